@@ -0,0 +1,166 @@
+#include "batch.hpp"
+
+#include <iostream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <QRegularExpression>
+
+#include "data.hpp"
+#include "util.hpp"
+#include "glinit.hpp"
+
+std::vector<BatchJob> readBatchManifest()
+{
+    const auto manifestPath=QString::fromStdString(opts.batchManifestPath);
+    QFile file(manifestPath);
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open batch manifest \"" << manifestPath << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    const QDir manifestDir=QFileInfo(manifestPath).absoluteDir();
+
+    // Each line has the description path and the output directory, either of them in double quotes if it contains spaces
+    const QRegularExpression lineFormat(R"(^\s*(?:"([^"]*)"|(\S+))\s+(?:"([^"]*)"|(\S+))\s*$)");
+    std::vector<BatchJob> jobs;
+    QTextStream in(&file);
+    for(int lineNumber=1; !in.atEnd(); ++lineNumber)
+    {
+        const auto line=in.readLine();
+        if(line.trimmed().isEmpty() || line.trimmed().startsWith('#'))
+            continue;
+        const auto match=lineFormat.match(line);
+        if(!match.hasMatch())
+            throw ParsingError{manifestPath,lineNumber,"expected atmosphere description path and output directory"};
+        const auto atmoDescrPath = match.captured(1).isEmpty() ? match.captured(2) : match.captured(1);
+        const auto outputDir = match.captured(3).isEmpty() ? match.captured(4) : match.captured(3);
+        jobs.push_back({QDir::cleanPath(manifestDir.absoluteFilePath(atmoDescrPath)),
+                        QDir::cleanPath(manifestDir.absoluteFilePath(outputDir)).toStdString()});
+    }
+    if(jobs.empty())
+    {
+        std::cerr << "Batch manifest \"" << manifestPath << "\" lists no atmospheres\n";
+        throw MustQuit{};
+    }
+    return jobs;
+}
+
+namespace
+{
+
+// Replaces the placeholders ${name} if there are any, otherwise the value of the top-level key.
+// Values inside GLSL code, like a scale of number density, can only be swept using a placeholder.
+QString substituteSweepValue(QString text, QString const& value)
+{
+    const auto parameter=QString::fromStdString(opts.sweepParameter);
+    const auto placeholder="${"+parameter+"}";
+    if(text.contains(placeholder))
+        return text.replace(placeholder, value);
+
+    // Keys of the scatterer sections are indented, so only those at the start of the line are top-level
+    auto keyPattern=QRegularExpression::escape(parameter.trimmed());
+    keyPattern.replace("\\ ", "\\s+");
+    const QRegularExpression keyLine("^("+keyPattern+"\\s*:)[^#\n]*",
+                                     QRegularExpression::CaseInsensitiveOption|QRegularExpression::MultilineOption);
+    auto matches=keyLine.globalMatch(text);
+    if(!matches.hasNext())
+    {
+        std::cerr << "Swept parameter \"" << parameter << "\" is neither a top-level key of the atmosphere description "
+                     "nor a placeholder ${" << parameter << "} in it\n";
+        throw MustQuit{};
+    }
+    const auto match=matches.next();
+    if(matches.hasNext())
+    {
+        std::cerr << "Key \"" << parameter << "\" appears more than once in the atmosphere description, "
+                     "use a placeholder ${" << parameter << "} to mark the value to sweep\n";
+        throw MustQuit{};
+    }
+    const bool commentFollows = match.capturedEnd() < text.size() && text[match.capturedEnd()]=='#';
+    return text.replace(match.capturedStart(), match.capturedLength(),
+                        match.captured(1)+' '+value+(commentFollows ? " " : ""));
+}
+
+}
+
+std::vector<BatchJob> makeSweepJobs()
+{
+    const auto atmoDescrPath=QString::fromStdString(opts.sweepAtmoDescrPath);
+    QFile file(atmoDescrPath);
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open atmosphere description file \"" << atmoDescrPath << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    const QString text=file.readAll();
+
+    const auto digits=QString::number(opts.sweepValues.size()-1).size();
+    std::vector<BatchJob> jobs;
+    for(unsigned n=0; n<opts.sweepValues.size(); ++n)
+    {
+        const auto value=QString::fromStdString(opts.sweepValues[n]);
+        const auto pointDir=QString("point%1").arg(n, digits, 10, QChar('0'));
+        jobs.push_back({atmoDescrPath, opts.sweepOutputDir+"/"+pointDir.toStdString(),
+                        substituteSweepValue(text, value), value});
+    }
+    return jobs;
+}
+
+std::vector<BatchJob> batchJobs()
+{
+    if(!opts.sweepParameter.empty())
+        return makeSweepJobs();
+    return readBatchManifest();
+}
+
+void writeSweepIndex(std::vector<BatchJob> const& jobs)
+{
+    const auto path=QString::fromStdString(opts.sweepOutputDir)+"/sweep-index.json";
+    std::cerr << "Writing sweep index to \"" << path << "\"... ";
+
+    // The directories are relative to the index, so that the whole stack can be moved
+    const QDir outDir(QString::fromStdString(opts.sweepOutputDir));
+    QJsonArray points;
+    for(const auto& job : jobs)
+    {
+        QJsonObject point;
+        point["value"]=job.sweepValue;
+        point["directory"]=outDir.relativeFilePath(QString::fromStdString(job.textureOutputDir));
+        points.append(point);
+    }
+    QJsonObject root;
+    root["parameter"]=QString::fromStdString(opts.sweepParameter);
+    root["atmosphereDescription"]=QFileInfo(QString::fromStdString(opts.sweepAtmoDescrPath)).absoluteFilePath();
+    root["points"]=points;
+
+    QFile file(path);
+    if(!file.open(QFile::WriteOnly))
+    {
+        std::cerr << "FAILED to open: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    file.write(QJsonDocument(root).toJson());
+    file.close();
+    if(file.error())
+    {
+        std::cerr << "FAILED to write: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+}
+
+void loadBatchJob(BatchJob const& job)
+{
+    resetAtmosphereState();
+    atmo.textureOutputDir=job.textureOutputDir;
+    const AtmosphereParameters::ForceNoEDSTextures forceNoEDSTextures{opts.dbgNoEDSTextures};
+    if(job.atmoDescrText.isEmpty())
+        atmo.parse(job.atmoDescrPath, forceNoEDSTextures);
+    else
+        atmo.parseText(job.atmoDescrText, job.atmoDescrPath, forceNoEDSTextures);
+}
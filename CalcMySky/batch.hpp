@@ -0,0 +1,39 @@
+#ifndef INCLUDE_ONCE_E29B5D17_4AC6_4F03_8B7E_1D60C3A94F52
+#define INCLUDE_ONCE_E29B5D17_4AC6_4F03_8B7E_1D60C3A94F52
+
+#include <string>
+#include <vector>
+#include <QString>
+
+/* Computation of several atmospheres in one process, see --batch.
+ *
+ * The OpenGL context, the FBOs, the texture objects and the program cache are created once and
+ * shared by all the atmospheres, so that the identical programs, like those for accumulation and
+ * texture saving, are only compiled once. Between the atmospheres the global state is reset by
+ * resetAtmosphereState(), and the textures are reallocated for the new sizes.
+ *
+ * A sweep (see --sweep) is a batch generated from a single atmosphere description by substituting
+ * each of the values of one parameter. Its points share the stage cache of --reuse-stages, so the
+ * stages that don't depend on the swept parameter are only computed for the first point.
+ */
+
+struct BatchJob
+{
+    QString atmoDescrPath;
+    std::string textureOutputDir;
+    QString atmoDescrText; // if not empty, parsed instead of the contents of atmoDescrPath
+    QString sweepValue;
+};
+
+// Reads opts.batchManifestPath. Relative paths in the manifest are relative to its directory.
+std::vector<BatchJob> readBatchManifest();
+// Generates the points of the sweep over opts.sweepParameter
+std::vector<BatchJob> makeSweepJobs();
+// The jobs of either the manifest or the sweep, whichever is requested
+std::vector<BatchJob> batchJobs();
+// Writes the index mapping the values of the swept parameter to the output directories
+void writeSweepIndex(std::vector<BatchJob> const& jobs);
+// Resets the state left by the previous job and parses the atmosphere description of this one
+void loadBatchJob(BatchJob const& job);
+
+#endif
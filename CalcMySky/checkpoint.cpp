@@ -0,0 +1,365 @@
+#include "checkpoint.hpp"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <filesystem>
+#include <QDir>
+#include <QFile>
+
+#include "data.hpp"
+#include "util.hpp"
+#include "disk-accumulation.hpp"
+#include "texture-saving.hpp"
+#include "convergence.hpp"
+
+namespace
+{
+
+constexpr char configFileName[]="config";
+constexpr char progressFileName[]="progress";
+constexpr char completeStateName[]="complete";
+constexpr char ordersStatePrefix[]="orders";
+constexpr char convergencePrefix[]="convergence: ";
+constexpr char accumulatorFileName[]="multiple-scattering-accumulator.f32";
+
+struct CheckpointTexture
+{
+    std::string fileName;
+    GLenum target;
+    TextureId id;
+};
+
+bool checkpointsEnabled()
+{
+    // Without textures saved there's no long computation to checkpoint
+    return !opts.checkpointDir.empty() && !opts.dbgNoSaveTextures;
+}
+
+std::string wavelengthSetDir(const unsigned texIndex)
+{
+    return opts.checkpointDir+"/wlset"+std::to_string(texIndex);
+}
+
+std::string stateDir(const unsigned texIndex, std::string const& state)
+{
+    return wavelengthSetDir(texIndex)+"/"+state;
+}
+
+QString checkpointConfig()
+{
+    // Everything that affects the contents of the checkpointed textures. Whether the wavelength
+    // sets are computed by workers doesn't matter, since the same partial textures are saved anyway.
+    // The size of the memory budget doesn't matter either, only whether multiple scattering is accumulated on disk.
+    return QString("radiance: %1\nno-eds-tex: %2\naccumulated-on-disk: %3\n%4").arg(opts.saveResultAsRadiance)
+                                                                             .arg(opts.dbgNoEDSTextures)
+                                                                             .arg(accumulatingScatteringOnDisk())
+                                                                             .arg(atmo.descriptionFileText);
+}
+
+std::vector<CheckpointTexture> checkpointTextures(const bool wavelengthSetComplete)
+{
+    // The output of a completed wavelength set is all on disk, and no later set depends on its textures
+    if(wavelengthSetComplete)
+        return {};
+    std::vector<CheckpointTexture> list{{"transmittance.f32", GL_TEXTURE_2D, TEX_TRANSMITTANCE},
+                                        {"irradiance.f32", GL_TEXTURE_2D, TEX_IRRADIANCE},
+                                        {"delta-irradiance.f32", GL_TEXTURE_2D, TEX_DELTA_IRRADIANCE},
+                                        {"delta-scattering.f32", GL_TEXTURE_3D, TEX_DELTA_SCATTERING}};
+    // With accumulation on disk there's no multiple scattering texture, its accumulator file is saved instead
+    if(!accumulatingScatteringOnDisk())
+        list.push_back({"multiple-scattering.f32", GL_TEXTURE_3D, TEX_MULTIPLE_SCATTERING});
+    return list;
+}
+
+void copyFile(std::string const& from, std::string const& to)
+{
+    QFile::remove(QString::fromStdString(to));
+    if(!QFile::copy(QString::fromStdString(from), QString::fromStdString(to)))
+    {
+        std::cerr << "Failed to copy \"" << from << "\" to \"" << to << "\"\n";
+        throw MustQuit{};
+    }
+}
+
+std::vector<int> textureSizes(CheckpointTexture const& tex)
+{
+    if(tex.target==GL_TEXTURE_3D)
+        return {atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1], atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]};
+    switch(tex.id)
+    {
+    case TEX_TRANSMITTANCE:
+        return {atmo.transmittanceTexW, atmo.transmittanceTexH};
+    case TEX_IRRADIANCE:
+    case TEX_DELTA_IRRADIANCE:
+        return {atmo.irradianceTexW, atmo.irradianceTexH};
+    default:
+        std::cerr << "Internal error: unexpected checkpointed texture " << tex.fileName << "\n";
+        throw MustQuit{};
+    }
+}
+
+struct Progress
+{
+    std::string state; // name of the state after the last completed unit, empty if there's none
+    std::string convergence; // see scatteringOrdersConvergenceState(), empty if not recorded
+};
+
+Progress readProgress(const unsigned texIndex)
+{
+    QFile file(QString::fromStdString(wavelengthSetDir(texIndex)+"/"+progressFileName));
+    if(!file.exists()) return {};
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open checkpoint progress file \"" << file.fileName() << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    const auto lines=QString::fromUtf8(file.readAll()).trimmed().split('\n');
+    Progress progress{lines[0].trimmed().toStdString(), {}};
+    for(int i=1; i<lines.size(); ++i)
+        if(lines[i].startsWith(convergencePrefix))
+            progress.convergence=lines[i].mid(std::strlen(convergencePrefix)).trimmed().toStdString();
+    return progress;
+}
+
+void writeProgress(const unsigned texIndex, std::string const& state, std::string const& convergence={})
+{
+    // Write to a temporary file and then rename it over the old one, so that a crash in
+    // the middle leaves either the old or the new record, but not a broken one.
+    const auto path=wavelengthSetDir(texIndex)+"/"+progressFileName;
+    const auto tmpPath=path+".tmp";
+    {
+        QFile file(QString::fromStdString(tmpPath));
+        if(!file.open(QFile::WriteOnly))
+        {
+            std::cerr << "Failed to open checkpoint progress file \"" << tmpPath << "\": " << file.errorString() << "\n";
+            throw MustQuit{};
+        }
+        file.write(QByteArray::fromStdString(state+"\n"));
+        if(!convergence.empty())
+            file.write(QByteArray::fromStdString(convergencePrefix+convergence+"\n"));
+        file.close();
+        if(file.error())
+        {
+            std::cerr << "Failed to write checkpoint progress file \"" << tmpPath << "\": " << file.errorString() << "\n";
+            throw MustQuit{};
+        }
+    }
+    namespace fs=std::filesystem;
+    std::error_code err;
+    fs::rename(fs::u8path(tmpPath), fs::u8path(path), err);
+    if(err)
+    {
+        std::cerr << "Failed to rename \"" << tmpPath << "\" to \"" << path << "\": "
+                  << QString::fromLocal8Bit(err.message().c_str()) << "\n";
+        throw MustQuit{};
+    }
+}
+
+void removeState(const unsigned texIndex, std::string const& state)
+{
+    if(state.empty()) return;
+    QDir(QString::fromStdString(stateDir(texIndex, state))).removeRecursively();
+}
+
+void saveState(const unsigned texIndex, std::string const& state, const bool wavelengthSetComplete)
+{
+    const auto dir=stateDir(texIndex, state);
+    std::cerr << indentOutput() << "Saving checkpoint to \"" << dir << "\":\n";
+    OutputIndentIncrease incr;
+
+    createDirs(dir);
+    for(const auto& tex : checkpointTextures(wavelengthSetComplete))
+    {
+        const auto path=dir+"/"+tex.fileName;
+        saveTexture(tex.target, textures[tex.id], tex.fileName, path, textureSizes(tex),
+                    ReturnTextureData{false}, ReducePrecision{false});
+    }
+    // The accumulator file is updated in place by each scattering order, so it must be snapshotted
+    // together with the textures. Otherwise, after a crash between accumulating an order and saving
+    // the checkpoint for it, the resumed run would add this order to the file once again.
+    if(!wavelengthSetComplete && accumulatingScatteringOnDisk())
+    {
+        const auto path=dir+"/"+accumulatorFileName;
+        std::cerr << indentOutput() << "Copying multiple scattering accumulator file to \"" << path << "\"... ";
+        copyFile(multipleScatteringAccumulatorPath(texIndex), path);
+        std::cerr << "done\n";
+    }
+
+    // The progress record written after this must not claim textures that aren't on disk yet. Nor may any
+    // other output of the stages it marks as done still be pending: a resumed run skips these stages, so
+    // it wouldn't save this output again.
+    waitForTextureSaves();
+}
+
+QByteArray readStateFile(std::string const& path)
+{
+    QFile file(QString::fromStdString(path));
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "failed to open \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    const auto data=file.readAll();
+    if(file.error())
+    {
+        std::cerr << "failed to read \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    return data;
+}
+
+void loadState(const unsigned texIndex, std::string const& state)
+{
+    const auto dir=stateDir(texIndex, state);
+    std::cerr << indentOutput() << "Restoring checkpoint from \"" << dir << "\"... ";
+
+    for(const auto& tex : checkpointTextures(false))
+    {
+        const auto path=dir+"/"+tex.fileName;
+        const auto data=readStateFile(path);
+        const auto sizes=textureSizes(tex);
+        std::vector<uint16_t> header(sizes.size());
+        const auto headerByteCount=header.size()*sizeof header[0];
+        size_t pixelCount=1;
+        for(const auto s : sizes)
+            pixelCount *= s;
+        if(size_t(data.size()) != headerByteCount+pixelCount*sizeof(glm::vec4))
+        {
+            std::cerr << "size of \"" << path << "\" doesn't match the texture\n";
+            throw MustQuit{};
+        }
+        std::memcpy(header.data(), data.data(), headerByteCount);
+        if(!std::equal(header.begin(), header.end(), sizes.begin()))
+        {
+            std::cerr << "header of \"" << path << "\" doesn't match the texture sizes\n";
+            throw MustQuit{};
+        }
+
+        const auto pixels=reinterpret_cast<const GLfloat*>(data.data()+headerByteCount);
+        gl.glBindTexture(tex.target, textures[tex.id]);
+        if(tex.target==GL_TEXTURE_3D)
+        {
+            gl.glTexImage3D(GL_TEXTURE_3D,0,GL_RGBA32F,atmo.scatTexWidth(),atmo.scatTexHeight(),atmo.scatTexDepth(),
+                            0,GL_RGBA,GL_FLOAT,pixels);
+        }
+        else
+        {
+            gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,sizes[0],sizes[1],0,GL_RGBA,GL_FLOAT,pixels);
+            gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        }
+        gl.glBindTexture(tex.target, 0);
+        if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+        {
+            std::cerr << "GL error while uploading \"" << path << "\": " << openglErrorString(err) << "\n";
+            throw MustQuit{};
+        }
+    }
+    if(accumulatingScatteringOnDisk())
+        copyFile(dir+"/"+accumulatorFileName, multipleScatteringAccumulatorPath(texIndex));
+
+    std::cerr << "done\n";
+}
+
+}
+
+void initCheckpoints()
+{
+    if(!checkpointsEnabled()) return;
+
+    const auto configPath=QString::fromStdString(opts.checkpointDir+"/"+configFileName);
+    if(opts.resume)
+    {
+        QFile file(configPath);
+        if(!file.open(QFile::ReadOnly))
+        {
+            std::cerr << "Failed to open checkpoint in \"" << opts.checkpointDir << "\": " << file.errorString() << "\n";
+            throw MustQuit{};
+        }
+        if(QString::fromUtf8(file.readAll()) != checkpointConfig())
+        {
+            std::cerr << "Checkpoint in \"" << opts.checkpointDir << "\" was made with a different atmosphere description or options\n";
+            throw MustQuit{};
+        }
+        std::cerr << "Resuming from checkpoint in \"" << opts.checkpointDir << "\"\n";
+        return;
+    }
+
+    // Starting from scratch, so any old checkpoint is stale
+    QDir(QString::fromStdString(opts.checkpointDir)).removeRecursively();
+    createDirs(opts.checkpointDir);
+    QFile file(configPath);
+    if(!file.open(QFile::WriteOnly))
+    {
+        std::cerr << "Failed to open \"" << configPath << "\" for writing: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    file.write(checkpointConfig().toUtf8());
+    file.close();
+    if(file.error())
+    {
+        std::cerr << "Failed to write \"" << configPath << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+}
+
+bool wavelengthSetCompletedPreviously(const unsigned texIndex)
+{
+    if(!checkpointsEnabled() || !opts.resume) return false;
+    return readProgress(texIndex).state==completeStateName;
+}
+
+unsigned restoreCheckpoint(const unsigned texIndex)
+{
+    if(!checkpointsEnabled() || !opts.resume) return 0;
+
+    if(const auto progress=readProgress(texIndex); !progress.state.empty())
+    {
+        const auto ordersDone=QString::fromStdString(progress.state).mid(std::strlen(ordersStatePrefix)).toUInt();
+        loadState(texIndex, progress.state);
+        // Without the recorded convergence state the check starts anew, which can only delay the termination
+        if(opts.scatteringOrdersTolerance>0 && !progress.convergence.empty() &&
+           !restoreScatteringOrdersConvergence(progress.convergence))
+        {
+            std::cerr << "Checkpoint progress file of wavelength set " << texIndex << " has malformed convergence record\n";
+            throw MustQuit{};
+        }
+        std::cerr << indentOutput() << "Continuing after scattering order " << ordersDone << "\n";
+        return ordersDone;
+    }
+
+    return 0;
+}
+
+void saveCheckpoint(const unsigned texIndex, const unsigned scatteringOrdersDone)
+{
+    if(!checkpointsEnabled()) return;
+
+    const auto oldState=readProgress(texIndex).state;
+    const auto newState=ordersStatePrefix+std::to_string(scatteringOrdersDone);
+    saveState(texIndex, newState, false);
+    writeProgress(texIndex, newState, scatteringOrdersConvergenceState());
+    if(oldState!=newState)
+        removeState(texIndex, oldState);
+}
+
+void saveWavelengthSetCompletedCheckpoint(const unsigned texIndex)
+{
+    if(!checkpointsEnabled()) return;
+
+    const auto oldState=readProgress(texIndex).state;
+    saveState(texIndex, completeStateName, true);
+    writeProgress(texIndex, completeStateName);
+    if(oldState!=completeStateName)
+        removeState(texIndex, oldState);
+}
+
+void removeCheckpoints()
+{
+    if(!checkpointsEnabled()) return;
+    if(!QDir(QString::fromStdString(opts.checkpointDir)).removeRecursively())
+        std::cerr << "Warning: failed to remove checkpoint directory \"" << opts.checkpointDir << "\"\n";
+}
@@ -0,0 +1,21 @@
+#ifndef INCLUDE_ONCE_4B1C7E0A_2D6F_4E8B_A3F1_9C5D0E7B6A24
+#define INCLUDE_ONCE_4B1C7E0A_2D6F_4E8B_A3F1_9C5D0E7B6A24
+
+/* Checkpoints are kept per wavelength set. The units of work recorded are the scattering
+ * orders of multiple scattering computation and the whole wavelength set. Together with the
+ * record of the last completed unit, the checkpoint contains all the textures needed to
+ * continue computation after this unit. No wavelength set depends on the textures of another
+ * one: their luminance contributions are saved as separate partial textures, see computingPartials().
+ *
+ * All these functions do nothing if no checkpoint directory was requested.
+ */
+
+void initCheckpoints();
+bool wavelengthSetCompletedPreviously(unsigned texIndex);
+// Returns the number of scattering orders whose computation can be skipped
+unsigned restoreCheckpoint(unsigned texIndex);
+void saveCheckpoint(unsigned texIndex, unsigned scatteringOrdersDone);
+void saveWavelengthSetCompletedCheckpoint(unsigned texIndex);
+void removeCheckpoints();
+
+#endif
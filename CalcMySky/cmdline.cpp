@@ -171,6 +171,48 @@ void handleCmdLine()
     const QCommandLineOption printOpenGLInfoAndQuit("opengl-info","Print OpenGL info and quit");
     const QCommandLineOption textureOutputDirOpt("out-dir","Directory for the textures computed","output directory",".");
     const QCommandLineOption saveResultAsRadianceOpt("radiance","Save result as radiance instead of XYZW components");
+    const QCommandLineOption jobsOpt("jobs","Compute wavelength sets in parallel in N worker processes. Luminance textures are merged in a fixed order, "
+                                            "the same way as without this option, so the result doesn't depend on N.","N");
+    QCommandLineOption workerWavelengthSetsOpt("worker-wlsets","Comma-separated list of wavelength set indices to compute (used by --jobs)","indices");
+    workerWavelengthSetsOpt.setFlags(QCommandLineOption::HiddenFromHelp);
+    const QCommandLineOption checkpointDirOpt("checkpoint-dir","Save checkpoints to the given directory after each scattering order and wavelength set, "
+                                                            "so that the computation can be continued with --resume after a failure","directory");
+    const QCommandLineOption resumeOpt("resume","Skip the work recorded as completed in the checkpoint directory and continue from the last checkpoint");
+    const QCommandLineOption layersPerDrawOpt("layers-per-draw","Number of 3D texture layers rendered by a single draw call, 0 meaning all of them. Large values reduce "
+                                                              "overhead, but may trigger GPU watchdog timeouts on some systems; 1 renders the layers one by one.","N");
+    const QCommandLineOption programCacheDirOpt("program-cache-dir","Directory to cache compiled shader programs in, so that subsequent runs can reuse them. "
+                                                                  "Without this option, the programs are only cached in memory within a single run.",
+                                                "directory");
+    const QCommandLineOption saveQueueDepthOpt("save-queue-depth","Maximum number of textures being saved in background while computation goes on, "
+                                                                "0 meaning synchronous saving. Each queued texture takes host memory.","N");
+    const QCommandLineOption scatteringOrdersToleranceOpt("scattering-orders-tolerance","Stop computing scattering orders when the contribution of the last order "
+                                                                              "relative to the sum of orders from 2 on falls below this value. 0 means computing "
+                                                                              "all the orders from the atmosphere description.","tolerance");
+    const QCommandLineOption memoryBudgetOpt("memory-budget","Accumulate single and multiple scattering in their output files instead of VRAM, "
+                                                        "chunk by chunk of altitude layers, the chunk being as large as the given number of MiB "
+                                                        "allows together with the other textures. This doesn't bound VRAM use by an arbitrary "
+                                                        "budget: delta scattering and scattering density are still kept whole in VRAM, so the "
+                                                        "budget must fit two full 4D textures. 0 means keeping the accumulators in VRAM.","MiB");
+    const QCommandLineOption reuseStagesOpt("reuse-stages","Keep the results of the stages that don't depend on the whole atmosphere description in the "
+                                                       "output directory, tagged with hashes of their inputs, and reuse them in subsequent runs if "
+                                                       "the inputs haven't changed");
+    const QCommandLineOption profileReportOpt("profile-report","Write wall-clock and GPU timings of each computation stage, shader program build times "
+                                                           "and sizes of the files written to the given file in JSON format","file");
+    const QCommandLineOption progressJSONOpt("progress-json","Write progress events (stage begin and end, work units done of total, "
+                                                         "estimated time remaining) as JSON lines to the given file or, if a number "
+                                                         "is given, to the file descriptor with this number","file or fd");
+    const QCommandLineOption estimateOpt("estimate","Print the VRAM, host memory and disk space the computation would need, and "
+                                                    "its runtime if a calibration profile is given, then quit without computing");
+    const QCommandLineOption calibrationOpt("calibration","Calibration profile for --estimate to predict the runtime","file");
+    const QCommandLineOption writeCalibrationOpt("write-calibration","Write a calibration profile for --estimate from the timings of "
+                                                                    "this run, preferably of a small atmosphere model","file");
+    const QCommandLineOption batchOpt("batch","Compute the atmospheres listed in the manifest file in this process, sharing the OpenGL context "
+                                              "and compiled shader programs. Each line of the manifest contains a path to an atmosphere "
+                                              "description and an output directory","manifest");
+    const QCommandLineOption sweepOpt("sweep","Compute the atmosphere for each of the values of the given parameter, separated by semicolons, "
+                                              "into numbered subdirectories of the output directory, computing the stages that don't depend "
+                                              "on the parameter only once. The parameter is a top-level key of the atmosphere description, "
+                                              "or a name used in it as ${name} placeholder","name=value1;value2;...");
     const QCommandLineOption textureSavePrecisionOpt("texture-save-precision","Number of bits of precision when saving 3D textures, from 1 to 24. Smaller number improves compressibility. Too small destroys fidelity.","bits");
     const QCommandLineOption dbgNoSaveTexturesOpt("no-save-tex","Don't save textures, only save shaders and other fast-to-compute data; don't run the long 4D "
                                                                 "textures computations (for debugging)");
@@ -187,6 +229,23 @@ void handleCmdLine()
                         textureOutputDirOpt,
                         saveResultAsRadianceOpt,
                         textureSavePrecisionOpt,
+                        jobsOpt,
+                        workerWavelengthSetsOpt,
+                        checkpointDirOpt,
+                        resumeOpt,
+                        layersPerDrawOpt,
+                        saveQueueDepthOpt,
+                        programCacheDirOpt,
+                        scatteringOrdersToleranceOpt,
+                        memoryBudgetOpt,
+                        reuseStagesOpt,
+                        profileReportOpt,
+                        progressJSONOpt,
+                        estimateOpt,
+                        calibrationOpt,
+                        writeCalibrationOpt,
+                        batchOpt,
+                        sweepOpt,
                         dbgNoEDSTexturesOpt,
                         dbgNoSaveTexturesOpt,
                         printOpenGLInfoAndQuit,
@@ -260,13 +319,180 @@ void handleCmdLine()
         }
     }
 
+    if(parser.isSet(jobsOpt))
+    {
+        bool ok=false;
+        opts.jobs=parser.value(jobsOpt).toUInt(&ok);
+        if(!ok || opts.jobs==0)
+        {
+            std::cerr << "Number of jobs must be a positive integer\n";
+            throw MustQuit{};
+        }
+    }
+
+    if(parser.isSet(layersPerDrawOpt))
+    {
+        bool ok=false;
+        opts.layersPerDraw=parser.value(layersPerDrawOpt).toUInt(&ok);
+        if(!ok)
+        {
+            std::cerr << "Number of layers per draw must be a non-negative integer\n";
+            throw MustQuit{};
+        }
+    }
+
+    opts.programCacheDir=parser.value(programCacheDirOpt).toStdString();
+
+    if(parser.isSet(saveQueueDepthOpt))
+    {
+        bool ok=false;
+        opts.saveQueueDepth=parser.value(saveQueueDepthOpt).toUInt(&ok);
+        if(!ok)
+        {
+            std::cerr << "Save queue depth must be a non-negative integer\n";
+            throw MustQuit{};
+        }
+    }
+
+    if(parser.isSet(scatteringOrdersToleranceOpt))
+    {
+        bool ok=false;
+        opts.scatteringOrdersTolerance=parser.value(scatteringOrdersToleranceOpt).toDouble(&ok);
+        if(!ok || !(opts.scatteringOrdersTolerance>=0))
+        {
+            std::cerr << "Scattering orders tolerance must be a non-negative number\n";
+            throw MustQuit{};
+        }
+    }
+
+    if(parser.isSet(memoryBudgetOpt))
+    {
+        bool ok=false;
+        opts.memoryBudgetMiB=parser.value(memoryBudgetOpt).toUInt(&ok);
+        if(!ok)
+        {
+            std::cerr << "Memory budget must be a non-negative integer\n";
+            throw MustQuit{};
+        }
+    }
+
+    if(parser.isSet(reuseStagesOpt))
+        opts.reuseStages=true;
+
+    if(parser.isSet(profileReportOpt))
+        opts.profileReportPath=parser.value(profileReportOpt).toStdString();
+
+    if(parser.isSet(estimateOpt))
+        opts.estimateOnly=true;
+
+    if(parser.isSet(calibrationOpt))
+    {
+        if(!opts.estimateOnly)
+        {
+            std::cerr << "Calibration profile is only used with --estimate\n";
+            throw MustQuit{};
+        }
+        opts.calibrationPath=parser.value(calibrationOpt).toStdString();
+    }
+
+    if(parser.isSet(progressJSONOpt))
+    {
+        opts.progressJSONDest=parser.value(progressJSONOpt).toStdString();
+        if(opts.progressJSONDest.empty())
+        {
+            std::cerr << "Progress stream destination must not be empty\n";
+            throw MustQuit{};
+        }
+    }
+
+    if(parser.isSet(checkpointDirOpt))
+    {
+        opts.checkpointDir=parser.value(checkpointDirOpt).toStdString();
+    }
+    if(parser.isSet(resumeOpt))
+    {
+        if(opts.checkpointDir.empty())
+        {
+            std::cerr << "Option --resume requires --checkpoint-dir\n";
+            throw MustQuit{};
+        }
+        opts.resume=true;
+    }
+
+    if(parser.isSet(writeCalibrationOpt))
+    {
+        // Stages done by other processes or reused from previous runs would make the costs meaningless
+        if(opts.jobs || opts.reuseStages || !opts.checkpointDir.empty())
+        {
+            std::cerr << "Calibration can't be written in a run with --jobs, --reuse-stages or --checkpoint-dir\n";
+            throw MustQuit{};
+        }
+        opts.calibrationOutputPath=parser.value(writeCalibrationOpt).toStdString();
+    }
+
     const auto posArgs=parser.positionalArguments();
     if(posArgs.size()>1)
     {
         std::cerr << "Too many arguments\n";
         throw MustQuit{};
     }
-    if(!posArgs.isEmpty())
+    if(parser.isSet(batchOpt) && parser.isSet(sweepOpt))
+    {
+        std::cerr << "Options --batch and --sweep can't be combined\n";
+        throw MustQuit{};
+    }
+    if(parser.isSet(batchOpt))
+    {
+        if(!posArgs.isEmpty() || parser.isSet(textureOutputDirOpt))
+        {
+            std::cerr << "With --batch the atmosphere descriptions and output directories are taken from the manifest\n";
+            throw MustQuit{};
+        }
+        // Workers and checkpoints identify their work by wavelength sets of a single atmosphere
+        if(opts.jobs || !opts.checkpointDir.empty() || !opts.calibrationOutputPath.empty())
+        {
+            std::cerr << "Option --batch can't be combined with --jobs, --checkpoint-dir or --write-calibration\n";
+            throw MustQuit{};
+        }
+        opts.batchManifestPath=parser.value(batchOpt).toStdString();
+    }
+    else if(parser.isSet(sweepOpt))
+    {
+        if(posArgs.isEmpty())
+        {
+            std::cerr << "Option --sweep requires an atmosphere description\n";
+            throw MustQuit{};
+        }
+        if(opts.jobs || !opts.checkpointDir.empty() || !opts.calibrationOutputPath.empty())
+        {
+            std::cerr << "Option --sweep can't be combined with --jobs, --checkpoint-dir or --write-calibration\n";
+            throw MustQuit{};
+        }
+        const auto sweep=parser.value(sweepOpt);
+        const auto equalsPos=sweep.indexOf('=');
+        const auto parameter = equalsPos<0 ? QString{} : sweep.left(equalsPos).trimmed();
+        if(parameter.isEmpty())
+        {
+            std::cerr << "Sweep must be given as name=value1;value2;...\n";
+            throw MustQuit{};
+        }
+        for(const auto& value : sweep.mid(equalsPos+1).split(';'))
+        {
+            if(value.trimmed().isEmpty())
+            {
+                std::cerr << "Empty value in the sweep: " << sweep << "\n";
+                throw MustQuit{};
+            }
+            opts.sweepValues.push_back(value.trimmed().toStdString());
+        }
+        opts.sweepParameter=parameter.toStdString();
+        // The description is parsed for each point, since with placeholders it's not valid by itself
+        opts.sweepAtmoDescrPath=posArgs[0].toStdString();
+        opts.sweepOutputDir=atmo.textureOutputDir;
+        opts.stageCacheDir=opts.sweepOutputDir+"/stage-cache";
+        opts.reuseStages=true;
+    }
+    else if(!posArgs.isEmpty())
     {
         const auto atmoDescrFileName=posArgs[0];
         atmo.parse(atmoDescrFileName, AtmosphereParameters::ForceNoEDSTextures{opts.dbgNoEDSTextures});
@@ -276,4 +502,22 @@ void handleCmdLine()
         showHelp(std::cerr, options, positionalArgument.first);
         throw MustQuit{};
     }
+
+    if(parser.isSet(workerWavelengthSetsOpt))
+    {
+        for(const auto& str : parser.value(workerWavelengthSetsOpt).split(','))
+        {
+            bool ok=false;
+            const auto texIndex=str.toUInt(&ok);
+            if(!ok || texIndex>=atmo.allWavelengths.size() ||
+               (!opts.wavelengthSetsToCompute.empty() && texIndex<=opts.wavelengthSetsToCompute.back()))
+            {
+                std::cerr << "Bad list of wavelength sets for the worker: " << parser.value(workerWavelengthSetsOpt) << "\n";
+                throw MustQuit{};
+            }
+            opts.wavelengthSetsToCompute.push_back(texIndex);
+        }
+        // Worker processes inherit the parent's command line, including --jobs
+        opts.jobs=0;
+    }
 }
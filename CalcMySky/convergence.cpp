@@ -0,0 +1,190 @@
+#include "convergence.hpp"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iostream>
+#include <QFile>
+#include <QTextStream>
+
+#include "data.hpp"
+#include "util.hpp"
+#include "shaders.hpp"
+
+namespace
+{
+
+glm::dvec4 sumOfOrders(0);
+bool haveSumOfOrders=false;
+
+std::string orderReachedPath(const unsigned texIndex)
+{
+    return atmo.textureOutputDir+"/scattering-orders-reached-wlset"+std::to_string(texIndex)+".txt";
+}
+
+// Sums the texels in two passes on the GPU, so that only one texel per layer needs to be read back
+glm::dvec4 sumDeltaScatteringTexels()
+{
+    GLint viewport[4];
+    gl.glGetIntegerv(GL_VIEWPORT, viewport);
+    gl.glBindFramebuffer(GL_FRAMEBUFFER,fbos[FBO_DELTA_SCATTERING_SUMS]);
+
+    gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,textures[TEX_DELTA_SCATTERING_ROW_SUMS],0);
+    checkFramebufferStatus("framebuffer for summation of delta scattering texture rows");
+    gl.glViewport(0, 0, atmo.scatTexHeight(), atmo.scatTexDepth());
+    {
+        const auto program=compileShaderProgram("sum-3d-texture-rows.frag", "3D texture row summation shader program");
+        program->bind();
+        setUniformTexture(*program,GL_TEXTURE_3D,TEX_DELTA_SCATTERING,0,"tex");
+        renderQuad();
+    }
+
+    gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,textures[TEX_DELTA_SCATTERING_LAYER_SUMS],0);
+    checkFramebufferStatus("framebuffer for summation of delta scattering texture layers");
+    gl.glViewport(0, 0, atmo.scatTexDepth(), 1);
+    {
+        const auto program=compileShaderProgram("sum-2d-texture-rows.frag", "2D texture row summation shader program");
+        program->bind();
+        setUniformTexture(*program,GL_TEXTURE_2D,TEX_DELTA_SCATTERING_ROW_SUMS,0,"tex");
+        renderQuad();
+    }
+    gl.glBindFramebuffer(GL_FRAMEBUFFER,0);
+    gl.glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    std::vector<glm::vec4> layerSums(atmo.scatTexDepth());
+    gl.glBindTexture(GL_TEXTURE_2D,textures[TEX_DELTA_SCATTERING_LAYER_SUMS]);
+    gl.glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, layerSums.data());
+    gl.glBindTexture(GL_TEXTURE_2D,0);
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error in sumDeltaScatteringTexels() after glGetTexImage() call: " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+
+    glm::dvec4 sum(0);
+    for(const auto& layerSum : layerSums)
+        sum += glm::dvec4(layerSum);
+    return sum;
+}
+
+}
+
+void resetScatteringOrdersConvergence()
+{
+    sumOfOrders=glm::dvec4(0);
+    haveSumOfOrders=false;
+}
+
+std::string scatteringOrdersConvergenceState()
+{
+    // 17 significant digits make the doubles read back exactly
+    return QString("%1 %2 %3 %4 %5 %6").arg(lastScatteringOrder)
+                                       .arg(int(haveSumOfOrders))
+                                       .arg(sumOfOrders[0], 0, 'g', 17)
+                                       .arg(sumOfOrders[1], 0, 'g', 17)
+                                       .arg(sumOfOrders[2], 0, 'g', 17)
+                                       .arg(sumOfOrders[3], 0, 'g', 17)
+                                       .toStdString();
+}
+
+bool restoreScatteringOrdersConvergence(std::string const& state)
+{
+    const auto parts=QString::fromStdString(state).split(' ');
+    if(parts.size()!=6) return false;
+
+    bool ok=false;
+    const auto lastOrder=parts[0].toUInt(&ok);
+    if(!ok) return false;
+    const auto haveSum=parts[1].toInt(&ok);
+    if(!ok) return false;
+    glm::dvec4 sum;
+    for(int i=0; i<4; ++i)
+    {
+        sum[i]=parts[2+i].toDouble(&ok);
+        if(!ok) return false;
+    }
+
+    lastScatteringOrder=lastOrder;
+    haveSumOfOrders=haveSum;
+    sumOfOrders=sum;
+    return true;
+}
+
+bool scatteringOrdersConverged(const unsigned scatteringOrder)
+{
+    const auto delta=sumDeltaScatteringTexels();
+    sumOfOrders += delta;
+    const bool haveRelativeContribution=haveSumOfOrders;
+    haveSumOfOrders=true;
+    if(!haveRelativeContribution)
+        return false;
+
+    // The largest among the wavelengths. Zero sums mean there's nothing to compute at this wavelength.
+    double relativeContribution=0;
+    for(int i=0; i<4; ++i)
+        if(sumOfOrders[i]>0)
+            relativeContribution=std::max(relativeContribution, delta[i]/sumOfOrders[i]);
+
+    std::cerr << indentOutput() << "Relative contribution of scattering order " << scatteringOrder << ": "
+              << relativeContribution << "\n";
+    return relativeContribution < opts.scatteringOrdersTolerance;
+}
+
+void saveScatteringOrderReached(const unsigned texIndex)
+{
+    const auto path=orderReachedPath(texIndex);
+    QFile file(QString::fromStdString(path));
+    if(!file.open(QFile::WriteOnly))
+    {
+        std::cerr << "Failed to open \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    file.write(QByteArray::number(lastScatteringOrder)+"\n");
+    file.close();
+    if(file.error())
+    {
+        std::cerr << "Failed to write \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+}
+
+void recordScatteringOrdersReached()
+{
+    unsigned maxOrderReached=0;
+    for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
+    {
+        QFile file(QString::fromStdString(orderReachedPath(texIndex)));
+        if(!file.open(QFile::ReadOnly))
+        {
+            // E.g. the wavelength set was completed in an earlier run without the tolerance
+            maxOrderReached=atmo.scatteringOrdersToCompute;
+            continue;
+        }
+        bool ok=false;
+        const auto order=file.readAll().trimmed().toUInt(&ok);
+        maxOrderReached=std::max(maxOrderReached, ok ? order : atmo.scatteringOrdersToCompute);
+        file.close();
+        file.remove();
+    }
+
+    const auto target=atmo.textureOutputDir+"/params.atmo";
+    std::cerr << "Recording scattering orders reached (" << maxOrderReached << ") in \"" << target << "\"...";
+    QFile file(target.c_str());
+    if(!file.open(QFile::WriteOnly|QFile::Append))
+    {
+        std::cerr << " FAILED to open: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    QTextStream out(&file);
+    // Being after the copy of the original description, this overrides its value
+    out << "\n# Highest scattering order reached with tolerance " << opts.scatteringOrdersTolerance << "\n"
+        << "scattering orders: " << maxOrderReached << "\n";
+    out.flush();
+    file.close();
+    if(file.error())
+    {
+        std::cerr << " FAILED to write: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << " done\n";
+}
@@ -0,0 +1,26 @@
+#ifndef INCLUDE_ONCE_9A46F8BA_FCE1_47F9_BED6_40A0C7563CE1
+#define INCLUDE_ONCE_9A46F8BA_FCE1_47F9_BED6_40A0C7563CE1
+
+/* Adaptive termination of multiple scattering computation, see --scattering-orders-tolerance.
+ *
+ * The contribution of a scattering order is measured by the sum of all texels of its delta scattering
+ * texture. Radiances are non-negative, so this is the L1 norm, and the norm of the sum of the orders
+ * is simply the sum of their norms. The sum is saved in checkpoints together with the last order,
+ * so that a resumed computation stops at the same order as an uninterrupted one.
+ */
+
+#include <string>
+
+void resetScatteringOrdersConvergence();
+// The sum of orders and lastScatteringOrder as a single line of text, for checkpoint progress records
+std::string scatteringOrdersConvergenceState();
+// Restores what scatteringOrdersConvergenceState() returned. Returns false if the state can't be parsed.
+bool restoreScatteringOrdersConvergence(std::string const& state);
+// Measures the delta scattering texture of the given order. Returns whether this order can be the last one.
+bool scatteringOrdersConverged(unsigned scatteringOrder);
+// Remembers lastScatteringOrder as the order reached for the wavelength set, for recordScatteringOrdersReached()
+void saveScatteringOrderReached(unsigned texIndex);
+// Writes the highest order reached by the wavelength sets to the output params.atmo
+void recordScatteringOrdersReached();
+
+#endif
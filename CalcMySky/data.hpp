@@ -6,6 +6,7 @@
 #include <cmath>
 #include <array>
 #include <vector>
+#include <string>
 #include <memory>
 #include <QOpenGLShader>
 #include <glm/glm.hpp>
@@ -26,6 +27,8 @@ enum FBOId
     FBO_MULTIPLE_SCATTERING,
     FBO_ECLIPSED_DOUBLE_SCATTERING,
     FBO_LIGHT_POLLUTION,
+    FBO_DELTA_SCATTERING_SUMS,
+    FBO_SCATTERING_CHUNK,
 
     FBO_COUNT
 };
@@ -38,21 +41,47 @@ enum TextureId
     TEX_DELTA_SCATTERING,
     TEX_MULTIPLE_SCATTERING,
     TEX_DELTA_SCATTERING_DENSITY,
-    TEX_ECLIPSED_DOUBLE_SCATTERING,
     TEX_LIGHT_POLLUTION_SCATTERING,
     TEX_LIGHT_POLLUTION_DELTA_SCATTERING,
     TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE,
     TEX_LIGHT_POLLUTION_SCATTERING_PREV_ORDER,
+    TEX_DELTA_SCATTERING_ROW_SUMS,
+    TEX_DELTA_SCATTERING_LAYER_SUMS,
+    TEX_SCATTERING_CHUNK,
 
     TEX_COUNT
 };
 inline GLuint textures[TEX_COUNT];
-// Accumulation of radiance to yield luminance
+// Conversion of single scattering radiance to luminance
 inline std::map<QString/*scatterer name*/, GLuint> accumulatedSingleScatteringTextures;
+// The last scattering order to compute for the current wavelength set: atmo.scatteringOrdersToCompute,
+// unless the orders converge earlier (see opts.scatteringOrdersTolerance)
+inline unsigned lastScatteringOrder=0;
 
 struct Options
 {
     unsigned textureSavePrecision = 0; // 0 means not reduced
+    std::string programCacheDir; // empty means caching program binaries only in memory
+    unsigned saveQueueDepth = 2; // 0 means saving textures synchronously
+    unsigned jobs = 0; // 0 means computing all wavelength sets in this process, without workers
+    std::vector<unsigned> wavelengthSetsToCompute; // non-empty only in worker processes
+    std::string checkpointDir; // empty means no checkpoints
+    bool resume=false;
+    unsigned layersPerDraw = 16; // 0 means all layers of a 3D texture in a single draw call
+    double scatteringOrdersTolerance = 0; // 0 means always computing atmo.scatteringOrdersToCompute orders
+    unsigned memoryBudgetMiB = 0; // 0 means keeping the scattering accumulators in VRAM
+    bool reuseStages=false;
+    std::string profileReportPath; // empty means no profiling
+    std::string progressJSONDest; // file path or descriptor number, empty means no progress stream
+    bool estimateOnly=false;
+    std::string calibrationPath; // used by --estimate, empty means not predicting runtime
+    std::string calibrationOutputPath; // empty means not writing calibration
+    std::string batchManifestPath; // empty means computing the single atmosphere given on the command line
+    std::string sweepParameter; // empty means no sweep
+    std::vector<std::string> sweepValues;
+    std::string sweepAtmoDescrPath;
+    std::string sweepOutputDir;
+    std::string stageCacheDir; // empty means the stage-cache subdirectory of the output directory
     bool openglDebug=false;
     bool openglDebugFull=false;
     bool printOpenGLInfoAndQuit=false;
@@ -0,0 +1,196 @@
+#include "disk-accumulation.hpp"
+
+#include <memory>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+#include <type_traits>
+#include <QFile>
+
+#include "parallel.hpp"
+#include "profiling.hpp"
+#include "texture-saving.hpp"
+
+namespace
+{
+
+GLsizei chunkLayerCount=0;
+// Sizes of the 4 dimensions stored as uint16 before the data, as saveTexture() does
+constexpr qint64 headerSize=4*sizeof(uint16_t);
+
+size_t textureBytes(const size_t width, const size_t height, const size_t depth=1)
+{
+    return width*height*depth*4*sizeof(GLfloat);
+}
+
+size_t layerSubpixelCount()
+{
+    return size_t(4)*atmo.scatTexWidth()*atmo.scatTexHeight();
+}
+
+std::vector<int> scatteringTextureSizes()
+{
+    return {atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1],
+            atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]};
+}
+
+}
+
+size_t fixedTexturesBytes()
+{
+    const auto width=atmo.scatTexWidth(), height=atmo.scatTexHeight(), depth=atmo.scatTexDepth();
+
+    size_t fixedBytes = 2*textureBytes(width,height,depth) // delta scattering and scattering density
+                      + textureBytes(atmo.transmittanceTexW, atmo.transmittanceTexH)
+                      + 2*textureBytes(atmo.irradianceTexW, atmo.irradianceTexH)
+                      + 4*textureBytes(atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
+    if(opts.scatteringOrdersTolerance>0)
+        fixedBytes += textureBytes(height, depth) + textureBytes(depth, 1);
+    return fixedBytes;
+}
+
+GLsizei scatteringChunkLayersForBudget()
+{
+    const auto budget=size_t(opts.memoryBudgetMiB)*1024*1024;
+    const auto fixedBytes=fixedTexturesBytes();
+    const auto layerBytes=textureBytes(atmo.scatTexWidth(),atmo.scatTexHeight());
+    if(budget < fixedBytes+layerBytes)
+        return 0;
+    return GLsizei(std::min<size_t>(atmo.scatTexDepth(), (budget-fixedBytes)/layerBytes));
+}
+
+void initScatteringChunks()
+{
+    const auto width=atmo.scatTexWidth(), height=atmo.scatTexHeight(), depth=atmo.scatTexDepth();
+
+    chunkLayerCount=scatteringChunkLayersForBudget();
+    if(!chunkLayerCount)
+    {
+        constexpr size_t MiB=1024*1024;
+        const auto neededBytes=fixedTexturesBytes()+textureBytes(width,height);
+        std::cerr << "Memory budget of " << opts.memoryBudgetMiB << " MiB is too small for this atmosphere model: at least "
+                  << (neededBytes+MiB-1)/MiB << " MiB are needed\n";
+        throw MustQuit{};
+    }
+    std::cerr << "Scattering textures will be accumulated on disk in chunks of " << chunkLayerCount
+              << " of " << depth << " layers\n";
+
+    gl.glBindTexture(GL_TEXTURE_3D,textures[TEX_SCATTERING_CHUNK]);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_R,GL_CLAMP_TO_EDGE);
+    setupTexture(TEX_SCATTERING_CHUNK,width,height,chunkLayerCount);
+}
+
+GLsizei scatteringChunkLayerCount()
+{
+    return chunkLayerCount;
+}
+
+std::string multipleScatteringAccumulatorPath(const unsigned texIndex)
+{
+    return computingPartials() ? partialLuminancePath("multiple-scattering", texIndex) :
+                                 atmo.textureOutputDir+"/multiple-scattering-wlset"+std::to_string(texIndex)+".f32";
+}
+
+void storeScatteringChunk(std::string const& path, const GLsizei firstLayer, const GLsizei layerCount, const bool add)
+{
+    // The whole chunk texture is read back, but only its first layerCount layers are used
+    std::unique_ptr<GLfloat[]> chunk(new GLfloat[layerSubpixelCount()*chunkLayerCount]);
+    gl.glActiveTexture(GL_TEXTURE0);
+    gl.glBindTexture(GL_TEXTURE_3D,textures[TEX_SCATTERING_CHUNK]);
+    gl.glGetTexImage(GL_TEXTURE_3D, 0, GL_RGBA, GL_FLOAT, chunk.get());
+    gl.glBindTexture(GL_TEXTURE_3D,0);
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error in storeScatteringChunk() after glGetTexImage() call: " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+
+    const auto writeBegin=std::chrono::steady_clock::now();
+    QFile file(QString::fromStdString(path));
+    const bool newFile = !add && firstLayer==0;
+    if(!file.open(newFile ? QFile::WriteOnly : QFile::ReadWrite))
+    {
+        std::cerr << "Failed to open accumulator file \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    if(newFile)
+    {
+        for(const uint16_t s : scatteringTextureSizes())
+            file.write(reinterpret_cast<const char*>(&s), sizeof s);
+    }
+
+    const auto subpixelCount=layerSubpixelCount()*layerCount;
+    const auto offset=headerSize+qint64(sizeof(GLfloat)*layerSubpixelCount())*firstLayer;
+    const auto byteCount=qint64(sizeof(GLfloat)*subpixelCount);
+    if(add)
+    {
+        std::unique_ptr<GLfloat[]> accumulated(new GLfloat[subpixelCount]);
+        if(!file.seek(offset) || file.read(reinterpret_cast<char*>(accumulated.get()), byteCount)!=byteCount)
+        {
+            std::cerr << "Failed to read layers " << firstLayer << " to " << firstLayer+layerCount-1
+                      << " of accumulator file \"" << path << "\": " << file.errorString() << "\n";
+            throw MustQuit{};
+        }
+        for(size_t i=0; i<subpixelCount; ++i)
+            chunk[i] += accumulated[i];
+    }
+    if(!file.seek(offset) || file.write(reinterpret_cast<const char*>(chunk.get()), byteCount)!=byteCount)
+    {
+        std::cerr << "Failed to write layers " << firstLayer << " to " << firstLayer+layerCount-1
+                  << " of accumulator file \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    file.close();
+    if(file.error())
+    {
+        std::cerr << "Failed to write accumulator file \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    recordFileWrite(path, byteCount, writeBegin);
+}
+
+std::vector<glm::vec4> finishScatteringAccumulatorFile(std::string const& path, const std::string_view name,
+                                                       const ReturnTextureData returnTexData,
+                                                       const ReducePrecision reducePrecision)
+{
+    if(opts.dbgNoSaveTextures)
+    {
+        std::cerr << indentOutput() << "Would save " << name << ", but only shaders are to be saved.\n";
+        return {};
+    }
+
+    std::cerr << indentOutput() << "Finishing " << name << " in \"" << path << "\"... ";
+    TextureSaveJob job{std::string(name), path, scatteringTextureSizes()};
+    job.subpixelCount = layerSubpixelCount()*atmo.scatTexDepth();
+    job.reducePrecision = opts.textureSavePrecision && reducePrecision;
+    job.subpixels.reset(new GLfloat[job.subpixelCount]);
+    {
+        QFile file(QString::fromStdString(path));
+        const auto byteCount=qint64(sizeof(GLfloat)*job.subpixelCount);
+        if(!file.open(QFile::ReadOnly) || !file.seek(headerSize) ||
+           file.read(reinterpret_cast<char*>(job.subpixels.get()), byteCount)!=byteCount)
+        {
+            std::cerr << "failed to read the file: " << file.errorString() << "\n";
+            throw MustQuit{};
+        }
+    }
+
+    std::vector<glm::vec4> dataToReturn;
+    if(returnTexData)
+    {
+        static_assert(std::is_trivially_copyable_v<glm::vec4>);
+        dataToReturn.assign(reinterpret_cast<const glm::vec4*>(job.subpixels.get()),
+                            reinterpret_cast<const glm::vec4*>(job.subpixels.get()+job.subpixelCount));
+    }
+
+    if(const auto error=finishTextureSave(job); !error.empty())
+    {
+        std::cerr << error << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+
+    return dataToReturn;
+}
@@ -0,0 +1,45 @@
+#ifndef INCLUDE_ONCE_3C7E91A4_58D2_4B6F_A0E3_D94B26F1C875
+#define INCLUDE_ONCE_3C7E91A4_58D2_4B6F_A0E3_D94B26F1C875
+
+#include <string>
+#include <vector>
+#include <string_view>
+#include <glm/glm.hpp>
+#include "data.hpp"
+#include "util.hpp"
+
+/* Accumulation of the 4D scattering textures in files instead of VRAM, see --memory-budget.
+ * This saves the VRAM of the accumulators, but doesn't bound the total VRAM by the budget.
+ *
+ * Layers of the 3D textures correspond to altitudes, and they are the slowest-varying dimension in
+ * the texture files, so a range of layers is a contiguous range of bytes in a file. The layers to be
+ * accumulated are rendered chunk by chunk into TEX_SCATTERING_CHUNK, read back, and added to the file
+ * (or written over it on the first contribution), so that the accumulators don't take any VRAM.
+ *
+ * Only the accumulators are chunked. Delta scattering and scattering density textures remain whole,
+ * so the peak VRAM is still at least two full 4D textures, and doesn't scale with the chunk size.
+ * The scattering density must be whole for the multiple scattering pass, which integrates it along
+ * rays crossing all the altitudes. The density pass, on the other hand, reads delta scattering only
+ * at the altitude being computed, so delta scattering could be streamed per chunk, but this isn't
+ * implemented.
+ */
+
+inline bool accumulatingScatteringOnDisk() { return opts.memoryBudgetMiB>0; }
+// File where multiple scattering of the given wavelength set is accumulated over the scattering orders
+std::string multipleScatteringAccumulatorPath(unsigned texIndex);
+// Bytes of the textures that stay in VRAM for the whole computation, apart from the chunk
+size_t fixedTexturesBytes();
+// Number of layers per chunk fitting into the budget, 0 if even one layer doesn't fit
+GLsizei scatteringChunkLayersForBudget();
+// Chooses the number of layers per chunk to fit into the budget, quits if it's impossible
+void initScatteringChunks();
+GLsizei scatteringChunkLayerCount();
+// Reads back the first layerCount layers of TEX_SCATTERING_CHUNK and adds them to the layers of the
+// file starting from firstLayer. If add is false, the data are written instead of added.
+void storeScatteringChunk(std::string const& path, GLsizei firstLayer, GLsizei layerCount, bool add);
+// Checks the accumulated data for NaNs and reduces their precision like saveTexture() does
+std::vector<glm::vec4> finishScatteringAccumulatorFile(std::string const& path, std::string_view name,
+                                                       ReturnTextureData=ReturnTextureData{false},
+                                                       ReducePrecision=ReducePrecision{true});
+
+#endif
@@ -0,0 +1,471 @@
+#include "estimate.hpp"
+
+#include <map>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <iomanip>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <QFile>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+#include "data.hpp"
+#include "util.hpp"
+#include "profiling.hpp"
+#include "disk-accumulation.hpp"
+#include "../common/timing.hpp"
+
+namespace
+{
+
+constexpr int calibrationFormatVersion=1;
+constexpr double texelBytes=4*sizeof(GLfloat);
+constexpr double MiB=1024*1024;
+
+// Kinds of stages whose cost is calibrated. The units of work are texels times iterations of the
+// innermost integration loop of their shaders.
+const char*const costKinds[]=
+{
+    "transmittance",
+    "direct-irradiance",
+    "single-scattering",
+    "scattering-density",
+    "indirect-irradiance",
+    "multiple-scattering",
+    "accumulation",
+    "eclipsed-double-scattering",
+    "light-pollution",
+};
+
+double scatteringTexels()
+{
+    return double(atmo.scatTexWidth())*atmo.scatTexHeight()*atmo.scatTexDepth();
+}
+
+double irradianceTexels()
+{
+    return double(atmo.irradianceTexW)*atmo.irradianceTexH;
+}
+
+double lightPollutionTexels()
+{
+    return double(atmo.lightPollutionTextureSize[0])*atmo.lightPollutionTextureSize[1];
+}
+
+// Radiance samples computed on the GPU for each altitude and sun zenith angle
+double eclipsedDoubleScatteringSamplesPerPoint()
+{
+    return 8.*atmo.eclipsedDoubleScatteringNumberOfAzimuthPairsToSample*atmo.eclipsedDoubleScatteringNumberOfElevationPairsToSample;
+}
+
+double eclipsedDoubleScatteringTextureBytes()
+{
+    return double(atmo.eclipsedDoubleScatteringTextureSize[2])*atmo.eclipsedDoubleScatteringTextureSize[3]*
+                  eclipsedDoubleScatteringSamplesPerPoint()*texelBytes;
+}
+
+// Units of work in one run of a stage of the kind
+double unitsOfWork(std::string const& kind)
+{
+    if(kind=="transmittance")
+        return double(atmo.transmittanceTexW)*atmo.transmittanceTexH*atmo.numTransmittanceIntegrationPoints;
+    if(kind=="direct-irradiance")
+        return irradianceTexels();
+    if(kind=="single-scattering" || kind=="multiple-scattering")
+        return scatteringTexels()*atmo.radialIntegrationPoints;
+    if(kind=="scattering-density")
+        return scatteringTexels()*atmo.angularIntegrationPoints;
+    if(kind=="indirect-irradiance")
+        return irradianceTexels()*atmo.angularIntegrationPoints/2;
+    if(kind=="accumulation")
+        return scatteringTexels();
+    if(kind=="eclipsed-double-scattering")
+        return double(atmo.eclipsedDoubleScatteringTextureSize[2])*atmo.eclipsedDoubleScatteringTextureSize[3]*
+               eclipsedDoubleScatteringSamplesPerPoint()*atmo.eclipseAngularIntegrationPoints*atmo.radialIntegrationPoints;
+    if(kind=="light-pollution")
+        return lightPollutionTexels()*atmo.lightPollutionAngularIntegrationPoints*atmo.radialIntegrationPoints;
+    return 0;
+}
+
+bool startsWith(std::string const& str, std::string const& prefix)
+{
+    return str.compare(0, prefix.size(), prefix)==0;
+}
+
+// Kind of a profiled stage and the number of runs of that kind it comprises. The names
+// must be kept in sync with those of ProfiledStage objects in main.cpp.
+std::pair<std::string, double> classifyStage(std::string const& name)
+{
+    const double otherOrders=std::max(1u, atmo.scatteringOrdersToCompute)-1;
+    if(name=="transmittance")
+        return {"transmittance", 1};
+    if(name=="direct ground irradiance")
+        return {"direct-irradiance", 1};
+    if(startsWith(name, "single scattering for "))
+        return {"single-scattering", 1};
+    if(name=="scattering order 1 and scattering density order 2")
+        return {"scattering-density", atmo.scatteringOrdersToCompute>=2 ? atmo.scatterers.size()+1 : 0};
+    if(startsWith(name, "scattering density order "))
+        return {"scattering-density", 1};
+    if(startsWith(name, "indirect irradiance order "))
+        return {"indirect-irradiance", 1};
+    if(startsWith(name, "multiple scattering order "))
+        return {"multiple-scattering", 1};
+    if(startsWith(name, "single scattering accumulation for ") || startsWith(name, "multiple scattering accumulation order "))
+        return {"accumulation", 1};
+    if(name=="eclipsed double scattering")
+        return {"eclipsed-double-scattering", 1};
+    if(name=="light pollution single scattering")
+        return {"light-pollution", 1};
+    if(name=="light pollution multiple scattering")
+        return {"light-pollution", otherOrders};
+    if(startsWith(name, "saving "))
+        return {"saving", 0};
+    return {};
+}
+
+bool scattererIsAccumulated(AtmosphereParameters::Scatterer const& scatterer)
+{
+    // Even in radiance mode, single scattering for these phase functions is saved as XYZW
+    return scatterer.phaseFunctionType!=PhaseFunctionType::General;
+}
+
+// Runs of each kind of stage for one wavelength set. With --scattering-orders-tolerance this is an upper bound.
+std::map<std::string, double> runsPerWavelengthSet()
+{
+    const double orders=atmo.scatteringOrdersToCompute;
+    const double scatterers=atmo.scatterers.size();
+    const double higherOrders=std::max(0., orders-2);
+    double accumulatedScatterers=0;
+    for(const auto& scatterer : atmo.scatterers)
+        accumulatedScatterers += scattererIsAccumulated(scatterer);
+
+    std::map<std::string, double> runs;
+    runs["transmittance"]=1;
+    runs["direct-irradiance"]=1;
+    runs["single-scattering"]=scatterers;
+    runs["scattering-density"]=(orders>=2 ? scatterers+1 : 0) + higherOrders;
+    runs["indirect-irradiance"]=scatterers + higherOrders;
+    runs["multiple-scattering"]=std::max(0., orders-1);
+    runs["accumulation"]=accumulatedScatterers + std::max(0., orders-1);
+    runs["eclipsed-double-scattering"]=opts.dbgNoEDSTextures ? 0 : 1;
+    runs["light-pollution"]=std::max(1., orders);
+    return runs;
+}
+
+struct OutputFile
+{
+    std::string what;
+    double count;
+    double bytes; // of each file
+};
+
+std::vector<OutputFile> outputFiles()
+{
+    const double sets=atmo.allWavelengths.size();
+    const double scatBytes=scatteringTexels()*texelBytes;
+    const bool radiance=opts.saveResultAsRadiance;
+
+    std::vector<OutputFile> files;
+    files.push_back({"transmittance", sets, double(atmo.transmittanceTexW)*atmo.transmittanceTexH*texelBytes});
+    files.push_back({"irradiance", sets, irradianceTexels()*texelBytes});
+    for(const auto& scatterer : atmo.scatterers)
+    {
+        files.push_back({"single scattering for "+scatterer.name.toStdString(), scattererIsAccumulated(scatterer) ? 1 : sets,
+                         scatBytes});
+    }
+    files.push_back({"multiple scattering", radiance ? sets : 1, scatBytes});
+    files.push_back({"light pollution", radiance ? sets : 1, lightPollutionTexels()*texelBytes});
+    if(!opts.dbgNoEDSTextures)
+        files.push_back({"eclipsed double scattering", radiance ? sets : 1, eclipsedDoubleScatteringTextureBytes()});
+    return files;
+}
+
+// Files that exist only while the computation runs or serve subsequent runs
+std::vector<OutputFile> auxiliaryFiles()
+{
+    const double sets=atmo.allWavelengths.size();
+    const double scatBytes=scatteringTexels()*texelBytes;
+
+    std::vector<OutputFile> files;
+    // Partial luminance textures of all the wavelength sets exist until they are merged, see computingPartials()
+    double accumulatedScatterers=0;
+    for(const auto& scatterer : atmo.scatterers)
+        accumulatedScatterers += scattererIsAccumulated(scatterer);
+    if(accumulatedScatterers)
+        files.push_back({"partial luminance single scattering", sets, accumulatedScatterers*scatBytes});
+    if(!opts.saveResultAsRadiance)
+    {
+        files.push_back({"partial luminance multiple scattering", sets, scatBytes});
+        files.push_back({"partial luminance light pollution", sets, lightPollutionTexels()*texelBytes});
+        if(!opts.dbgNoEDSTextures)
+            files.push_back({"partial luminance eclipsed double scattering", sets, eclipsedDoubleScatteringTextureBytes()});
+    }
+    if(opts.reuseStages)
+    {
+        files.push_back({"stage cache", sets, double(atmo.transmittanceTexW)*atmo.transmittanceTexH*texelBytes +
+                                              irradianceTexels()*texelBytes + atmo.scatterers.size()*scatBytes +
+                                              lightPollutionTexels()*texelBytes});
+    }
+    return files;
+}
+
+struct StageMemory
+{
+    std::string stage;
+    double vramBytes;
+    double hostBytes;
+};
+
+std::vector<StageMemory> memoryByStage()
+{
+    const double scatBytes=scatteringTexels()*texelBytes;
+    const double layerBytes=double(atmo.scatTexWidth())*atmo.scatTexHeight()*texelBytes;
+    double accumulatedScatterers=0;
+    bool needGuides=false;
+    for(const auto& scatterer : atmo.scatterers)
+    {
+        accumulatedScatterers += scattererIsAccumulated(scatterer);
+        needGuides = needGuides || scatterer.needsInterpolationGuides;
+    }
+
+    double residentVRAM=fixedTexturesBytes();
+    double chunkBytes=0;
+    if(accumulatingScatteringOnDisk())
+    {
+        chunkBytes=scatteringChunkLayersForBudget()*layerBytes;
+        residentVRAM += chunkBytes;
+    }
+    else
+    {
+        residentVRAM += scatBytes; // multiple scattering accumulator
+        residentVRAM += accumulatedScatterers*scatBytes; // single scattering accumulators
+    }
+
+    std::vector<StageMemory> stages;
+    stages.push_back({"resident textures", residentVRAM, 0});
+
+    // Pending saves keep their pixel buffers in VRAM and their data in host memory
+    const double pendingSaves=std::max(1u, opts.saveQueueDepth);
+    stages.push_back({"saving 4D textures", residentVRAM + (opts.saveQueueDepth ? opts.saveQueueDepth*scatBytes : 0),
+                      pendingSaves*scatBytes + (needGuides ? scatBytes : 0)});
+
+    if(accumulatingScatteringOnDisk())
+        stages.push_back({"accumulation on disk", residentVRAM, std::max(2*chunkBytes, scatBytes)});
+
+    if(!opts.dbgNoEDSTextures)
+    {
+        // See EclipsedDoubleScatteringSamplesReducer
+        const double sampleBytes=double(atmo.eclipseAngularIntegrationPoints)*atmo.radialIntegrationPoints*texelBytes;
+        const double samplesPerCall=4.*atmo.eclipsedDoubleScatteringNumberOfAzimuthPairsToSample*
+                                       atmo.eclipsedDoubleScatteringNumberOfElevationPairsToSample;
+        const double batch=std::max(1., std::min(samplesPerCall, std::floor(64*MiB/sampleBytes)));
+        const double reducerBytes=batch*sampleBytes + batch*atmo.radialIntegrationPoints*texelBytes + 2*batch*texelBytes;
+        stages.push_back({"eclipsed double scattering", residentVRAM+reducerBytes,
+                          eclipsedDoubleScatteringTextureBytes()});
+    }
+    return stages;
+}
+
+std::string formatBytes(const double bytes)
+{
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    if(bytes >= 1024*MiB)
+        ss << bytes/(1024*MiB) << " GiB";
+    else
+        ss << bytes/MiB << " MiB";
+    return ss.str();
+}
+
+std::string formatSeconds(const double seconds)
+{
+    using namespace std::chrono;
+    const steady_clock::time_point begin;
+    return formatDeltaTime(begin, begin+duration_cast<steady_clock::duration>(duration<double>(seconds)));
+}
+
+struct Calibration
+{
+    std::string renderer;
+    std::map<std::string, double> secondsPerUnit;
+    double secondsPerByteSaved=0;
+};
+
+Calibration loadCalibration(std::string const& path)
+{
+    QFile file(QString::fromStdString(path));
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "Failed to open calibration profile \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    QJsonParseError error;
+    const auto doc=QJsonDocument::fromJson(file.readAll(), &error);
+    if(doc.isNull() || !doc.isObject())
+    {
+        std::cerr << "Failed to parse calibration profile \"" << path << "\": " << error.errorString() << "\n";
+        throw MustQuit{};
+    }
+    const auto root=doc.object();
+    if(root["formatVersion"].toInt()!=calibrationFormatVersion)
+    {
+        std::cerr << "Calibration profile \"" << path << "\" has unsupported format version "
+                  << root["formatVersion"].toInt() << ", expected " << calibrationFormatVersion << "\n";
+        throw MustQuit{};
+    }
+
+    Calibration calibration;
+    calibration.renderer=root["renderer"].toString().toStdString();
+    const auto costs=root["secondsPerUnit"].toObject();
+    for(const auto kind : costKinds)
+        if(costs.contains(kind))
+            calibration.secondsPerUnit[kind]=costs[kind].toDouble();
+    calibration.secondsPerByteSaved=root["secondsPerByteSaved"].toDouble();
+    return calibration;
+}
+
+}
+
+void printEstimate()
+{
+    const double sets=atmo.allWavelengths.size();
+    const unsigned processes = opts.jobs ? std::min<unsigned>(opts.jobs, atmo.allWavelengths.size()) : 1;
+
+    std::cout << "Estimates for " << atmo.allWavelengths.size() << " wavelength sets, " << atmo.scatterers.size()
+              << " scatterers, " << atmo.scatteringOrdersToCompute << " scattering orders:\n";
+
+    std::cout << "\nPeak memory by stage, per process (driver overhead and shader programs not included):\n";
+    double peakVRAM=0, peakHost=0;
+    for(const auto& stage : memoryByStage())
+    {
+        std::cout << "  " << std::left << std::setw(30) << stage.stage << std::right
+                  << " VRAM " << std::setw(10) << formatBytes(stage.vramBytes)
+                  << ", host " << std::setw(10) << formatBytes(stage.hostBytes) << "\n";
+        peakVRAM=std::max(peakVRAM, stage.vramBytes);
+        peakHost=std::max(peakHost, stage.hostBytes);
+    }
+    if(accumulatingScatteringOnDisk() && !scatteringChunkLayersForBudget())
+        std::cout << "  The memory budget is too small even for a single layer of the scattering textures\n";
+    std::cout << "  Peak VRAM: " << formatBytes(peakVRAM*processes) << ", peak host memory: " << formatBytes(peakHost*processes);
+    if(processes>1)
+        std::cout << " (" << processes << " worker processes)";
+    std::cout << "\n";
+
+    std::cout << "\nDisk usage:\n";
+    double outputBytes=0, auxiliaryBytes=0;
+    for(const auto& file : outputFiles())
+    {
+        std::cout << "  " << std::left << std::setw(40) << file.what << std::right << " " << std::setw(4) << file.count
+                  << " x " << formatBytes(file.bytes) << "\n";
+        outputBytes += file.count*file.bytes;
+    }
+    for(const auto& file : auxiliaryFiles())
+    {
+        std::cout << "  " << std::left << std::setw(40) << file.what << std::right << " " << std::setw(4) << file.count
+                  << " x " << formatBytes(file.bytes) << "\n";
+        auxiliaryBytes += file.count*file.bytes;
+    }
+    std::cout << "  Total output: " << formatBytes(outputBytes);
+    if(auxiliaryBytes)
+        std::cout << ", auxiliary: " << formatBytes(auxiliaryBytes);
+    std::cout << "\n";
+
+    std::cout << "\nWork" << (opts.calibrationPath.empty() ? "" : " and runtime") << " by kind of stage, all wavelength sets:\n";
+    Calibration calibration;
+    if(!opts.calibrationPath.empty())
+        calibration=loadCalibration(opts.calibrationPath);
+    double totalSeconds=0;
+    bool allKindsCalibrated=true;
+    const auto runs=runsPerWavelengthSet();
+    for(const auto kind : costKinds)
+    {
+        const double units=sets*runs.at(kind)*unitsOfWork(kind);
+        if(units==0) continue;
+        std::cout << "  " << std::left << std::setw(30) << kind << std::right << " " << std::setw(12)
+                  << std::setprecision(3) << units << " units";
+        if(!opts.calibrationPath.empty())
+        {
+            if(const auto cost=calibration.secondsPerUnit.find(kind); cost!=calibration.secondsPerUnit.end())
+            {
+                std::cout << ", " << formatSeconds(units*cost->second);
+                totalSeconds += units*cost->second;
+            }
+            else
+            {
+                std::cout << ", not calibrated";
+                allKindsCalibrated=false;
+            }
+        }
+        std::cout << "\n";
+    }
+    if(opts.calibrationPath.empty())
+    {
+        std::cout << "  No calibration profile given, use --calibration to predict the runtime\n";
+        return;
+    }
+    totalSeconds += outputBytes*calibration.secondsPerByteSaved;
+    std::cout << "  " << std::left << std::setw(30) << "saving" << std::right << " " << std::setw(12)
+              << std::setprecision(3) << outputBytes << " bytes, " << formatSeconds(outputBytes*calibration.secondsPerByteSaved) << "\n";
+    std::cout << "  Predicted runtime: " << formatSeconds(totalSeconds);
+    if(!allKindsCalibrated)
+        std::cout << " plus the uncalibrated stages";
+    if(opts.scatteringOrdersTolerance>0)
+        std::cout << " at most, since scattering orders may converge earlier";
+    std::cout << "\n";
+    if(!calibration.renderer.empty())
+        std::cout << "  Calibrated on " << calibration.renderer << "\n";
+}
+
+void writeCalibration()
+{
+    if(opts.calibrationOutputPath.empty()) return;
+
+    std::cerr << "Writing calibration profile to \"" << opts.calibrationOutputPath << "\"... ";
+    std::map<std::string, std::pair<double/*seconds*/, double/*units*/>> sums;
+    double savingSeconds=0;
+    for(const auto& timing : finishedStageTimings())
+    {
+        const auto [kind, runs]=classifyStage(timing.name);
+        if(kind=="saving")
+        {
+            savingSeconds += timing.selfWallSeconds;
+        }
+        else if(!kind.empty())
+        {
+            auto& [seconds, units]=sums[kind];
+            seconds += timing.selfWallSeconds;
+            units += runs*unitsOfWork(kind);
+        }
+    }
+
+    QJsonObject costs;
+    for(const auto& [kind, sum] : sums)
+        if(sum.second>0)
+            costs[QString::fromStdString(kind)]=sum.first/sum.second;
+
+    QJsonObject root;
+    root["formatVersion"]=calibrationFormatVersion;
+    root["renderer"]=QString::fromLatin1(reinterpret_cast<const char*>(gl.glGetString(GL_RENDERER)));
+    root["secondsPerUnit"]=costs;
+    if(const auto bytes=totalBytesWritten())
+        root["secondsPerByteSaved"]=savingSeconds/bytes;
+
+    QFile file(QString::fromStdString(opts.calibrationOutputPath));
+    if(!file.open(QFile::WriteOnly))
+    {
+        std::cerr << "FAILED to open: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    file.write(QJsonDocument(root).toJson());
+    file.close();
+    if(file.error())
+    {
+        std::cerr << "FAILED to write: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+}
@@ -0,0 +1,19 @@
+#ifndef INCLUDE_ONCE_71D0A4E2_58C3_4F1B_9E67_C2A5B38F06D9
+#define INCLUDE_ONCE_71D0A4E2_58C3_4F1B_9E67_C2A5B38F06D9
+
+/* Resource estimation, see --estimate.
+ *
+ * VRAM, host memory and disk usage are computed from the sizes in the atmosphere description the
+ * same way the computation allocates them. Runtime is predicted from the amount of work of each
+ * kind of stage, counted in texels times integration points, multiplied by the time per unit of
+ * work measured on this machine. The latter comes from a calibration profile, which is written by
+ * a run with --write-calibration, typically of a small model, using the per-stage timings of the
+ * profiler.
+ */
+
+// Prints the estimates for the atmosphere description, using opts.calibrationPath if set
+void printEstimate();
+// Writes the calibration profile from the timings of the run. Must be called at the end of the run.
+void writeCalibration();
+
+#endif
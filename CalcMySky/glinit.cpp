@@ -3,6 +3,8 @@
 #include <iostream>
 #include "util.hpp"
 #include "data.hpp"
+#include "program-cache.hpp"
+#include "disk-accumulation.hpp"
 
 void initBuffers()
 {
@@ -35,11 +37,6 @@ void initTexturesAndFramebuffers()
         gl.glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
         gl.glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
     }
-    setupTexture(TEX_TRANSMITTANCE,atmo.transmittanceTexW,atmo.transmittanceTexH);
-    setupTexture(TEX_DELTA_IRRADIANCE,atmo.irradianceTexW,atmo.irradianceTexH);
-    setupTexture(TEX_IRRADIANCE,atmo.irradianceTexW,atmo.irradianceTexH);
-
-    const auto width=atmo.scatTexWidth(), height=atmo.scatTexHeight(), depth=atmo.scatTexDepth();
     for(const auto tex : {TEX_DELTA_SCATTERING,TEX_DELTA_SCATTERING_DENSITY})
     {
         gl.glBindTexture(GL_TEXTURE_3D,textures[tex]);
@@ -47,15 +44,8 @@ void initTexturesAndFramebuffers()
         gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
         gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
         gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_R,GL_CLAMP_TO_EDGE);
-        setupTexture(tex,width,height,depth);
     }
-    setupTexture(TEX_MULTIPLE_SCATTERING,width,height,depth);
-    // XXX: keep in sync with its use in GLSL computeDoubleScatteringEclipsedDensitySample() and EclipsedDoubleScatteringPrecomputer's constructor
-    setupTexture(TEX_ECLIPSED_DOUBLE_SCATTERING, atmo.eclipseAngularIntegrationPoints, atmo.radialIntegrationPoints);
-
-    setupTexture(TEX_LIGHT_POLLUTION_SCATTERING           , atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
-    setupTexture(TEX_LIGHT_POLLUTION_DELTA_SCATTERING     , atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
-    setupTexture(TEX_LIGHT_POLLUTION_SCATTERING_PREV_ORDER, atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
+    gl.glBindTexture(GL_TEXTURE_3D,0);
 
     gl.glGenFramebuffers(FBO_COUNT,fbos);
 }
@@ -71,6 +61,44 @@ void checkLimits()
     }
 }
 
+void initAtmosphereTextures()
+{
+    checkLimits();
+
+    setupTexture(TEX_TRANSMITTANCE,atmo.transmittanceTexW,atmo.transmittanceTexH);
+    setupTexture(TEX_DELTA_IRRADIANCE,atmo.irradianceTexW,atmo.irradianceTexH);
+    setupTexture(TEX_IRRADIANCE,atmo.irradianceTexW,atmo.irradianceTexH);
+
+    const auto width=atmo.scatTexWidth(), height=atmo.scatTexHeight(), depth=atmo.scatTexDepth();
+    for(const auto tex : {TEX_DELTA_SCATTERING,TEX_DELTA_SCATTERING_DENSITY})
+        setupTexture(tex,width,height,depth);
+    if(accumulatingScatteringOnDisk())
+        initScatteringChunks();
+    else
+        setupTexture(TEX_MULTIPLE_SCATTERING,width,height,depth);
+
+    setupTexture(TEX_LIGHT_POLLUTION_SCATTERING           , atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
+    setupTexture(TEX_LIGHT_POLLUTION_DELTA_SCATTERING     , atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
+    setupTexture(TEX_LIGHT_POLLUTION_SCATTERING_PREV_ORDER, atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
+
+    if(opts.scatteringOrdersTolerance>0)
+    {
+        setupTexture(TEX_DELTA_SCATTERING_ROW_SUMS, height, depth);
+        setupTexture(TEX_DELTA_SCATTERING_LAYER_SUMS, depth, 1);
+    }
+}
+
+void resetAtmosphereState()
+{
+    for(const auto& [name, texture] : accumulatedSingleScatteringTextures)
+        gl.glDeleteTextures(1, &texture);
+    accumulatedSingleScatteringTextures.clear();
+    virtualSourceFiles.clear();
+    virtualHeaderFiles.clear();
+    lastScatteringOrder=0;
+    atmo=AtmosphereParameters{};
+}
+
 std::pair<std::unique_ptr<QOffscreenSurface>, std::unique_ptr<QOpenGLContext>> initOpenGL()
 {
     QSurfaceFormat format;
@@ -128,7 +156,7 @@ std::pair<std::unique_ptr<QOffscreenSurface>, std::unique_ptr<QOpenGLContext>> i
         setupDebugPrintCallback(*context, opts.openglDebugFull);
     initBuffers();
     initTexturesAndFramebuffers();
-    checkLimits();
+    initProgramCache(*context);
 
     return {std::move(surface),std::move(context)};
 }
@@ -6,5 +6,9 @@
 class QOpenGLContext;
 class QOffscreenSurface;
 std::pair<std::unique_ptr<QOffscreenSurface>, std::unique_ptr<QOpenGLContext>> initOpenGL();
+// Allocates the textures with the sizes given in atmo. Can be called again for another atmosphere.
+void initAtmosphereTextures();
+// Forgets atmo and everything computed for it, so that another atmosphere can be computed in the same context
+void resetAtmosphereState();
 
 #endif
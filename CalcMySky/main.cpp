@@ -4,11 +4,14 @@
 #include <sstream>
 #include <complex>
 #include <memory>
+#include <algorithm>
 #include <random>
 #include <chrono>
 #include <cmath>
 #include <map>
 #include <set>
+#include <deque>
+#include <csignal>
 
 #include <QRegularExpression>
 #include <QOffscreenSurface>
@@ -23,6 +26,17 @@
 #include "glinit.hpp"
 #include "cmdline.hpp"
 #include "shaders.hpp"
+#include "parallel.hpp"
+#include "checkpoint.hpp"
+#include "convergence.hpp"
+#include "disk-accumulation.hpp"
+#include "texture-saving.hpp"
+#include "program-cache.hpp"
+#include "profiling.hpp"
+#include "progress-stream.hpp"
+#include "estimate.hpp"
+#include "batch.hpp"
+#include "stage-cache.hpp"
 #include "interpolation-guides.hpp"
 #include "../common/EclipsedDoubleScatteringPrecomputer.hpp"
 #include "../common/timing.hpp"
@@ -31,16 +45,18 @@ QOpenGLFunctions_3_3_Core gl;
 using glm::ivec2;
 using glm::vec2;
 using glm::vec4;
-std::vector<glm::vec4> eclipsedDoubleScatteringAccumulatorTexture;
+
+void saveFinalIrradiance(const unsigned texIndex)
+{
+    saveTexture(GL_TEXTURE_2D,textures[TEX_IRRADIANCE],"irradiance texture",
+                atmo.textureOutputDir+"/irradiance-wlset"+std::to_string(texIndex)+".f32",
+                {atmo.irradianceTexW, atmo.irradianceTexH});
+}
 
 void saveIrradiance(const unsigned scatteringOrder, const unsigned texIndex)
 {
-    if(scatteringOrder==atmo.scatteringOrdersToCompute)
-    {
-        saveTexture(GL_TEXTURE_2D,textures[TEX_IRRADIANCE],"irradiance texture",
-                    atmo.textureOutputDir+"/irradiance-wlset"+std::to_string(texIndex)+".f32",
-                    {atmo.irradianceTexW, atmo.irradianceTexH});
-    }
+    if(scatteringOrder==lastScatteringOrder)
+        saveFinalIrradiance(texIndex);
 
     if(!opts.dbgSaveGroundIrradiance) return;
 
@@ -62,7 +78,12 @@ void saveScatteringDensity(const unsigned scatteringOrder, const unsigned texInd
                 {atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1], atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]});
 }
 
-void render3DTexLayers(QOpenGLShaderProgram& program, const std::string_view whatIsBeingDone)
+// A few draws in flight are enough to keep the GPU busy, more would only delay progress
+// reporting and reaction to interruption.
+constexpr unsigned maxDrawsInFlight=4;
+// Renders layers from beginLayer to endLayer-1, reporting progress relative to the whole texture
+void render3DTexLayers(QOpenGLShaderProgram& program, const std::string_view whatIsBeingDone,
+                       const GLsizei beginLayer, const GLsizei endLayer)
 {
     if(opts.dbgNoSaveTextures) return; // don't take time to do useless computations
 
@@ -73,22 +94,80 @@ void render3DTexLayers(QOpenGLShaderProgram& program, const std::string_view wha
     }
 
     std::cerr << indentOutput() << whatIsBeingDone << "... ";
-    for(GLsizei layer=0; layer<atmo.scatTexDepth(); ++layer)
+
+    // Each draw renders a batch of layers as instances of the quad, with the geometry shader
+    // routing each instance to its layer. With one layer per batch this degenerates into the
+    // plain layer-by-layer loop.
+    const GLsizei depth=atmo.scatTexDepth();
+    const GLsizei layerCountToRender=endLayer-beginLayer;
+    const GLsizei layersPerDraw = opts.layersPerDraw==0 ? layerCountToRender : std::min(GLsizei(opts.layersPerDraw), layerCountToRender);
+
+    // Instead of waiting for each draw to finish, we keep a few of them in flight, so that the GPU
+    // doesn't idle while we're submitting the next one. Progress is reported as their fences signal.
+    std::deque<std::pair<GLsync,GLsizei>> fences;
+    GLsizei layersDone=beginLayer;
+    ReportedProgress progress(std::string(whatIsBeingDone), depth, "layers", beginLayer);
+    std::streamoff statusWidth=0;
+    const auto printStatus=[&statusWidth, &layersDone, depth]
     {
+        // Clear previous status and reset cursor position
+        std::cerr << std::string(statusWidth, '\b') << std::string(statusWidth, ' ')
+                  << std::string(statusWidth, '\b');
         std::ostringstream ss;
-        ss << layer << " of " << atmo.scatTexDepth() << " layers done ";
+        ss << layersDone << " of " << depth << " layers done ";
         std::cerr << ss.str();
+        statusWidth=ss.tellp();
+    };
+    const auto waitForOldestDraw=[&fences, &layersDone, &printStatus, &progress]
+    {
+        const auto [fence, layerCount]=fences.front();
+        fences.pop_front();
+        for(;;)
+        {
+            constexpr GLuint64 timeout=100'000'000; // ns
+            const auto result=gl.glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+            if(result==GL_ALREADY_SIGNALED || result==GL_CONDITION_SATISFIED)
+                break;
+            if(result==GL_WAIT_FAILED)
+            {
+                std::cerr << "glClientWaitSync() FAILED in render3DTexLayers(): " << openglErrorString(gl.glGetError()) << "\n";
+                throw MustQuit{};
+            }
+        }
+        gl.glDeleteSync(fence);
+        layersDone+=layerCount;
+        printStatus();
+        progress.update(layersDone);
+    };
+
+    printStatus();
+    for(GLsizei firstLayer=beginLayer; firstLayer<endLayer; firstLayer+=layersPerDraw)
+    {
+        if(interruptRequested)
+        {
+            while(!fences.empty())
+                waitForOldestDraw();
+            std::cerr << "interrupted\n";
+            throw MustQuit{130};
+        }
 
-        program.setUniformValue("layer",layer);
-        renderQuad();
-        gl.glFinish();
-        OPENGL_DEBUG_CHECK_ERROR("glFinish() FAILED in render3DTexLayers()");
+        const auto layerCount=std::min(layersPerDraw, endLayer-firstLayer);
+        program.setUniformValue("firstLayer",firstLayer);
+        if(layerCount==1)
+            renderQuad();
+        else
+            renderQuadInstances(layerCount);
+        fences.emplace_back(gl.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), layerCount);
+        OPENGL_DEBUG_CHECK_ERROR("glFenceSync() FAILED in render3DTexLayers()");
 
-        // Clear previous status and reset cursor position
-        const auto statusWidth=ss.tellp();
-        std::cerr << std::string(statusWidth, '\b') << std::string(statusWidth, ' ')
-                  << std::string(statusWidth, '\b');
+        if(fences.size() >= maxDrawsInFlight)
+            waitForOldestDraw();
     }
+    while(!fences.empty())
+        waitForOldestDraw();
+    std::cerr << std::string(statusWidth, '\b') << std::string(statusWidth, ' ')
+              << std::string(statusWidth, '\b');
+
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
         std::cerr << "FAILED: " << openglErrorString(err) << "\n";
@@ -97,23 +176,58 @@ void render3DTexLayers(QOpenGLShaderProgram& program, const std::string_view wha
     std::cerr << "done\n";
 }
 
-void computeTransmittance(const unsigned texIndex)
+void render3DTexLayers(QOpenGLShaderProgram& program, const std::string_view whatIsBeingDone)
+{
+    render3DTexLayers(program, whatIsBeingDone, 0, atmo.scatTexDepth());
+}
+
+// Renders the layers chunk by chunk, adding them to the accumulator file, or writing them into it if add is false
+void accumulate3DTexLayersInFile(QOpenGLShaderProgram& program, std::string const& path, const bool add,
+                                 const std::string_view whatIsBeingDone)
 {
-    const auto program=compileShaderProgram("compute-transmittance.frag", "transmittance computation shader program");
+    if(opts.dbgNoSaveTextures) return;
 
-    std::cerr << indentOutput() << "Computing transmittance... ";
+    gl.glDisable(GL_BLEND);
+    gl.glBindFramebuffer(GL_FRAMEBUFFER,fbos[FBO_SCATTERING_CHUNK]);
+    gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0, textures[TEX_SCATTERING_CHUNK],0);
+    checkFramebufferStatus("framebuffer for a chunk of scattering texture layers");
+
+    const GLsizei depth=atmo.scatTexDepth(), chunkLayerCount=scatteringChunkLayerCount();
+    for(GLsizei firstLayer=0; firstLayer<depth; firstLayer+=chunkLayerCount)
+    {
+        const auto endLayer=std::min(depth, firstLayer+chunkLayerCount);
+        program.setUniformValue("layerOffset", firstLayer);
+        render3DTexLayers(program, whatIsBeingDone, firstLayer, endLayer);
+        storeScatteringChunk(path, firstLayer, endLayer-firstLayer, add);
+    }
+    program.setUniformValue("layerOffset", 0);
+    gl.glBindFramebuffer(GL_FRAMEBUFFER,0);
+}
 
+void computeTransmittance(const unsigned texIndex)
+{
+    const ProfiledStage profiledStage("transmittance", texIndex);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,fbos[FBO_TRANSMITTANCE]);
     assert(fbos[FBO_TRANSMITTANCE]);
     gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,textures[TEX_TRANSMITTANCE],0);
     checkFramebufferStatus("framebuffer for transmittance texture");
 
-    program->bind();
-    gl.glViewport(0, 0, atmo.transmittanceTexW, atmo.transmittanceTexH);
-    renderQuad();
+    const auto stageKey=transmittanceStageKey(texIndex);
+    if(!loadStageResult(GL_TEXTURE_2D, textures[TEX_TRANSMITTANCE], stageKey))
+    {
+        const auto program=compileShaderProgram("compute-transmittance.frag", "transmittance computation shader program");
 
-    gl.glFinish();
-    std::cerr << "done\n";
+        std::cerr << indentOutput() << "Computing transmittance... ";
+
+        program->bind();
+        gl.glViewport(0, 0, atmo.transmittanceTexW, atmo.transmittanceTexH);
+        renderQuad();
+
+        gl.glFinish();
+        std::cerr << "done\n";
+
+        saveStageResult(GL_TEXTURE_2D, textures[TEX_TRANSMITTANCE], stageKey);
+    }
 
     saveTexture(GL_TEXTURE_2D,textures[TEX_TRANSMITTANCE],"transmittance texture",
                 atmo.textureOutputDir+"/transmittance-wlset"+std::to_string(texIndex)+".f32",
@@ -124,6 +238,16 @@ void computeTransmittance(const unsigned texIndex)
 
 void computeDirectGroundIrradiance(const unsigned texIndex)
 {
+    const ProfiledStage profiledStage("direct ground irradiance", texIndex);
+    // Direct irradiance is both the delta and the total irradiance at this point
+    const auto stageKey=directIrradianceStageKey(texIndex);
+    if(loadStageResult(GL_TEXTURE_2D, textures[TEX_DELTA_IRRADIANCE], stageKey) &&
+       loadStageResult(GL_TEXTURE_2D, textures[TEX_IRRADIANCE], stageKey))
+    {
+        saveIrradiance(1,texIndex);
+        return;
+    }
+
     const auto program=compileShaderProgram("compute-direct-irradiance.frag", "direct ground irradiance computation shader program");
 
     std::cerr << indentOutput() << "Computing direct ground irradiance... ";
@@ -144,6 +268,7 @@ void computeDirectGroundIrradiance(const unsigned texIndex)
     gl.glFinish();
     std::cerr << "done\n";
 
+    saveStageResult(GL_TEXTURE_2D, textures[TEX_DELTA_IRRADIANCE], stageKey);
     saveIrradiance(1,texIndex);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,0);
 }
@@ -423,6 +548,116 @@ void saveEclipsedDoubleScatteringRenderingShader(const unsigned texIndex)
     }
 }
 
+unsigned renderingBatchCount()
+{
+    return (atmo.allWavelengths.size()+wavelengthSetsPerRenderingBatch-1)/wavelengthSetsPerRenderingBatch;
+}
+
+// Phase function of the scatterer for each wavelength set of the batch. The per-set constants the phase
+// function may use are redeclared locally, hiding the global ones of the current wavelength set.
+QString makeBatchedPhaseFunctionsSrc(const unsigned firstTexIndex, const unsigned setCount,
+                                     AtmosphereParameters::Scatterer const& scatterer)
+{
+    QString src=makePhaseFunctionsSrc()+
+        "vec4 currentPhaseFunction(float dotViewSun) { return phaseFunction_"+scatterer.name+"(dotViewSun); }\n";
+    QString selector="vec4 phaseFunctionOfBatch(int setIndexInBatch, float dotViewSun)\n"
+                     "{\n";
+    for(unsigned i=0; i<setCount; ++i)
+    {
+        src += QString("vec4 phaseFunctionOfBatch%1(float dotViewSun)\n"
+                       "{\n"
+                       "const vec4 wavelengths=%2;\n"
+                       "const int wlSetIndex=%3;\n").arg(i).arg(toString(atmo.allWavelengths[firstTexIndex+i]))
+                                                     .arg(firstTexIndex+i)
+               +scatterer.phaseFunction+
+               "}\n";
+        selector += QString("    if(setIndexInBatch==%1) return phaseFunctionOfBatch%1(dotViewSun);\n").arg(i);
+    }
+    selector += "    return vec4(0);\n"
+                "}\n";
+    virtualHeaderFiles[PHASE_FUNCTIONS_HEADER_FILENAME] += "vec4 phaseFunctionOfBatch(int setIndexInBatch, float dotViewSun);\n";
+    return src+selector;
+}
+
+// Saves the shaders that render wavelength sets of the batch in a single pass, with luminance
+// and each set's radiance going to separate draw buffers
+void saveBatchedRadianceRenderingShaders(const unsigned batchIndex)
+{
+    const unsigned firstTexIndex=batchIndex*wavelengthSetsPerRenderingBatch;
+    const unsigned setCount=std::min<unsigned>(wavelengthSetsPerRenderingBatch, atmo.allWavelengths.size()-firstTexIndex);
+    QString setsOfBatch, radianceToLuminances;
+    for(unsigned i=0; i<setCount; ++i)
+    {
+        setsOfBatch += QString(" F(%1)").arg(i);
+        radianceToLuminances += (i ? ",\n    " : "    ") + toString(radianceToLuminance(firstTexIndex+i, atmo.allWavelengths));
+    }
+    virtualHeaderFiles[WAVELENGTH_SET_BATCH_HEADER_FILENAME]=QString("#define WAVELENGTH_SET_BATCH_SIZE %1\n"
+                                                                      "#define FOR_EACH_WAVELENGTH_SET_OF_BATCH(F)%2\n"
+                                                                      "const mat4 radianceToLuminances[%1]=mat4[%1](\n%3);\n")
+                                                                .arg(setCount).arg(setsOfBatch).arg(radianceToLuminances);
+    virtualSourceFiles.erase(DOUBLE_SCATTERING_ECLIPSED_FILENAME);
+    virtualSourceFiles[viewDirFuncFileName]=viewDirStubFunc;
+
+    const std::pair<const char*, const char*> shaderKinds[]=
+    {
+        {"RENDERING_MULTIPLE_SCATTERING_RADIANCE_BATCH", "multiple-scattering-batched"},
+        {"RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_RADIANCE_BATCH", "double-scattering-eclipsed/precomputed-batched"},
+        {"RENDERING_LIGHT_POLLUTION_RADIANCE_BATCH", "light-pollution-batched"},
+    };
+    const auto saveSources=[](std::vector<std::pair<QString, QString>> const& sourcesToSave, QString const& dirPath)
+    {
+        for(const auto& [filename, src] : sourcesToSave)
+        {
+            if(filename==viewDirFuncFileName) continue;
+
+            const auto filePath=QString("%1/%2").arg(dirPath).arg(filename);
+            std::cerr << indentOutput() << "Saving shader \"" << filePath << "\"...";
+            QFile file(filePath);
+            if(!file.open(QFile::WriteOnly))
+            {
+                std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
+                throw MustQuit{};
+            }
+            file.write(src.toUtf8());
+            file.flush();
+            if(file.error())
+            {
+                std::cerr << " failed: " << file.errorString().toStdString() << "\"\n";
+                throw MustQuit{};
+            }
+            std::cerr << "done\n";
+        }
+    };
+    for(const auto& [macroToReplace, dirName] : shaderKinds)
+    {
+        std::vector<std::pair<QString, QString>> sourcesToSave;
+        virtualSourceFiles[renderShaderFileName]=getShaderSrc(renderShaderFileName,IgnoreCache{})
+            .replace(QRegularExpression("\\b(RENDERING_ANY_RADIANCE_BATCH)\\b"), "1 /*\\1*/")
+            .replace(QRegularExpression(QString("\\b(%1)\\b").arg(macroToReplace)), "1 /*\\1*/");
+        const auto program=compileShaderProgram(renderShaderFileName,
+                                                "batched radiance rendering shader program",
+                                                UseGeomShader{false}, &sourcesToSave);
+        saveSources(sourcesToSave, QString("%1/shaders/%2/%3").arg(atmo.textureOutputDir.c_str()).arg(dirName).arg(batchIndex));
+    }
+
+    // With radiance output all phase functions are general, so single scattering is sampled per wavelength set
+    for(auto const& scatterer : atmo.scatterers)
+    {
+        virtualSourceFiles[PHASE_FUNCTIONS_SHADER_FILENAME]=makeBatchedPhaseFunctionsSrc(firstTexIndex, setCount, scatterer);
+
+        std::vector<std::pair<QString, QString>> sourcesToSave;
+        virtualSourceFiles[renderShaderFileName]=getShaderSrc(renderShaderFileName,IgnoreCache{})
+            .replace(QRegularExpression("\\b(RENDERING_ANY_RADIANCE_BATCH)\\b"), "1 /*\\1*/")
+            .replace(QRegularExpression("\\b(RENDERING_ANY_SINGLE_SCATTERING)\\b"), "1 /*\\1*/")
+            .replace(QRegularExpression("\\b(RENDERING_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE_BATCH)\\b"), "1 /*\\1*/");
+        const auto program=compileShaderProgram(renderShaderFileName,
+                                                "batched single scattering rendering shader program",
+                                                UseGeomShader{false}, &sourcesToSave);
+        saveSources(sourcesToSave, QString("%1/shaders/single-scattering/precomputed-batched/%2/%3")
+                                        .arg(atmo.textureOutputDir.c_str()).arg(batchIndex).arg(scatterer.name));
+    }
+}
+
 void saveLightPollutionRenderingShader(const unsigned texIndex)
 {
     if(!opts.saveResultAsRadiance && texIndex!=0)
@@ -465,22 +700,32 @@ void saveLightPollutionRenderingShader(const unsigned texIndex)
 }
 
 
+void accumulateSingleScatteringOnDisk(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer)
+{
+    const auto program=compileShaderProgram("accumulate-single-scattering-texture.frag",
+                                            "single scattering accumulation shader program",
+                                            UseGeomShader{});
+    program->bind();
+    setUniformTexture(*program,GL_TEXTURE_3D,TEX_DELTA_SCATTERING,0,"tex");
+    program->setUniformValue("radianceToLuminance", toQMatrix(radianceToLuminance(texIndex, atmo.allWavelengths)));
+    program->setUniformValue("embedPhaseFunction", scatterer.phaseFunctionType==PhaseFunctionType::Smooth);
+
+    const auto filePath=partialLuminancePath("single-scattering-"+scatterer.name.toStdString(), texIndex);
+    accumulate3DTexLayersInFile(*program, filePath, false, "Writing single scattering layers into partial texture file");
+    finishScatteringAccumulatorFile(filePath, "partial single scattering texture",
+                                    ReturnTextureData{false}, ReducePrecision{false});
+}
+
 void accumulateSingleScattering(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer)
 {
-    gl.glBlendFunc(GL_ONE, GL_ONE);
-    gl.glEnable(GL_BLEND);
+    const ProfiledStage profiledStage("single scattering accumulation for "+scatterer.name.toStdString(), texIndex);
+    if(accumulatingScatteringOnDisk())
+        return accumulateSingleScatteringOnDisk(texIndex, scatterer);
+
+    // The XYZW data of each wavelength set are saved separately and merged in the end, see computingPartials()
     auto& targetTexture=accumulatedSingleScatteringTextures[scatterer.name];
     if(!targetTexture)
-    {
-        gl.glGenTextures(1, &targetTexture);
-        gl.glBindTexture(GL_TEXTURE_3D,targetTexture);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
-        gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_R,GL_CLAMP_TO_EDGE);
-        setupTexture(targetTexture, atmo.scatTexWidth(),atmo.scatTexHeight(),atmo.scatTexDepth());
-        gl.glDisable(GL_BLEND);
-    }
+        targetTexture=makeScatteringAccumulatorTexture();
     gl.glBindFramebuffer(GL_FRAMEBUFFER,fbos[FBO_SINGLE_SCATTERING]);
     gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0, targetTexture,0);
     checkFramebufferStatus("framebuffer for accumulation of single scattering radiance");
@@ -492,44 +737,48 @@ void accumulateSingleScattering(const unsigned texIndex, AtmosphereParameters::S
     setUniformTexture(*program,GL_TEXTURE_3D,TEX_DELTA_SCATTERING,0,"tex");
     program->setUniformValue("radianceToLuminance", toQMatrix(radianceToLuminance(texIndex, atmo.allWavelengths)));
     program->setUniformValue("embedPhaseFunction", scatterer.phaseFunctionType==PhaseFunctionType::Smooth);
-    render3DTexLayers(*program, "Blending single scattering layers into accumulator texture");
+    render3DTexLayers(*program, "Converting single scattering layers to XYZW");
 
-    gl.glDisable(GL_BLEND);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,0);
 
-    if(texIndex+1==atmo.allWavelengths.size())
-    {
-        const auto filePath = atmo.textureOutputDir+"/single-scattering/"+scatterer.name.toStdString()+"-xyzw.f32";
-        const std::vector<int> sizes{atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1],
-                                     atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]};
-        const auto data = saveTexture(GL_TEXTURE_3D,targetTexture, "single scattering texture",
-                                      filePath, sizes, ReturnTextureData{true});
-        if(scatterer.needsInterpolationGuides && !opts.dbgNoSaveTextures)
-            generateInterpolationGuidesForScatteringTexture(filePath, data, sizes);
-    }
+    saveTexture(GL_TEXTURE_3D,targetTexture, "partial single scattering texture",
+                partialLuminancePath("single-scattering-"+scatterer.name.toStdString(), texIndex),
+                {atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1],
+                 atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]},
+                ReturnTextureData{false}, ReducePrecision{false});
+}
+
+QString makeSingleScatteringDensitiesSrc(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer)
+{
+    return makeScattererDensityFunctionsSrc()+
+           "float scattererDensity(float alt) { return scattererNumberDensity_"+scatterer.name+"(alt); }\n"+
+           "vec4 scatteringCrossSection() { return "+toString(scatterer.scatteringCrossSection(atmo.allWavelengths[texIndex]))+"; }\n";
 }
 
 void computeSingleScattering(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer)
 {
+    const ProfiledStage profiledStage("single scattering for "+scatterer.name.toStdString(), texIndex);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,fbos[FBO_DELTA_SCATTERING]);
     gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0, textures[TEX_DELTA_SCATTERING],0);
     checkFramebufferStatus("framebuffer for first scattering");
 
     gl.glViewport(0, 0, atmo.scatTexWidth(), atmo.scatTexHeight());
 
-    const auto src=makeScattererDensityFunctionsSrc()+
-                    "float scattererDensity(float alt) { return scattererNumberDensity_"+scatterer.name+"(alt); }\n"+
-                    "vec4 scatteringCrossSection() { return "+toString(scatterer.scatteringCrossSection(atmo.allWavelengths[texIndex]))+"; }\n";
-    virtualSourceFiles[DENSITIES_SHADER_FILENAME]=src;
+    virtualSourceFiles[DENSITIES_SHADER_FILENAME]=makeSingleScatteringDensitiesSrc(texIndex, scatterer);
     virtualSourceFiles[PHASE_FUNCTIONS_SHADER_FILENAME]=makePhaseFunctionsSrc()+
         "vec4 currentPhaseFunction(float dotViewSun) { return phaseFunction_"+scatterer.name+"(dotViewSun); }\n";
-    const auto program=compileShaderProgram("compute-single-scattering.frag",
-                                            "single scattering computation shader program",
-                                            UseGeomShader{});
-    program->bind();
-    setUniformTexture(*program,GL_TEXTURE_2D,TEX_TRANSMITTANCE,0,"transmittanceTexture");
+    const auto stageKey=singleScatteringStageKey(texIndex, scatterer);
+    if(!loadStageResult(GL_TEXTURE_3D, textures[TEX_DELTA_SCATTERING], stageKey))
+    {
+        const auto program=compileShaderProgram("compute-single-scattering.frag",
+                                                "single scattering computation shader program",
+                                                UseGeomShader{});
+        program->bind();
+        setUniformTexture(*program,GL_TEXTURE_2D,TEX_TRANSMITTANCE,0,"transmittanceTexture");
 
-    render3DTexLayers(*program, "Computing single scattering layers");
+        render3DTexLayers(*program, "Computing single scattering layers");
+        saveStageResult(GL_TEXTURE_3D, textures[TEX_DELTA_SCATTERING], stageKey);
+    }
 
     gl.glBindFramebuffer(GL_FRAMEBUFFER,0);
 
@@ -560,9 +809,10 @@ void computeSingleScattering(const unsigned texIndex, AtmosphereParameters::Scat
     saveEclipsedSingleScatteringComputationShader(texIndex, scatterer);
 }
 
-void computeIndirectIrradianceOrder1(unsigned scattererIndex);
+void computeIndirectIrradianceOrder1(unsigned texIndex, unsigned scattererIndex);
 void computeScatteringOrder1AndScatteringDensityOrder2(const unsigned texIndex)
 {
+    const ProfiledStage profiledStage("scattering order 1 and scattering density order 2", texIndex);
     constexpr unsigned scatteringOrder=2;
 
     virtualSourceFiles[DENSITIES_SHADER_FILENAME]=makeScattererDensityFunctionsSrc();
@@ -642,7 +892,7 @@ void computeScatteringOrder1AndScatteringDensityOrder2(const unsigned texIndex)
         }
 
         // Disables blending before returning
-        computeIndirectIrradianceOrder1(scattererIndex);
+        computeIndirectIrradianceOrder1(texIndex, scattererIndex);
     }
     gl.glDisable(GL_BLEND);
     saveIrradiance(scatteringOrder,texIndex);
@@ -652,6 +902,7 @@ void computeScatteringOrder1AndScatteringDensityOrder2(const unsigned texIndex)
 
 void computeScatteringDensity(const unsigned scatteringOrder, const unsigned texIndex)
 {
+    const ProfiledStage profiledStage("scattering density order "+std::to_string(scatteringOrder), texIndex);
     assert(scatteringOrder>2);
 
     gl.glViewport(0, 0, atmo.scatTexWidth(), atmo.scatTexHeight());
@@ -676,8 +927,9 @@ void computeScatteringDensity(const unsigned scatteringOrder, const unsigned tex
     gl.glBindFramebuffer(GL_FRAMEBUFFER,0);
 }
 
-void computeIndirectIrradianceOrder1(const unsigned scattererIndex)
+void computeIndirectIrradianceOrder1(const unsigned texIndex, const unsigned scattererIndex)
 {
+    const ProfiledStage profiledStage("indirect irradiance order 1 for "+atmo.scatterers[scattererIndex].name.toStdString(), texIndex);
     constexpr unsigned scatteringOrder=2;
 
     gl.glViewport(0, 0, atmo.irradianceTexW, atmo.irradianceTexH);
@@ -713,6 +965,7 @@ void computeIndirectIrradianceOrder1(const unsigned scattererIndex)
 
 void computeIndirectIrradiance(const unsigned scatteringOrder, const unsigned texIndex)
 {
+    const ProfiledStage profiledStage("indirect irradiance order "+std::to_string(scatteringOrder-1), texIndex);
     assert(scatteringOrder>2);
     gl.glViewport(0, 0, atmo.irradianceTexW, atmo.irradianceTexH);
 
@@ -738,14 +991,57 @@ void computeIndirectIrradiance(const unsigned scatteringOrder, const unsigned te
     gl.glBindFramebuffer(GL_FRAMEBUFFER,0);
 }
 
+void accumulateMultipleScatteringOnDisk(const unsigned scatteringOrder, const unsigned texIndex)
+{
+    const auto program=compileShaderProgram("copy-scattering-texture-3d.frag",
+                                            "scattering texture copy-blend shader program",
+                                            UseGeomShader{});
+    program->bind();
+    if(!opts.saveResultAsRadiance)
+        program->setUniformValue("radianceToLuminance", toQMatrix(radianceToLuminance(texIndex, atmo.allWavelengths)));
+    setUniformTexture(*program,GL_TEXTURE_3D,TEX_DELTA_SCATTERING,0,"tex");
+
+    const auto filePath=multipleScatteringAccumulatorPath(texIndex);
+    accumulate3DTexLayersInFile(*program, filePath, scatteringOrder>2, "Blending multiple scattering layers into accumulator file");
+
+    if(opts.dbgSaveAccumScattering && !opts.dbgNoSaveTextures)
+    {
+        const auto copyPath=atmo.textureOutputDir+"/multiple-scattering-to-order"+std::to_string(scatteringOrder)+
+                                                    "-wlset"+std::to_string(texIndex)+".f32";
+        std::cerr << indentOutput() << "Copying multiple scattering accumulator file to \"" << copyPath << "\"... ";
+        QFile::remove(copyPath.c_str());
+        if(!QFile::copy(filePath.c_str(), copyPath.c_str()))
+        {
+            std::cerr << "FAILED\n";
+            throw MustQuit{};
+        }
+        std::cerr << "done\n";
+    }
+    if(scatteringOrder!=lastScatteringOrder)
+        return;
+    if(computingPartials())
+    {
+        finishScatteringAccumulatorFile(filePath, "partial multiple scattering texture",
+                                        ReturnTextureData{false}, ReducePrecision{false});
+    }
+    else
+    {
+        finishScatteringAccumulatorFile(filePath, "multiple scattering accumulator texture");
+    }
+}
+
 void accumulateMultipleScattering(const unsigned scatteringOrder, const unsigned texIndex)
 {
+    const ProfiledStage profiledStage("multiple scattering accumulation order "+std::to_string(scatteringOrder), texIndex);
+    if(accumulatingScatteringOnDisk())
+        return accumulateMultipleScatteringOnDisk(scatteringOrder, texIndex);
+
     // We didn't render to the accumulating texture when computing delta scattering to avoid holding
     // more than two 4D textures in VRAM at once.
     // Now it's time to do this by only holding the accumulator and delta scattering texture in VRAM.
     gl.glActiveTexture(GL_TEXTURE0);
     gl.glBlendFunc(GL_ONE, GL_ONE);
-    if(scatteringOrder>2 || (texIndex>0 && !opts.saveResultAsRadiance))
+    if(scatteringOrder>2)
         gl.glEnable(GL_BLEND);
     else
         gl.glDisable(GL_BLEND);
@@ -772,19 +1068,24 @@ void accumulateMultipleScattering(const unsigned scatteringOrder, const unsigned
                     atmo.textureOutputDir+"/multiple-scattering-to-order"+std::to_string(scatteringOrder)+"-wlset"+std::to_string(texIndex)+".f32",
                     {atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1], atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]});
     }
-    if(scatteringOrder==atmo.scatteringOrdersToCompute && (texIndex+1==atmo.allWavelengths.size() || opts.saveResultAsRadiance))
+    if(scatteringOrder==lastScatteringOrder && computingPartials())
     {
-        const auto filename = opts.saveResultAsRadiance ?
-            atmo.textureOutputDir+"/multiple-scattering-wlset"+std::to_string(texIndex)+".f32" :
-            atmo.textureOutputDir+"/multiple-scattering-xyzw.f32";
         saveTexture(GL_TEXTURE_3D,textures[TEX_MULTIPLE_SCATTERING],
-                    "multiple scattering accumulator texture", filename,
+                    "partial multiple scattering texture", partialLuminancePath("multiple-scattering", texIndex),
+                    {atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1], atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]},
+                    ReturnTextureData{false}, ReducePrecision{false});
+    }
+    else if(scatteringOrder==lastScatteringOrder)
+    {
+        saveTexture(GL_TEXTURE_3D,textures[TEX_MULTIPLE_SCATTERING], "multiple scattering accumulator texture",
+                    atmo.textureOutputDir+"/multiple-scattering-wlset"+std::to_string(texIndex)+".f32",
                     {atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1], atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]});
     }
 }
 
 void computeMultipleScatteringFromDensity(const unsigned scatteringOrder, const unsigned texIndex)
 {
+    const ProfiledStage profiledStage("multiple scattering order "+std::to_string(scatteringOrder), texIndex);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,fbos[FBO_MULTIPLE_SCATTERING]);
     gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0, textures[TEX_DELTA_SCATTERING],0);
     checkFramebufferStatus("framebuffer for delta multiple scattering");
@@ -802,6 +1103,14 @@ void computeMultipleScatteringFromDensity(const unsigned scatteringOrder, const
 
         render3DTexLayers(*program, "Computing multiple scattering layers");
 
+        if(opts.scatteringOrdersTolerance>0 && scatteringOrder<lastScatteringOrder && scatteringOrdersConverged(scatteringOrder))
+        {
+            std::cerr << indentOutput() << "Scattering orders have converged, this order will be the last one\n";
+            // The irradiance of this order has already been computed and it wasn't the last one then
+            lastScatteringOrder=scatteringOrder;
+            saveFinalIrradiance(texIndex);
+        }
+
         if(opts.dbgSaveDeltaScattering)
         {
             saveTexture(GL_TEXTURE_3D,textures[TEX_DELTA_SCATTERING],
@@ -814,10 +1123,11 @@ void computeMultipleScatteringFromDensity(const unsigned scatteringOrder, const
     accumulateMultipleScattering(scatteringOrder, texIndex);
 }
 
-void computeMultipleScattering(const unsigned texIndex)
+void computeMultipleScattering(const unsigned texIndex, const unsigned scatteringOrdersDone)
 {
     // Due to interleaving of calculations of first scattering for each scatterer with the
     // second-order scattering density and irradiance we have to do this iteration separately.
+    if(scatteringOrdersDone < 2)
     {
         std::cerr << indentOutput() << "Working on scattering orders 1 and 2:\n";
         OutputIndentIncrease incr;
@@ -826,9 +1136,18 @@ void computeMultipleScattering(const unsigned texIndex)
         if(atmo.scatteringOrdersToCompute >= 2)
         {
             computeMultipleScatteringFromDensity(2,texIndex);
+            saveCheckpoint(texIndex, 2);
         }
     }
-    for(unsigned scatteringOrder=3; scatteringOrder<=atmo.scatteringOrdersToCompute; ++scatteringOrder)
+    else
+    {
+        // Set up the shader sources the way the skipped orders would have left them for the subsequent ones
+        const auto& scatterer=atmo.scatterers.back();
+        virtualSourceFiles[DENSITIES_SHADER_FILENAME]=makeSingleScatteringDensitiesSrc(texIndex, scatterer);
+        virtualSourceFiles[PHASE_FUNCTIONS_SHADER_FILENAME]=makePhaseFunctionsSrc()+
+            "vec4 currentPhaseFunction(float dotViewSun) { return phaseFunction_"+scatterer.name+"(dotViewSun); }\n";
+    }
+    for(unsigned scatteringOrder=std::max(3u, scatteringOrdersDone+1); scatteringOrder<=lastScatteringOrder; ++scatteringOrder)
     {
         std::cerr << indentOutput() << "Working on scattering order " << scatteringOrder << ":\n";
         OutputIndentIncrease incr;
@@ -836,7 +1155,10 @@ void computeMultipleScattering(const unsigned texIndex)
         computeScatteringDensity(scatteringOrder,texIndex);
         computeIndirectIrradiance(scatteringOrder,texIndex);
         computeMultipleScatteringFromDensity(scatteringOrder,texIndex);
+        saveCheckpoint(texIndex, scatteringOrder);
     }
+    if(opts.scatteringOrdersTolerance>0)
+        saveScatteringOrderReached(texIndex);
 }
 
 // XXX: keep in sync with the GLSL version in texture-coordinates.frag
@@ -899,6 +1221,7 @@ std::unique_ptr<QOpenGLShaderProgram> saveEclipsedDoubleScatteringComputationSha
 
 void computeEclipsedDoubleScattering(const unsigned texIndex)
 {
+    const ProfiledStage profiledStage("eclipsed double scattering", texIndex);
     const auto program=saveEclipsedDoubleScatteringComputationShader(texIndex);
 
     if(opts.dbgNoEDSTextures || opts.dbgNoSaveTextures) return;
@@ -915,7 +1238,8 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
     const unsigned texSizeByAltitude = atmo.eclipsedDoubleScatteringTextureSize[3];
 
     gl.glBindFramebuffer(GL_FRAMEBUFFER, fbos[FBO_ECLIPSED_DOUBLE_SCATTERING]);
-    gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,textures[TEX_ECLIPSED_DOUBLE_SCATTERING],0);
+    EclipsedDoubleScatteringSamplesReducer reducer(gl, atmo);
+    reducer.setRenderTarget(0);
     checkFramebufferStatus("framebuffer for eclipsed double scattering");
     program->bind();
     int unusedTextureUnitNum=0;
@@ -927,6 +1251,7 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
 	gl.glBindVertexArray(vao);
     std::vector<glm::vec4> dataToSave;
     size_t numPointsPerSet=0;
+    ReportedProgress progress("eclipsed double scattering", texSizeBySZA*texSizeByAltitude, "samples");
     for(unsigned altIndex=0; altIndex<texSizeByAltitude; ++altIndex)
     {
         // Using the same encoding for altitude as in scatteringTex4DCoordsToTexVars()
@@ -937,6 +1262,12 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
 
         for(unsigned szaIndex=0; szaIndex<texSizeBySZA; ++szaIndex)
         {
+            if(interruptRequested)
+            {
+                std::cerr << "interrupted\n";
+                throw MustQuit{130};
+            }
+
             std::ostringstream ss;
             ss << altIndex*texSizeBySZA+szaIndex << " of " << texSizeBySZA*texSizeByAltitude << " samples done ";
             std::cerr << ss.str();
@@ -944,7 +1275,7 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
             const double cosSunZenithAngle=unitRangeTexCoordToCosSZA(float(szaIndex)/(texSizeBySZA-1));
             const double sunZenithAngle=acos(cosSunZenithAngle);
 
-            precomputer.computeRadianceOnCoarseGrid(*program, textures[TEX_ECLIPSED_DOUBLE_SCATTERING], unusedTextureUnitNum,
+            precomputer.computeRadianceOnCoarseGrid(*program, reducer, unusedTextureUnitNum,
                                                     cameraAltitude, sunZenithAngle, sunZenithAngle, 0, atmo.earthMoonDistance);
             numPointsPerSet = precomputer.appendCoarseGridSamplesTo(dataToSave);
 
@@ -952,6 +1283,7 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
             const auto statusWidth=ss.tellp();
             std::cerr << std::string(statusWidth, '\b') << std::string(statusWidth, ' ')
                       << std::string(statusWidth, '\b');
+            progress.update(altIndex*texSizeBySZA+szaIndex+1);
         }
     }
 	gl.glBindVertexArray(0);
@@ -959,61 +1291,42 @@ void computeEclipsedDoubleScattering(const unsigned texIndex)
     const auto time1=std::chrono::steady_clock::now();
     std::cerr << "done in " << formatDeltaTime(time0, time1) << "\n";
 
-    if(!opts.saveResultAsRadiance)
+    if(computingPartials())
     {
-        std::cerr << indentOutput() << "Blending eclipsed double scattering texture into accumulator... ";
-        const auto time0=std::chrono::steady_clock::now();
+        // The contributions of the wavelength sets are summed up when the partials are merged
         const auto rad2lum = radianceToLuminance(texIndex, atmo.allWavelengths);
-        if(texIndex == 0)
-        {
-            // Initialize the accumulator with the first layer...
-            eclipsedDoubleScatteringAccumulatorTexture = std::move(dataToSave);
-            // ... and apply the weight.
-            for(auto& v : eclipsedDoubleScatteringAccumulatorTexture)
-                v = rad2lum*v;
-        }
-        else
-        {
-            // Blend the new texture data into the accumulator.
-            auto& accum = eclipsedDoubleScatteringAccumulatorTexture;
-            const auto& src = dataToSave;
-            for(size_t i = 0; i < accum.size(); ++i)
-                accum[i] += rad2lum * src[i];
-        }
-        const auto time1=std::chrono::steady_clock::now();
-        std::cerr << "done in " << formatDeltaTime(time0, time1) << "\n";
+        for(auto& v : dataToSave)
+            v = rad2lum*v;
     }
 
-    if(opts.saveResultAsRadiance || texIndex+1 == atmo.allWavelengths.size())
+    const auto path = computingPartials() ? partialLuminancePath("eclipsed-double-scattering", texIndex) :
+                      atmo.textureOutputDir+"/eclipsed-double-scattering-wlset"+std::to_string(texIndex)+".f32";
+    std::cerr << "Saving eclipsed double scattering texture to \"" << path << "\"... ";
+    const auto writeBegin=std::chrono::steady_clock::now();
+    QFile out(QString::fromStdString(path));
+    if(!out.open(QFile::WriteOnly))
     {
-        const auto path = atmo.textureOutputDir+"/eclipsed-double-scattering" +
-                          (opts.saveResultAsRadiance ? "-wlset"+std::to_string(texIndex) : "-xyzw") +
-                          ".f32";
-        std::cerr << "Saving eclipsed double scattering texture to \"" << path << "\"... ";
-        QFile out(QString::fromStdString(path));
-        if(!out.open(QFile::WriteOnly))
-        {
-            std::cerr << "failed to open file: " << out.errorString().toStdString() << "\n";
-            throw MustQuit{};
-        }
-        for(const uint16_t size : {numPointsPerSet})
-            out.write(reinterpret_cast<const char*>(&size), sizeof size);
-        auto& texture = opts.saveResultAsRadiance ? dataToSave : eclipsedDoubleScatteringAccumulatorTexture;
-        if(opts.textureSavePrecision)
-            roundTexData(&texture[0][0], 4*texture.size(), opts.textureSavePrecision);
-        out.write(reinterpret_cast<const char*>(texture.data()), texture.size()*sizeof texture[0]);
-        out.close();
-        if(out.error())
-        {
-            std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
-            throw MustQuit{};
-        }
-        std::cerr << "done\n";
+        std::cerr << "failed to open file: " << out.errorString().toStdString() << "\n";
+        throw MustQuit{};
+    }
+    for(const uint16_t size : {numPointsPerSet})
+        out.write(reinterpret_cast<const char*>(&size), sizeof size);
+    if(opts.textureSavePrecision && !computingPartials())
+        roundTexData(&dataToSave[0][0], 4*dataToSave.size(), opts.textureSavePrecision);
+    out.write(reinterpret_cast<const char*>(dataToSave.data()), dataToSave.size()*sizeof dataToSave[0]);
+    out.close();
+    if(out.error())
+    {
+        std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
+        throw MustQuit{};
     }
+    recordFileWrite(path, sizeof(uint16_t)+dataToSave.size()*sizeof dataToSave[0], writeBegin);
+    std::cerr << "done\n";
 }
 
 void computeLightPollutionSingleScattering(const unsigned texIndex)
 {
+    const ProfiledStage profiledStage("light pollution single scattering", texIndex);
     std::cerr << indentOutput() << "Computing light pollution single scattering... ";
 
     gl.glBindFramebuffer(GL_FRAMEBUFFER,fbos[FBO_LIGHT_POLLUTION]);
@@ -1047,6 +1360,7 @@ void computeLightPollutionSingleScattering(const unsigned texIndex)
 
 void computeLightPollutionMultipleScattering(const unsigned texIndex)
 {
+    const ProfiledStage profiledStage("light pollution multiple scattering", texIndex);
     std::cerr << indentOutput() << "Computing light pollution multiple scattering...\n";
     OutputIndentIncrease incr;
 
@@ -1100,16 +1414,9 @@ void computeLightPollutionMultipleScattering(const unsigned texIndex)
 
 void accumulateLightPollutionLuminanceTexture(const unsigned texIndex)
 {
+    const ProfiledStage profiledStage("light pollution accumulation", texIndex);
     const auto tex = TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE;
-    if(texIndex==0)
-    {
-        setupTexture(tex, atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
-    }
-    else
-    {
-        gl.glBlendFunc(GL_ONE, GL_ONE);
-        gl.glEnable(GL_BLEND);
-    }
+    setupTexture(tex, atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,fbos[FBO_LIGHT_POLLUTION]);
     gl.glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0, textures[tex],0);
     checkFramebufferStatus("framebuffer for accumulation of light pollution luminance");
@@ -1123,140 +1430,172 @@ void accumulateLightPollutionLuminanceTexture(const unsigned texIndex)
     program->setUniformValue("radianceToLuminance", toQMatrix(radianceToLuminance(texIndex, atmo.allWavelengths)));
     renderQuad();
 
-    if(texIndex+1==atmo.allWavelengths.size())
-    {
-        saveTexture(GL_TEXTURE_2D,textures[TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE],"light pollution texture",
-                    atmo.textureOutputDir+"/light-pollution-xyzw.f32",
-                    {atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]});
-    }
+    saveTexture(GL_TEXTURE_2D,textures[TEX_LIGHT_POLLUTION_SCATTERING_LUMINANCE],"partial light pollution texture",
+                partialLuminancePath("light-pollution", texIndex),
+                {atmo.lightPollutionTextureSize[0], atmo.lightPollutionTextureSize[1]});
 
-    gl.glDisable(GL_BLEND);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,0);
 }
 
-int main(int argc, char** argv)
+// Computes everything for the atmosphere description in atmo, whose textures must have been set up
+void computeAtmosphere()
 {
-    [[maybe_unused]] UTF8Console utf8console;
+    const auto timeBegin=std::chrono::steady_clock::now();
 
-    qInstallMessageHandler(qtMessageHandler);
-    QApplication app(argc, argv);
-    app.setApplicationName("CalcMySky");
-    app.setApplicationVersion(PROJECT_VERSION);
+    if(opts.saveResultAsRadiance)
+        for(auto& scatterer : atmo.scatterers)
+            scatterer.phaseFunctionType=PhaseFunctionType::General;
 
-    try
+    if(atmo.textureOutputDir.length() && atmo.textureOutputDir.back()=='/')
+        atmo.textureOutputDir.pop_back(); // Make the paths a bit nicer (without double slashes)
+    for(const auto& scatterer : atmo.scatterers)
     {
-        handleCmdLine();
-
-        std::cerr << qApp->applicationName() << ' ' << qApp->applicationVersion() << '\n';
-        std::cerr << "Compiled against Qt " << QT_VERSION_MAJOR << "." << QT_VERSION_MINOR << "." << QT_VERSION_PATCH << "\n";
-        std::cerr << "Running on " << QSysInfo::prettyProductName().toStdString() << " " << QSysInfo::currentCpuArchitecture() << "\n";
-
-        [[maybe_unused]] const auto glCtxAndSfc = initOpenGL();
-
-        if(opts.saveResultAsRadiance)
-            for(auto& scatterer : atmo.scatterers)
-                scatterer.phaseFunctionType=PhaseFunctionType::General;
-
-        if(atmo.textureOutputDir.length() && atmo.textureOutputDir.back()=='/')
-            atmo.textureOutputDir.pop_back(); // Make the paths a bit nicer (without double slashes)
-        for(const auto& scatterer : atmo.scatterers)
+        for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
         {
-            for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
-            {
-                createDirs(atmo.textureOutputDir+"/shaders/single-scattering-eclipsed/precomputation/"+
-                           std::to_string(texIndex)+"/"+scatterer.name.toStdString());
-                createDirs(atmo.textureOutputDir+"/shaders/single-scattering-eclipsed/"+singleScatteringRenderModeNames[SSRM_ON_THE_FLY]+"/"+
-                           std::to_string(texIndex)+"/"+scatterer.name.toStdString());
-                createDirs(atmo.textureOutputDir+"/shaders/single-scattering/"+singleScatteringRenderModeNames[SSRM_ON_THE_FLY]+"/"+
-                           std::to_string(texIndex)+"/"+scatterer.name.toStdString());
-                if(scatterer.phaseFunctionType==PhaseFunctionType::General)
-                {
-                    createDirs(atmo.textureOutputDir+"/shaders/single-scattering/"+singleScatteringRenderModeNames[SSRM_PRECOMPUTED]+"/"+
-                               std::to_string(texIndex)+"/"+scatterer.name.toStdString());
-                    createDirs(atmo.textureOutputDir+"/shaders/single-scattering-eclipsed/"+singleScatteringRenderModeNames[SSRM_PRECOMPUTED]+"/"+
-                               std::to_string(texIndex)+"/"+scatterer.name.toStdString());
-                }
-            }
-            if(scatterer.phaseFunctionType!=PhaseFunctionType::General)
+            createDirs(atmo.textureOutputDir+"/shaders/single-scattering-eclipsed/precomputation/"+
+                       std::to_string(texIndex)+"/"+scatterer.name.toStdString());
+            createDirs(atmo.textureOutputDir+"/shaders/single-scattering-eclipsed/"+singleScatteringRenderModeNames[SSRM_ON_THE_FLY]+"/"+
+                       std::to_string(texIndex)+"/"+scatterer.name.toStdString());
+            createDirs(atmo.textureOutputDir+"/shaders/single-scattering/"+singleScatteringRenderModeNames[SSRM_ON_THE_FLY]+"/"+
+                       std::to_string(texIndex)+"/"+scatterer.name.toStdString());
+            if(scatterer.phaseFunctionType==PhaseFunctionType::General)
             {
                 createDirs(atmo.textureOutputDir+"/shaders/single-scattering/"+singleScatteringRenderModeNames[SSRM_PRECOMPUTED]+"/"+
-                           scatterer.name.toStdString());
+                           std::to_string(texIndex)+"/"+scatterer.name.toStdString());
                 createDirs(atmo.textureOutputDir+"/shaders/single-scattering-eclipsed/"+singleScatteringRenderModeNames[SSRM_PRECOMPUTED]+"/"+
-                           scatterer.name.toStdString());
+                           std::to_string(texIndex)+"/"+scatterer.name.toStdString());
             }
         }
-        createDirs(atmo.textureOutputDir+"/shaders/double-scattering-eclipsed/precomputed/");
-        for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
+        if(scatterer.phaseFunctionType!=PhaseFunctionType::General)
         {
-            createDirs(atmo.textureOutputDir+"/shaders/zero-order-scattering/"+std::to_string(texIndex));
-            createDirs(atmo.textureOutputDir+"/shaders/eclipsed-zero-order-scattering/"+std::to_string(texIndex));
-            if(opts.saveResultAsRadiance)
-                createDirs(atmo.textureOutputDir+"/shaders/double-scattering-eclipsed/precomputed/"+std::to_string(texIndex));
-            createDirs(atmo.textureOutputDir+"/shaders/double-scattering-eclipsed/precomputation/"+std::to_string(texIndex));
-            createDirs(atmo.textureOutputDir+"/single-scattering/"+std::to_string(texIndex));
+            createDirs(atmo.textureOutputDir+"/shaders/single-scattering/"+singleScatteringRenderModeNames[SSRM_PRECOMPUTED]+"/"+
+                       scatterer.name.toStdString());
+            createDirs(atmo.textureOutputDir+"/shaders/single-scattering-eclipsed/"+singleScatteringRenderModeNames[SSRM_PRECOMPUTED]+"/"+
+                       scatterer.name.toStdString());
         }
-        createDirs(atmo.textureOutputDir+"/shaders/multiple-scattering/");
-        if(opts.saveResultAsRadiance)
-            for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
-                createDirs(atmo.textureOutputDir+"/shaders/multiple-scattering/"+std::to_string(texIndex));
-        createDirs(atmo.textureOutputDir+"/shaders/light-pollution/");
+    }
+    createDirs(atmo.textureOutputDir+"/shaders/double-scattering-eclipsed/precomputed/");
+    for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
+    {
+        createDirs(atmo.textureOutputDir+"/shaders/zero-order-scattering/"+std::to_string(texIndex));
+        createDirs(atmo.textureOutputDir+"/shaders/eclipsed-zero-order-scattering/"+std::to_string(texIndex));
         if(opts.saveResultAsRadiance)
-            for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
-                createDirs(atmo.textureOutputDir+"/shaders/light-pollution/"+std::to_string(texIndex));
+            createDirs(atmo.textureOutputDir+"/shaders/double-scattering-eclipsed/precomputed/"+std::to_string(texIndex));
+        createDirs(atmo.textureOutputDir+"/shaders/double-scattering-eclipsed/precomputation/"+std::to_string(texIndex));
+        createDirs(atmo.textureOutputDir+"/single-scattering/"+std::to_string(texIndex));
+    }
+    createDirs(atmo.textureOutputDir+"/shaders/multiple-scattering/");
+    if(opts.saveResultAsRadiance)
+        for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
+            createDirs(atmo.textureOutputDir+"/shaders/multiple-scattering/"+std::to_string(texIndex));
+    createDirs(atmo.textureOutputDir+"/shaders/light-pollution/");
+    if(opts.saveResultAsRadiance)
+        for(unsigned texIndex=0; texIndex<atmo.allWavelengths.size(); ++texIndex)
+            createDirs(atmo.textureOutputDir+"/shaders/light-pollution/"+std::to_string(texIndex));
+    if(opts.saveResultAsRadiance)
+    {
+        for(unsigned batchIndex=0; batchIndex<renderingBatchCount(); ++batchIndex)
+        {
+            createDirs(atmo.textureOutputDir+"/shaders/multiple-scattering-batched/"+std::to_string(batchIndex));
+            createDirs(atmo.textureOutputDir+"/shaders/double-scattering-eclipsed/precomputed-batched/"+std::to_string(batchIndex));
+            createDirs(atmo.textureOutputDir+"/shaders/light-pollution-batched/"+std::to_string(batchIndex));
+            for(const auto& scatterer : atmo.scatterers)
+                createDirs(atmo.textureOutputDir+"/shaders/single-scattering/precomputed-batched/"+
+                           std::to_string(batchIndex)+"/"+scatterer.name.toStdString());
+        }
+    }
+    createDirs(partialsDir());
 
+    if(opts.wavelengthSetsToCompute.empty()) // worker processes leave this to the parent
+    {
+        std::cerr << "Writing parameters to output description file...";
+        const auto target=atmo.textureOutputDir+"/params.atmo";
+        QFile file(target.c_str());
+        if(!file.open(QFile::WriteOnly))
         {
-            std::cerr << "Writing parameters to output description file...";
-            const auto target=atmo.textureOutputDir+"/params.atmo";
-            QFile file(target.c_str());
-            if(!file.open(QFile::WriteOnly))
-            {
-                std::cerr << " FAILED to open \"" << target << "\": " << file.errorString() << "\n";
-                throw MustQuit{};
-            }
-            QTextStream out(&file);
-            out << "version: " << AtmosphereParameters::FORMAT_VERSION << "\n";
-            if(opts.saveResultAsRadiance)
-                out << AtmosphereParameters::ALL_TEXTURES_ARE_RADIANCES_DIRECTIVE << "\n";
-            if(opts.dbgNoEDSTextures)
-                out << AtmosphereParameters::NO_ECLIPSED_DOUBLE_SCATTERING_TEXTURES_DIRECTIVE << "\n";
-            out << "# These spectra override the spectra further down the document. This is to make sure\n# we have all the required spectra inlined, rather than just references to files.\n";
-            out << AtmosphereParameters::WAVELENGTHS_KEY << ": min=" << atmo.allWavelengths.front().x
-                << "nm,max=" << atmo.allWavelengths.back().w << "nm,count=" << 4*atmo.allWavelengths.size() << "\n";
-            out << AtmosphereParameters::SOLAR_IRRADIANCE_AT_TOA_KEY << ": "
-                << AtmosphereParameters::spectrumToString(atmo.solarIrradianceAtTOA) << "\n";
-            out << "\n#Copy of original atmosphere description\n" << atmo.descriptionFileText;
-            out.flush();
-            file.close();
-            if(file.error())
-            {
-                std::cerr << " FAILED to write to \"" << target << "\": " << file.errorString() << "\n";
-                throw MustQuit{};
-            }
-            std::cerr << " done\n";
+            std::cerr << " FAILED to open \"" << target << "\": " << file.errorString() << "\n";
+            throw MustQuit{};
+        }
+        QTextStream out(&file);
+        out << "version: " << AtmosphereParameters::FORMAT_VERSION << "\n";
+        if(opts.saveResultAsRadiance)
+            out << AtmosphereParameters::ALL_TEXTURES_ARE_RADIANCES_DIRECTIVE << "\n";
+        if(opts.dbgNoEDSTextures)
+            out << AtmosphereParameters::NO_ECLIPSED_DOUBLE_SCATTERING_TEXTURES_DIRECTIVE << "\n";
+        // Lets the renderer know that the saved shaders expect textures of two altitude slices
+        out << AtmosphereParameters::ALTITUDE_SLICES_MIXED_IN_SHADERS_DIRECTIVE << "\n";
+        out << "# These spectra override the spectra further down the document. This is to make sure\n# we have all the required spectra inlined, rather than just references to files.\n";
+        out << AtmosphereParameters::WAVELENGTHS_KEY << ": min=" << atmo.allWavelengths.front().x
+            << "nm,max=" << atmo.allWavelengths.back().w << "nm,count=" << 4*atmo.allWavelengths.size() << "\n";
+        out << AtmosphereParameters::SOLAR_IRRADIANCE_AT_TOA_KEY << ": "
+            << AtmosphereParameters::spectrumToString(atmo.solarIrradianceAtTOA) << "\n";
+        out << "\n#Copy of original atmosphere description\n" << atmo.descriptionFileText;
+        out.flush();
+        file.close();
+        if(file.error())
+        {
+            std::cerr << " FAILED to write to \"" << target << "\": " << file.errorString() << "\n";
+            throw MustQuit{};
         }
+        std::cerr << " done\n";
+    }
 
-        const auto timeBegin=std::chrono::steady_clock::now();
+    if(opts.wavelengthSetsToCompute.empty())
+        initCheckpoints();
 
+    std::vector<unsigned> texIndices=opts.wavelengthSetsToCompute;
+    if(opts.jobs)
+    {
+        runWorkers();
+    }
+    else if(texIndices.empty())
+    {
         for(unsigned texIndex=0;texIndex<atmo.allWavelengths.size();++texIndex)
-        {
-            std::cerr << "Working on wavelengths " << atmo.allWavelengths[texIndex][0] << ", "
-                                                   << atmo.allWavelengths[texIndex][1] << ", "
-                                                   << atmo.allWavelengths[texIndex][2] << ", "
-                                                   << atmo.allWavelengths[texIndex][3] << " nm"
-                         " (set " << texIndex+1 << " of " << atmo.allWavelengths.size() << "):\n";
-            OutputIndentIncrease incr;
-
-            initConstHeader(atmo.allWavelengths[texIndex]);
-            virtualSourceFiles[COMPUTE_TRANSMITTANCE_SHADER_FILENAME]=
-                makeTransmittanceComputeFunctionsSrc(atmo.allWavelengths[texIndex]);
-            virtualSourceFiles[PHASE_FUNCTIONS_SHADER_FILENAME]=makePhaseFunctionsSrc();
-            virtualSourceFiles[TOTAL_SCATTERING_COEFFICIENT_SHADER_FILENAME]=makeTotalScatteringCoefSrc();
-            virtualHeaderFiles[RADIANCE_TO_LUMINANCE_HEADER_FILENAME]="const mat4 radianceToLuminance=" +
-                                                  toString(radianceToLuminance(texIndex, atmo.allWavelengths)) + ";\n";
+            texIndices.push_back(texIndex);
+    }
 
-            saveZeroOrderScatteringRenderingShader(texIndex);
-            saveEclipsedZeroOrderScatteringRenderingShader(texIndex);
+    // The sets completed in a previous run don't count as work done in this one, otherwise the ETA would be too low
+    const unsigned setsDoneBefore=std::count_if(texIndices.begin(), texIndices.end(), wavelengthSetCompletedPreviously);
+    ReportedProgress progress("wavelength sets", texIndices.size(), "wavelength sets", setsDoneBefore);
+    unsigned setsDone=setsDoneBefore;
+    for(const unsigned texIndex : texIndices)
+    {
+        if(wavelengthSetCompletedPreviously(texIndex))
+        {
+            std::cerr << "Wavelength set " << texIndex+1 << " of " << atmo.allWavelengths.size()
+                      << " was completed in a previous run, skipping it\n";
+            continue;
+        }
 
+        std::cerr << "Working on wavelengths " << atmo.allWavelengths[texIndex][0] << ", "
+                                               << atmo.allWavelengths[texIndex][1] << ", "
+                                               << atmo.allWavelengths[texIndex][2] << ", "
+                                               << atmo.allWavelengths[texIndex][3] << " nm"
+                     " (set " << texIndex+1 << " of " << atmo.allWavelengths.size() << "):\n";
+        OutputIndentIncrease incr;
+        const ProfiledStage profiledStage("wavelength set", texIndex);
+        const ReportedProgress setProgress("wavelength set "+std::to_string(texIndex+1)+" of "+
+                                           std::to_string(atmo.allWavelengths.size()));
+
+        // Reset before restoring, since the checkpoint may continue the convergence check of an interrupted run
+        lastScatteringOrder=atmo.scatteringOrdersToCompute;
+        resetScatteringOrdersConvergence();
+        const unsigned scatteringOrdersDone=restoreCheckpoint(texIndex);
+
+        initConstHeader(atmo.allWavelengths[texIndex]);
+        virtualSourceFiles[COMPUTE_TRANSMITTANCE_SHADER_FILENAME]=
+            makeTransmittanceComputeFunctionsSrc(atmo.allWavelengths[texIndex]);
+        virtualSourceFiles[PHASE_FUNCTIONS_SHADER_FILENAME]=makePhaseFunctionsSrc();
+        virtualSourceFiles[TOTAL_SCATTERING_COEFFICIENT_SHADER_FILENAME]=makeTotalScatteringCoefSrc();
+        virtualHeaderFiles[RADIANCE_TO_LUMINANCE_HEADER_FILENAME]="const mat4 radianceToLuminance=" +
+                                              toString(radianceToLuminance(texIndex, atmo.allWavelengths)) + ";\n";
+
+        saveZeroOrderScatteringRenderingShader(texIndex);
+        saveEclipsedZeroOrderScatteringRenderingShader(texIndex);
+
+        // The results of these stages are in the checkpoint if it's been restored
+        if(!scatteringOrdersDone)
+        {
             {
                 std::cerr << indentOutput() << "Computing parts of scattering order 1:\n";
                 OutputIndentIncrease incr;
@@ -1267,8 +1606,13 @@ int main(int argc, char** argv)
                 computeDirectGroundIrradiance(texIndex);
             }
 
-            computeLightPollutionSingleScattering(texIndex);
-            computeLightPollutionMultipleScattering(texIndex);
+            const auto lightPollutionKey=lightPollutionStageKey(texIndex);
+            if(!loadStageResult(GL_TEXTURE_2D, textures[TEX_LIGHT_POLLUTION_SCATTERING], lightPollutionKey))
+            {
+                computeLightPollutionSingleScattering(texIndex);
+                computeLightPollutionMultipleScattering(texIndex);
+                saveStageResult(GL_TEXTURE_2D, textures[TEX_LIGHT_POLLUTION_SCATTERING], lightPollutionKey);
+            }
             if(opts.saveResultAsRadiance)
             {
                 saveTexture(GL_TEXTURE_2D,textures[TEX_LIGHT_POLLUTION_SCATTERING],"light pollution texture",
@@ -1279,26 +1623,133 @@ int main(int argc, char** argv)
             {
                 accumulateLightPollutionLuminanceTexture(texIndex);
             }
-            saveLightPollutionRenderingShader(texIndex);
+        }
+        saveLightPollutionRenderingShader(texIndex);
 
-            computeMultipleScattering(texIndex);
-            if(opts.saveResultAsRadiance)
+        computeMultipleScattering(texIndex, scatteringOrdersDone);
+        if(opts.saveResultAsRadiance)
+        {
+            saveMultipleScatteringRenderingShader(texIndex);
+            saveEclipsedDoubleScatteringRenderingShader(texIndex);
+        }
+
+        computeEclipsedDoubleScattering(texIndex);
+
+        saveWavelengthSetCompletedCheckpoint(texIndex);
+        progress.update(++setsDone);
+        reportWavelengthSetDoneToParent(texIndex);
+        resolveFinishedStageQueries();
+    }
+    if(!opts.saveResultAsRadiance && !texIndices.empty() && texIndices.back()+1==atmo.allWavelengths.size())
+    {
+        saveMultipleScatteringRenderingShader(-1);
+        saveEclipsedDoubleScatteringRenderingShader(-1);
+    }
+    if(opts.saveResultAsRadiance && !texIndices.empty() && texIndices.back()+1==atmo.allWavelengths.size())
+    {
+        for(unsigned batchIndex=0; batchIndex<renderingBatchCount(); ++batchIndex)
+            saveBatchedRadianceRenderingShaders(batchIndex);
+    }
+
+    if(opts.scatteringOrdersTolerance>0 && opts.wavelengthSetsToCompute.empty())
+        recordScatteringOrdersReached();
+
+    waitForTextureSaves();
+    if(opts.wavelengthSetsToCompute.empty())
+    {
+        // Done the same way whether the wavelength sets were computed here or by the workers,
+        // so that the result doesn't depend on the number of jobs
+        mergePartialLuminances();
+        removeCheckpoints();
+    }
+
+    const auto timeEnd=std::chrono::steady_clock::now();
+    std::cerr << "Finished in " << formatDeltaTime(timeBegin, timeEnd) << "\n";
+}
+
+void runBatch()
+{
+    const auto jobs=batchJobs();
+    {
+        ReportedProgress progress("atmospheres", jobs.size(), "atmospheres");
+        for(unsigned n=0; n<jobs.size(); ++n)
+        {
+            std::cerr << "Atmosphere " << n+1 << " of " << jobs.size() << ": \"" << jobs[n].atmoDescrPath;
+            if(!jobs[n].sweepValue.isEmpty())
+                std::cerr << "\" with " << opts.sweepParameter << " = " << jobs[n].sweepValue;
+            else
+                std::cerr << "\"";
+            std::cerr << ", output to \"" << jobs[n].textureOutputDir << "\"\n";
+            OutputIndentIncrease incr;
+            loadBatchJob(jobs[n]);
+            initAtmosphereTextures();
+            computeAtmosphere();
+            progress.update(n+1);
+        }
+    }
+    if(!opts.sweepParameter.empty())
+        writeSweepIndex(jobs);
+}
+
+int main(int argc, char** argv)
+{
+    [[maybe_unused]] UTF8Console utf8console;
+
+    qInstallMessageHandler(qtMessageHandler);
+    // Let long-running stages finish their queued GPU work and quit cleanly on the first
+    // interrupt; the second one will kill the process as usual.
+    std::signal(SIGINT, [](int)
+                {
+                    interruptRequested=1;
+                    std::signal(SIGINT, SIG_DFL);
+                });
+    QApplication app(argc, argv);
+    app.setApplicationName("CalcMySky");
+    app.setApplicationVersion(PROJECT_VERSION);
+    [[maybe_unused]] TextureWritersGuard textureWritersGuard;
+
+    try
+    {
+        handleCmdLine();
+
+        std::cerr << qApp->applicationName() << ' ' << qApp->applicationVersion() << '\n';
+        std::cerr << "Compiled against Qt " << QT_VERSION_MAJOR << "." << QT_VERSION_MINOR << "." << QT_VERSION_PATCH << "\n";
+        std::cerr << "Running on " << QSysInfo::prettyProductName().toStdString() << " " << QSysInfo::currentCpuArchitecture() << "\n";
+
+        if(opts.estimateOnly)
+        {
+            if(opts.batchManifestPath.empty() && opts.sweepParameter.empty())
+            {
+                printEstimate();
+                return 0;
+            }
+            for(const auto& job : batchJobs())
             {
-                saveMultipleScatteringRenderingShader(texIndex);
-                saveEclipsedDoubleScatteringRenderingShader(texIndex);
+                if(job.sweepValue.isEmpty())
+                    std::cout << "\n\"" << job.atmoDescrPath << "\":\n";
+                else
+                    std::cout << "\n" << opts.sweepParameter << " = " << job.sweepValue << ":\n";
+                loadBatchJob(job);
+                printEstimate();
             }
+            return 0;
+        }
 
-            computeEclipsedDoubleScattering(texIndex);
+        [[maybe_unused]] const auto glCtxAndSfc = initOpenGL();
 
+        if(opts.batchManifestPath.empty() && opts.sweepParameter.empty())
+        {
+            initAtmosphereTextures();
+            computeAtmosphere();
         }
-        if(!opts.saveResultAsRadiance)
+        else
         {
-            saveMultipleScatteringRenderingShader(-1);
-            saveEclipsedDoubleScatteringRenderingShader(-1);
+            runBatch();
         }
 
-        const auto timeEnd=std::chrono::steady_clock::now();
-        std::cerr << "Finished in " << formatDeltaTime(timeBegin, timeEnd) << "\n";
+        printProgramCacheStats();
+        writeProfileReport();
+        writeCalibration();
     }
     catch(ParsingError const& ex)
     {
@@ -0,0 +1,271 @@
+#include "parallel.hpp"
+
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QStringList>
+#include <QCoreApplication>
+
+#include "util.hpp"
+#include "checkpoint.hpp"
+#include "profiling.hpp"
+#include "progress-stream.hpp"
+#include "interpolation-guides.hpp"
+
+namespace
+{
+
+// Printed by the workers, so that the parent process can follow their progress in their output
+constexpr char wavelengthSetDoneMarker[]="Worker finished wavelength set ";
+
+std::vector<glm::vec4> readPartialLuminance(std::string const& path, std::vector<uint16_t>& header)
+{
+    QFile file(QString::fromStdString(path));
+    if(!file.open(QFile::ReadOnly))
+    {
+        std::cerr << "failed to open \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    const qint64 headerByteCount=header.size()*sizeof header[0];
+    if(file.read(reinterpret_cast<char*>(header.data()), headerByteCount) != headerByteCount)
+    {
+        std::cerr << "failed to read header of \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+
+    const auto dataByteCount=file.size()-headerByteCount;
+    if(dataByteCount % sizeof(glm::vec4))
+    {
+        std::cerr << "size of \"" << path << "\" is not a whole number of texels\n";
+        throw MustQuit{};
+    }
+    std::vector<glm::vec4> data(dataByteCount/sizeof(glm::vec4));
+    if(file.read(reinterpret_cast<char*>(data.data()), dataByteCount) != dataByteCount)
+    {
+        std::cerr << "failed to read \"" << path << "\": " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    return data;
+}
+
+std::vector<glm::vec4> mergePartials(std::string_view what, std::string const& outputPath,
+                                     const unsigned headerSize, const ReducePrecision reducePrecision)
+{
+    std::cerr << indentOutput() << "Merging " << what << " into \"" << outputPath << "\"... ";
+
+    // The order of summation is fixed, so that the result doesn't depend on how the
+    // wavelength sets were distributed between the workers.
+    std::vector<uint16_t> header(headerSize);
+    std::vector<glm::vec4> sum=readPartialLuminance(partialLuminancePath(what, 0), header);
+    for(unsigned texIndex=1; texIndex<atmo.allWavelengths.size(); ++texIndex)
+    {
+        std::vector<uint16_t> currentHeader(headerSize);
+        const auto data=readPartialLuminance(partialLuminancePath(what, texIndex), currentHeader);
+        if(currentHeader!=header || data.size()!=sum.size())
+        {
+            std::cerr << "partial texture for wavelength set " << texIndex+1 << " has mismatching size\n";
+            throw MustQuit{};
+        }
+        for(size_t i=0; i<sum.size(); ++i)
+            sum[i] += data[i];
+    }
+
+    auto dataToSave=sum;
+    if(reducePrecision && opts.textureSavePrecision)
+        roundTexData(&dataToSave[0][0], 4*dataToSave.size(), opts.textureSavePrecision);
+
+    const auto writeBegin=std::chrono::steady_clock::now();
+    QFile out(QString::fromStdString(outputPath));
+    if(!out.open(QFile::WriteOnly))
+    {
+        std::cerr << "failed to open file: " << out.errorString() << "\n";
+        throw MustQuit{};
+    }
+    out.write(reinterpret_cast<const char*>(header.data()), header.size()*sizeof header[0]);
+    out.write(reinterpret_cast<const char*>(dataToSave.data()), dataToSave.size()*sizeof dataToSave[0]);
+    out.close();
+    if(out.error())
+    {
+        std::cerr << "failed to write file: " << out.errorString() << "\n";
+        throw MustQuit{};
+    }
+    recordFileWrite(outputPath, header.size()*sizeof header[0]+dataToSave.size()*sizeof dataToSave[0], writeBegin);
+    std::cerr << "done\n";
+    return sum;
+}
+
+}
+
+std::string partialsDir()
+{
+    return atmo.textureOutputDir+"/partial";
+}
+
+std::string partialLuminancePath(const std::string_view what, const unsigned texIndex)
+{
+    return partialsDir()+"/"+std::string(what)+"-wlset"+std::to_string(texIndex)+".f32";
+}
+
+void reportWavelengthSetDoneToParent(const unsigned texIndex)
+{
+    if(opts.wavelengthSetsToCompute.empty()) return;
+    std::cerr << wavelengthSetDoneMarker << texIndex+1 << "\n";
+}
+
+void runWorkers()
+{
+    const unsigned numWavelengthSets=atmo.allWavelengths.size();
+    const unsigned numWorkers=std::min(opts.jobs, numWavelengthSets);
+
+    std::cerr << "Running " << numWorkers << " worker processes:\n";
+    OutputIndentIncrease incr;
+
+    struct Worker
+    {
+        QProcess process;
+        QFile log;
+        QByteArray incompleteLine; // of the output read so far
+        unsigned setCount=0, setsDone=0;
+        bool finished=false;
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+    unsigned setsDoneBefore=0;
+    for(unsigned w=0; w<numWorkers; ++w)
+    {
+        auto& worker=*workers.emplace_back(std::make_unique<Worker>());
+        // Round-robin distribution: the sets are of similar cost, and this way the last
+        // set is the last one processed by its worker, as required by the shaders saved after it.
+        QStringList setIndices, setNumbers;
+        for(unsigned texIndex=w; texIndex<numWavelengthSets; texIndex+=numWorkers)
+        {
+            setIndices << QString::number(texIndex);
+            setNumbers << QString::number(texIndex+1);
+            ++worker.setCount;
+            // The worker will skip these, they are not part of the work to estimate the remaining time from
+            if(wavelengthSetCompletedPreviously(texIndex))
+                ++worker.setsDone;
+        }
+        setsDoneBefore += worker.setsDone;
+
+        worker.log.setFileName(QString("%1/worker%2.log").arg(partialsDir().c_str()).arg(w+1));
+        if(!worker.log.open(QFile::WriteOnly|QFile::Truncate))
+        {
+            std::cerr << "Failed to open log file \"" << worker.log.fileName() << "\" for worker " << w+1
+                      << ": " << worker.log.errorString() << "\n";
+            throw MustQuit{};
+        }
+        worker.process.setProcessChannelMode(QProcess::MergedChannels);
+        worker.process.start(QCoreApplication::applicationFilePath(),
+                             QCoreApplication::arguments().mid(1) << "--worker-wlsets" << setIndices.join(','));
+        if(!worker.process.waitForStarted(-1))
+        {
+            std::cerr << "Failed to start worker " << w+1 << ": " << worker.process.errorString() << "\n";
+            throw MustQuit{};
+        }
+        std::cerr << indentOutput() << "Worker " << w+1 << " started for wavelength sets " << setNumbers.join(", ")
+                  << ", logging to \"" << worker.log.fileName() << "\"\n";
+    }
+
+    // The workers progress concurrently, so their output is followed all at once rather than
+    // waiting for each in turn, and the progress is counted in wavelength sets, not workers.
+    bool allSucceeded=true;
+    ReportedProgress progress("worker processes", numWavelengthSets, "wavelength sets", setsDoneBefore);
+    unsigned setsDone=setsDoneBefore;
+    for(unsigned workersRunning=numWorkers; workersRunning;)
+    {
+        for(unsigned w=0; w<numWorkers; ++w)
+        {
+            auto& worker=*workers[w];
+            if(worker.finished) continue;
+
+            // A short wait, so that a quiet worker doesn't delay the reports of the others
+            worker.process.waitForReadyRead(100);
+            const bool exited = worker.process.state()==QProcess::NotRunning;
+            const auto output=worker.process.readAll();
+            worker.log.write(output);
+            worker.log.flush();
+
+            worker.incompleteLine += output;
+            for(int lineEnd; (lineEnd=worker.incompleteLine.indexOf('\n')) >= 0;)
+            {
+                const bool setDone=worker.incompleteLine.left(lineEnd).contains(wavelengthSetDoneMarker);
+                worker.incompleteLine.remove(0, lineEnd+1);
+                if(!setDone) continue;
+
+                ++worker.setsDone;
+                progress.update(++setsDone);
+                std::cerr << indentOutput() << "Worker " << w+1 << ": " << worker.setsDone << " of "
+                          << worker.setCount << " wavelength sets done\n";
+            }
+
+            if(!exited) continue;
+            worker.finished=true;
+            --workersRunning;
+            worker.log.close();
+            if(worker.process.exitStatus()!=QProcess::NormalExit || worker.process.exitCode()!=0)
+            {
+                std::cerr << indentOutput() << "Worker " << w+1 << " FAILED, see \"" << worker.log.fileName() << "\" for details\n";
+                allSucceeded=false;
+                continue;
+            }
+            std::cerr << indentOutput() << "Worker " << w+1 << " finished\n";
+        }
+    }
+    if(!allSucceeded)
+        throw MustQuit{};
+}
+
+void mergePartialLuminances()
+{
+    if(opts.dbgNoSaveTextures)
+    {
+        std::cerr << "Would merge partial luminance textures, but only shaders are to be saved.\n";
+    }
+    else
+    {
+        std::cerr << "Merging luminance contributions of wavelength sets:\n";
+        OutputIndentIncrease incr;
+
+        if(computingPartials())
+        {
+            mergePartials("multiple-scattering", atmo.textureOutputDir+"/multiple-scattering-xyzw.f32",
+                          4, ReducePrecision{true});
+        }
+
+        for(const auto& scatterer : atmo.scatterers)
+        {
+            if(scatterer.phaseFunctionType==PhaseFunctionType::General)
+                continue;
+            const auto filePath = atmo.textureOutputDir+"/single-scattering/"+scatterer.name.toStdString()+"-xyzw.f32";
+            const auto data=mergePartials("single-scattering-"+scatterer.name.toStdString(), filePath,
+                                          4, ReducePrecision{true});
+            if(scatterer.needsInterpolationGuides)
+            {
+                const std::vector<int> sizes{atmo.scatteringTextureSize[0], atmo.scatteringTextureSize[1],
+                                             atmo.scatteringTextureSize[2], atmo.scatteringTextureSize[3]};
+                generateInterpolationGuidesForScatteringTexture(filePath, data, sizes);
+            }
+        }
+
+        if(computingPartials())
+        {
+            // 2D textures are always saved at full precision, see saveTexture()
+            mergePartials("light-pollution", atmo.textureOutputDir+"/light-pollution-xyzw.f32",
+                          2, ReducePrecision{false});
+        }
+
+        if(computingPartials() && !opts.dbgNoEDSTextures)
+        {
+            mergePartials("eclipsed-double-scattering", atmo.textureOutputDir+"/eclipsed-double-scattering-xyzw.f32",
+                          1, ReducePrecision{true});
+        }
+    }
+
+    if(!QDir(QString::fromStdString(partialsDir())).removeRecursively())
+        std::cerr << "Warning: failed to remove directory \"" << partialsDir() << "\"\n";
+}
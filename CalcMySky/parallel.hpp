@@ -0,0 +1,24 @@
+#ifndef INCLUDE_ONCE_0E9D3B52_61C4_4A0B_9C4E_7D2A8F55B1C3
+#define INCLUDE_ONCE_0E9D3B52_61C4_4A0B_9C4E_7D2A8F55B1C3
+
+#include <string>
+#include <string_view>
+#include "data.hpp"
+
+// The XYZW contribution of each wavelength set is saved separately, and when all the sets are done,
+// the contributions are summed up on the CPU in a fixed order. This is done the same way whether
+// the sets are computed in a single process or in --jobs worker processes, so the result is
+// bit-identical for any number of jobs. In radiance mode the only XYZW textures are those of single
+// scattering with non-general phase functions, which are saved as partials regardless of this function.
+inline bool computingPartials()
+{
+    return !opts.saveResultAsRadiance;
+}
+std::string partialsDir();
+std::string partialLuminancePath(std::string_view what, unsigned texIndex);
+void runWorkers();
+// Lets the parent process of a worker track its progress. Does nothing if this process is not a worker.
+void reportWavelengthSetDoneToParent(unsigned texIndex);
+void mergePartialLuminances();
+
+#endif
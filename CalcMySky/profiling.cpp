@@ -0,0 +1,268 @@
+#include "profiling.hpp"
+
+#include <map>
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <vector>
+#include <iostream>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+#include "data.hpp"
+#include "util.hpp"
+
+namespace
+{
+
+const auto programStart=std::chrono::steady_clock::now();
+
+struct StageRecord
+{
+    std::string name;
+    int texIndex;
+    unsigned depth;
+    double wallSeconds=0;
+    double gpuSeconds=0;
+    GLuint queries[2]={};
+    bool ended=false;
+    bool resolved=false;
+};
+std::vector<StageRecord> stageRecords;
+// Records before this one all have their GPU times fetched
+size_t firstUnresolvedRecord=0;
+// Query objects whose results have been fetched, to be reused by the following stages
+std::vector<GLuint> freeQueries;
+unsigned currentDepth=0;
+
+struct ProgramBuildStats
+{
+    unsigned count=0;
+    unsigned cacheHits=0;
+    double seconds=0;
+};
+std::map<std::string, ProgramBuildStats> programBuilds;
+
+struct FileWriteRecord
+{
+    std::string path;
+    size_t bytes;
+    double seconds;
+};
+std::mutex fileWritesMutex;
+std::vector<FileWriteRecord> fileWrites;
+
+std::vector<StageTiming> stageTimings;
+
+bool profiling()
+{
+    return !opts.profileReportPath.empty() || !opts.calibrationOutputPath.empty();
+}
+
+double secondsSince(const std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+}
+
+void resolveStageRecord(StageRecord& record)
+{
+    GLuint64 gpuBegin=0, gpuEnd=0;
+    gl.glGetQueryObjectui64v(record.queries[0], GL_QUERY_RESULT, &gpuBegin);
+    gl.glGetQueryObjectui64v(record.queries[1], GL_QUERY_RESULT, &gpuEnd);
+    record.gpuSeconds=1e-9*double(gpuEnd-gpuBegin);
+    freeQueries.insert(freeQueries.end(), std::begin(record.queries), std::end(record.queries));
+    record.queries[0]=record.queries[1]=0;
+    record.resolved=true;
+}
+
+}
+
+ProfiledStage::ProfiledStage(std::string name, const int texIndex)
+    : begin(std::chrono::steady_clock::now())
+    , recordIndex(stageRecords.size())
+    , active(profiling())
+{
+    if(!active) return;
+
+    StageRecord record{std::move(name), texIndex, currentDepth++};
+    if(freeQueries.size()>=2)
+    {
+        record.queries[0]=freeQueries.rbegin()[0];
+        record.queries[1]=freeQueries.rbegin()[1];
+        freeQueries.resize(freeQueries.size()-2);
+    }
+    else
+    {
+        gl.glGenQueries(2, record.queries);
+    }
+    gl.glQueryCounter(record.queries[0], GL_TIMESTAMP);
+    stageRecords.emplace_back(std::move(record));
+}
+
+ProfiledStage::~ProfiledStage()
+{
+    if(!active) return;
+
+    auto& record=stageRecords[recordIndex];
+    gl.glQueryCounter(record.queries[1], GL_TIMESTAMP);
+    record.wallSeconds=secondsSince(begin);
+    record.ended=true;
+    --currentDepth;
+}
+
+void resolveFinishedStageQueries()
+{
+    if(!profiling()) return;
+
+    for(size_t i=firstUnresolvedRecord; i<stageRecords.size(); ++i)
+    {
+        auto& record=stageRecords[i];
+        if(record.resolved || !record.ended) continue;
+        GLint available=false;
+        gl.glGetQueryObjectiv(record.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        // Timestamps are recorded in order, so the following stages haven't finished on the GPU either
+        if(!available) break;
+        resolveStageRecord(record);
+    }
+    while(firstUnresolvedRecord<stageRecords.size() && stageRecords[firstUnresolvedRecord].resolved)
+        ++firstUnresolvedRecord;
+}
+
+void recordShaderProgramBuild(std::string const& description, const std::chrono::steady_clock::time_point buildBegin,
+                              const bool fromCache)
+{
+    if(!profiling()) return;
+
+    auto& stats=programBuilds[description];
+    ++stats.count;
+    if(fromCache)
+        ++stats.cacheHits;
+    stats.seconds += secondsSince(buildBegin);
+}
+
+void recordFileWrite(std::string const& path, const size_t bytes, const std::chrono::steady_clock::time_point writeBegin)
+{
+    if(!profiling()) return;
+
+    const auto seconds=secondsSince(writeBegin);
+    std::lock_guard lock(fileWritesMutex);
+    fileWrites.push_back({path, bytes, seconds});
+}
+
+std::vector<StageTiming> const& finishedStageTimings()
+{
+    // The queries are deleted once all the results are fetched, and the results are kept here
+    for(unsigned i=0; i<stageRecords.size(); ++i)
+    {
+        auto& record=stageRecords[i];
+        if(!record.resolved)
+            resolveStageRecord(record);
+
+        double childrenSeconds=0;
+        for(unsigned k=i+1; k<stageRecords.size() && stageRecords[k].depth>record.depth; ++k)
+            if(stageRecords[k].depth==record.depth+1)
+                childrenSeconds += stageRecords[k].wallSeconds;
+
+        stageTimings.push_back({record.name, record.texIndex, record.depth, record.wallSeconds,
+                                record.gpuSeconds, std::max(0., record.wallSeconds-childrenSeconds)});
+    }
+    stageRecords.clear();
+    firstUnresolvedRecord=0;
+    if(!freeQueries.empty())
+        gl.glDeleteQueries(freeQueries.size(), freeQueries.data());
+    freeQueries.clear();
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error while fetching timer query results: " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+    return stageTimings;
+}
+
+size_t totalBytesWritten()
+{
+    std::lock_guard lock(fileWritesMutex);
+    size_t total=0;
+    for(const auto& write : fileWrites)
+        total += write.bytes;
+    return total;
+}
+
+void writeProfileReport()
+{
+    if(!profiling()) return;
+
+    // Worker processes of --jobs get the same command line, so they must not overwrite each other's reports
+    if(opts.profileReportPath.empty()) return;
+
+    auto path=opts.profileReportPath;
+    if(!opts.wavelengthSetsToCompute.empty())
+        path += ".worker-wlset"+std::to_string(opts.wavelengthSetsToCompute.front());
+
+    std::cerr << "Writing profile report to \"" << path << "\"... ";
+
+    QJsonArray stages;
+    for(const auto& timing : finishedStageTimings())
+    {
+        QJsonObject stage;
+        stage["name"]=QString::fromStdString(timing.name);
+        if(timing.texIndex>=0)
+            stage["wavelengthSet"]=timing.texIndex;
+        stage["depth"]=int(timing.depth);
+        stage["wallSeconds"]=timing.wallSeconds;
+        stage["selfWallSeconds"]=timing.selfWallSeconds;
+        stage["gpuSeconds"]=timing.gpuSeconds;
+        stages.append(stage);
+    }
+
+    QJsonArray programs;
+    double programSeconds=0;
+    for(const auto& [description, stats] : programBuilds)
+    {
+        QJsonObject program;
+        program["description"]=QString::fromStdString(description);
+        program["count"]=int(stats.count);
+        program["cacheHits"]=int(stats.cacheHits);
+        program["wallSeconds"]=stats.seconds;
+        programs.append(program);
+        programSeconds += stats.seconds;
+    }
+
+    QJsonArray files;
+    {
+        std::lock_guard lock(fileWritesMutex);
+        for(const auto& write : fileWrites)
+        {
+            QJsonObject file;
+            file["path"]=QString::fromStdString(write.path);
+            file["bytes"]=qint64(write.bytes);
+            file["wallSeconds"]=write.seconds;
+            files.append(file);
+        }
+    }
+
+    QJsonObject root;
+    root["totalWallSeconds"]=secondsSince(programStart);
+    root["stages"]=stages;
+    root["shaderPrograms"]=programs;
+    root["shaderProgramsWallSeconds"]=programSeconds;
+    root["fileWrites"]=files;
+    root["bytesWritten"]=qint64(totalBytesWritten());
+
+    QFile file(QString::fromStdString(path));
+    if(!file.open(QFile::WriteOnly))
+    {
+        std::cerr << "FAILED to open: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    file.write(QJsonDocument(root).toJson());
+    file.close();
+    if(file.error())
+    {
+        std::cerr << "FAILED to write: " << file.errorString() << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+}
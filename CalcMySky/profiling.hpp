@@ -0,0 +1,55 @@
+#ifndef INCLUDE_ONCE_B4D81F3C_7A26_4E95_9C0B_E5A3F62D1874
+#define INCLUDE_ONCE_B4D81F3C_7A26_4E95_9C0B_E5A3F62D1874
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <QOpenGLFunctions_3_3_Core>
+
+/* Per-stage timings for --profile-report.
+ *
+ * Each stage gets the wall-clock time and the GPU time between two GL_TIMESTAMP queries issued
+ * at its beginning and end. Unlike GL_TIME_ELAPSED queries, timestamps can be nested, which is
+ * needed since e.g. texture saves happen inside the stages. The results of the queries that the GPU
+ * has already reached are fetched after each wavelength set, and the query objects are reused, so
+ * that they don't pile up over long runs. The rest are fetched when the report is written, so
+ * profiling doesn't make the CPU wait for the GPU.
+ *
+ * All the functions do nothing unless the report or a calibration (see estimate.hpp) was requested.
+ */
+
+class ProfiledStage
+{
+    std::chrono::steady_clock::time_point begin;
+    size_t recordIndex;
+    bool active;
+public:
+    // texIndex is the wavelength set the stage works on, or -1 if it's not specific to one
+    ProfiledStage(std::string name, int texIndex);
+    ~ProfiledStage();
+    ProfiledStage(ProfiledStage const&) = delete;
+    ProfiledStage& operator=(ProfiledStage const&) = delete;
+};
+
+struct StageTiming
+{
+    std::string name;
+    int texIndex;
+    unsigned depth;
+    double wallSeconds;
+    double gpuSeconds;
+    double selfWallSeconds; // excluding the nested stages
+};
+// Fetches the GPU times of the ended stages whose results are available without waiting, freeing their queries for reuse
+void resolveFinishedStageQueries();
+// Waits for the GPU to finish, so must be called at the end, when no stage is active
+std::vector<StageTiming> const& finishedStageTimings();
+size_t totalBytesWritten();
+
+// Records a shader program compiled and linked, or loaded from the cache, since buildBegin
+void recordShaderProgramBuild(std::string const& description, std::chrono::steady_clock::time_point buildBegin, bool fromCache);
+// Records a file written since writeBegin. Thread-safe, since files are written by the texture saving threads too.
+void recordFileWrite(std::string const& path, size_t bytes, std::chrono::steady_clock::time_point writeBegin);
+void writeProfileReport();
+
+#endif
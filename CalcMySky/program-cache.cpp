@@ -0,0 +1,191 @@
+#include "program-cache.hpp"
+
+#include <map>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+
+#include "data.hpp"
+#include "util.hpp"
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+# define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+# define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+# define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+namespace
+{
+
+struct ProgramBinary
+{
+    GLenum format;
+    QByteArray data;
+};
+
+QOpenGLExtraFunctions* glExtra;
+QByteArray driverIdentification;
+std::map<QByteArray, ProgramBinary> memoryCache;
+unsigned memoryHits=0, diskHits=0, misses=0;
+
+QString diskCachePath(QByteArray const& key)
+{
+    return QString("%1/%2.bin").arg(QString::fromStdString(opts.programCacheDir), QString(key.toHex()));
+}
+
+const ProgramBinary* findBinary(QByteArray const& key)
+{
+    if(const auto it=memoryCache.find(key); it!=memoryCache.end())
+    {
+        ++memoryHits;
+        return &it->second;
+    }
+    if(opts.programCacheDir.empty())
+        return nullptr;
+
+    QFile file(diskCachePath(key));
+    if(!file.open(QFile::ReadOnly))
+        return nullptr;
+    const auto contents=file.readAll();
+    uint32_t format;
+    if(file.error() || size_t(contents.size()) <= sizeof format)
+        return nullptr;
+    std::memcpy(&format, contents.data(), sizeof format);
+    ++diskHits;
+    return &memoryCache.emplace(key, ProgramBinary{format, contents.mid(sizeof format)}).first->second;
+}
+
+void forgetBinary(QByteArray const& key)
+{
+    memoryCache.erase(key);
+    if(!opts.programCacheDir.empty())
+        QFile::remove(diskCachePath(key));
+}
+
+}
+
+void initProgramCache(QOpenGLContext& context)
+{
+    const auto version=context.format().version();
+    if(version < qMakePair(4,1) && !context.hasExtension(QByteArrayLiteral("GL_ARB_get_program_binary")))
+    {
+        std::cerr << "Program binaries are not supported, shader program cache is disabled\n";
+        return;
+    }
+    GLint formatCount=0;
+    gl.glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if(formatCount<=0)
+    {
+        std::cerr << "Driver provides no program binary formats, shader program cache is disabled\n";
+        return;
+    }
+
+    glExtra=context.extraFunctions();
+    driverIdentification=QByteArray(reinterpret_cast<const char*>(gl.glGetString(GL_VENDOR)))+'\n'+
+                         reinterpret_cast<const char*>(gl.glGetString(GL_RENDERER))+'\n'+
+                         reinterpret_cast<const char*>(gl.glGetString(GL_VERSION))+'\n';
+
+    if(!opts.programCacheDir.empty() && !QDir().mkpath(QString::fromStdString(opts.programCacheDir)))
+    {
+        std::cerr << "Warning: failed to create program cache directory \"" << opts.programCacheDir
+                  << "\", only caching in memory\n";
+        opts.programCacheDir.clear();
+    }
+}
+
+QByteArray programCacheKey(std::vector<ShaderSource> const& sources)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(driverIdentification);
+    for(const auto& shader : sources)
+    {
+        hash.addData(QByteArray::number(int(shader.type))+'\n');
+        hash.addData(shader.source.toUtf8());
+        hash.addData(QByteArray(1, '\0'));
+    }
+    return hash.result();
+}
+
+bool loadProgramFromCache(QOpenGLShaderProgram& program, QByteArray const& key)
+{
+    if(!glExtra) return false;
+
+    const auto binary=findBinary(key);
+    if(!binary)
+    {
+        ++misses;
+        return false;
+    }
+
+    program.create();
+    glExtra->glProgramBinary(program.programId(), binary->format, binary->data.constData(), binary->data.size());
+    GLint linked=GL_FALSE;
+    gl.glGetProgramiv(program.programId(), GL_LINK_STATUS, &linked);
+    // Clear the error a rejected binary may have generated, a stale cache entry is not an error
+    gl.glGetError();
+    if(!linked)
+    {
+        // E.g. the driver has been updated without changing the version string
+        forgetBinary(key);
+        ++misses;
+        return false;
+    }
+    // With no shaders added, this only makes QOpenGLShaderProgram check the link status
+    return program.link();
+}
+
+void prepareProgramForCaching(QOpenGLShaderProgram& program)
+{
+    if(!glExtra) return;
+    program.create();
+    glExtra->glProgramParameteri(program.programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void saveProgramToCache(QOpenGLShaderProgram& program, QByteArray const& key)
+{
+    if(!glExtra) return;
+
+    GLint length=0;
+    gl.glGetProgramiv(program.programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length<=0) return;
+    ProgramBinary binary{0, QByteArray(length, Qt::Uninitialized)};
+    GLsizei lengthReturned=0;
+    glExtra->glGetProgramBinary(program.programId(), length, &lengthReturned, &binary.format, binary.data.data());
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR || lengthReturned<=0)
+    {
+        std::cerr << "Warning: failed to get program binary: " << openglErrorString(err) << "\n";
+        return;
+    }
+    binary.data.truncate(lengthReturned);
+
+    if(!opts.programCacheDir.empty())
+    {
+        // Worker processes of --jobs share the cache directory, so the file must appear atomically
+        QSaveFile file(diskCachePath(key));
+        const uint32_t format=binary.format;
+        if(file.open(QFile::WriteOnly))
+        {
+            file.write(reinterpret_cast<const char*>(&format), sizeof format);
+            file.write(binary.data);
+            file.commit();
+        }
+    }
+    memoryCache.emplace(key, std::move(binary));
+}
+
+void printProgramCacheStats()
+{
+    if(!glExtra) return;
+    std::cerr << "Shader program cache: " << memoryHits << " hits in memory, " << diskHits << " hits on disk, "
+              << misses << " misses\n";
+}
@@ -0,0 +1,35 @@
+#ifndef INCLUDE_ONCE_D7B04E29_3A5C_4F61_8E1D_62C9A0F4B7E3
+#define INCLUDE_ONCE_D7B04E29_3A5C_4F61_8E1D_62C9A0F4B7E3
+
+#include <vector>
+#include <QString>
+#include <QByteArray>
+#include <QOpenGLShader>
+#include <QOpenGLContext>
+
+/* Binaries of the linked programs are kept in memory and in opts.programCacheDir, keyed by a hash
+ * of the preprocessed sources of all the shaders of the program along with the OpenGL vendor,
+ * renderer and version strings. This lets the identical programs be recreated without compiling
+ * and linking them again, both within one run and across runs.
+ *
+ * If the driver can't provide program binaries, the functions below do nothing, and loading
+ * from the cache always fails.
+ */
+
+struct ShaderSource
+{
+    QOpenGLShader::ShaderType type;
+    QString name;
+    QString source; // after preprocessing
+};
+
+void initProgramCache(QOpenGLContext& context);
+QByteArray programCacheKey(std::vector<ShaderSource> const& sources);
+// Returns true if the program has been created and linked from a cached binary
+bool loadProgramFromCache(QOpenGLShaderProgram& program, QByteArray const& key);
+// Must be called before the program is linked, so that its binary can be retrieved after linking
+void prepareProgramForCaching(QOpenGLShaderProgram& program);
+void saveProgramToCache(QOpenGLShaderProgram& program, QByteArray const& key);
+void printProgramCacheStats();
+
+#endif
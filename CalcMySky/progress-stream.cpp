@@ -0,0 +1,133 @@
+#include "progress-stream.hpp"
+
+#include <memory>
+#include <iostream>
+#include <exception>
+#include <QFile>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+#include "data.hpp"
+
+namespace
+{
+
+const auto programStart=std::chrono::steady_clock::now();
+unsigned currentDepth=0;
+
+double secondsSince(const std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+}
+
+// Opened on the first event. Null if the stream wasn't requested or isn't for this process.
+QFile* stream()
+{
+    static const std::unique_ptr<QFile> file=[]() -> std::unique_ptr<QFile>
+    {
+        const auto& dest=opts.progressJSONDest;
+        if(dest.empty()) return nullptr;
+
+        bool isFD=false;
+        const int fd=QString::fromStdString(dest).toInt(&isFD);
+        const bool isWorker=!opts.wavelengthSetsToCompute.empty();
+        auto file=std::make_unique<QFile>();
+        if(isFD)
+        {
+            // The workers of --jobs don't get the descriptor, the main process reports on them as a whole
+            if(isWorker) return nullptr;
+            if(!file->open(fd, QFile::WriteOnly|QFile::Unbuffered))
+            {
+                std::cerr << "Failed to open file descriptor " << fd << " for progress stream: " << file->errorString() << "\n";
+                throw MustQuit{};
+            }
+            return file;
+        }
+
+        auto path=dest;
+        if(isWorker)
+            path += ".worker-wlset"+std::to_string(opts.wavelengthSetsToCompute.front());
+        file->setFileName(QString::fromStdString(path));
+        if(!file->open(QFile::WriteOnly|QFile::Truncate|QFile::Unbuffered))
+        {
+            std::cerr << "Failed to open progress stream file \"" << path << "\": " << file->errorString() << "\n";
+            throw MustQuit{};
+        }
+        return file;
+    }();
+    return file.get();
+}
+
+void emitEvent(QJsonObject event)
+{
+    event["time"]=secondsSince(programStart);
+    // A failure to report progress is not a reason to stop the computation, the consumer will notice the silence
+    stream()->write(QJsonDocument(event).toJson(QJsonDocument::Compact)+'\n');
+}
+
+}
+
+ReportedProgress::ReportedProgress(std::string stage, const unsigned long long totalUnits, std::string unit,
+                                   const unsigned long long unitsDoneBefore)
+    : stage(std::move(stage))
+    , unit(std::move(unit))
+    , totalUnits(totalUnits)
+    , unitsDoneBefore(unitsDoneBefore)
+    , unitsDone(unitsDoneBefore)
+    , depth(currentDepth)
+    , begin(std::chrono::steady_clock::now())
+    , uncaughtExceptionsAtBegin(std::uncaught_exceptions())
+    , active(stream()!=nullptr)
+{
+    if(!active) return;
+
+    ++currentDepth;
+    QJsonObject event;
+    event["event"]="begin";
+    event["stage"]=QString::fromStdString(this->stage);
+    event["depth"]=int(depth);
+    if(totalUnits)
+    {
+        event["unit"]=QString::fromStdString(this->unit);
+        event["total"]=double(totalUnits);
+        event["done"]=double(unitsDoneBefore);
+    }
+    emitEvent(event);
+}
+
+void ReportedProgress::update(const unsigned long long unitsDone)
+{
+    if(!active) return;
+
+    this->unitsDone=unitsDone;
+    const auto elapsed=secondsSince(begin);
+    QJsonObject event;
+    event["event"]="progress";
+    event["stage"]=QString::fromStdString(stage);
+    event["depth"]=int(depth);
+    event["done"]=double(unitsDone);
+    event["total"]=double(totalUnits);
+    event["elapsed"]=elapsed;
+    if(unitsDone>unitsDoneBefore && unitsDone<=totalUnits)
+        event["eta"]=elapsed/(unitsDone-unitsDoneBefore)*(totalUnits-unitsDone);
+    emitEvent(event);
+}
+
+ReportedProgress::~ReportedProgress()
+{
+    if(!active) return;
+
+    --currentDepth;
+    QJsonObject event;
+    event["event"]="end";
+    event["stage"]=QString::fromStdString(stage);
+    event["depth"]=int(depth);
+    event["status"] = std::uncaught_exceptions()>uncaughtExceptionsAtBegin ? "aborted" : "done";
+    if(totalUnits)
+    {
+        event["done"]=double(unitsDone);
+        event["total"]=double(totalUnits);
+    }
+    event["elapsed"]=secondsSince(begin);
+    emitEvent(event);
+}
@@ -0,0 +1,43 @@
+#ifndef INCLUDE_ONCE_3C9E71A5_0D42_4B8F_A6E3_92F15D7C4B20
+#define INCLUDE_ONCE_3C9E71A5_0D42_4B8F_A6E3_92F15D7C4B20
+
+#include <chrono>
+#include <string>
+
+/* Machine-readable progress, see --progress-json.
+ *
+ * Each event is a JSON object on its own line, flushed immediately:
+ *   {"event":"begin","stage":...,"depth":...,"unit":...,"done":...,"total":...,"time":...}
+ *   {"event":"progress","stage":...,"depth":...,"done":...,"total":...,"elapsed":...,"eta":...,"time":...}
+ *   {"event":"end","stage":...,"depth":...,"status":"done"|"aborted","done":...,"total":...,"elapsed":...,"time":...}
+ * Times are in seconds, "time" being counted from the program start. Stages nest, "depth" tells
+ * how deep. The ETA is extrapolated from the mean cost of the units done so far in this run, and
+ * is absent until the first unit is done.
+ *
+ * Nothing is written unless the stream was requested.
+ */
+
+class ReportedProgress
+{
+    std::string stage;
+    std::string unit;
+    unsigned long long totalUnits;
+    unsigned long long unitsDoneBefore;
+    unsigned long long unitsDone;
+    unsigned depth;
+    std::chrono::steady_clock::time_point begin;
+    int uncaughtExceptionsAtBegin;
+    bool active;
+public:
+    // A totalUnits of zero means the stage only reports its beginning and end.
+    // unitsDoneBefore is for stages that continue work done elsewhere, e.g. in a previous chunk.
+    ReportedProgress(std::string stage, unsigned long long totalUnits=0, std::string unit={},
+                     unsigned long long unitsDoneBefore=0);
+    ~ReportedProgress();
+    ReportedProgress(ReportedProgress const&) = delete;
+    ReportedProgress& operator=(ReportedProgress const&) = delete;
+
+    void update(unsigned long long unitsDone);
+};
+
+#endif
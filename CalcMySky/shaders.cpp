@@ -10,6 +10,8 @@
 
 #include "data.hpp"
 #include "util.hpp"
+#include "program-cache.hpp"
+#include "profiling.hpp"
 
 #include "config.h"
 
@@ -198,6 +200,16 @@ vec4 totalScatteringCoefficient(float altitude, float dotViewInc)
     return src;
 }
 
+QString shadersDirPath()
+{
+    const auto appBinDir=QDir(qApp->applicationDirPath()+"/").canonicalPath();
+    if(appBinDir==QDir(INSTALL_BINDIR).canonicalPath())
+        return DATA_ROOT_DIR "shaders/";
+    if(appBinDir==QDir(BUILD_BINDIR "CalcMySky/").canonicalPath())
+        return SOURCE_DIR "shaders/";
+    return appBinDir + "/shaders/";
+}
+
 QString getShaderSrc(QString const& fileName, IgnoreCache ignoreCache)
 {
     if(!ignoreCache)
@@ -208,16 +220,7 @@ QString getShaderSrc(QString const& fileName, IgnoreCache ignoreCache)
             return it->second;
     }
 
-    const auto appBinDir=QDir(qApp->applicationDirPath()+"/").canonicalPath();
-    QString filePath=appBinDir + "/shaders/" + fileName;
-    if(appBinDir==QDir(INSTALL_BINDIR).canonicalPath())
-    {
-        filePath=DATA_ROOT_DIR "shaders/" + fileName;
-    }
-    else if(appBinDir==QDir(BUILD_BINDIR "CalcMySky/").canonicalPath())
-    {
-        filePath=SOURCE_DIR "shaders/" + fileName;
-    }
+    const QString filePath=shadersDirPath() + fileName;
     QFile file(filePath);
     if(!file.open(QIODevice::ReadOnly))
     {
@@ -247,14 +250,15 @@ void defineDisabledDefinitions(QString& source)
     }
 }
 
-std::unique_ptr<QOpenGLShader> compileShader(QOpenGLShader::ShaderType type, QString source, QString const& description,
-                                             QString* processedSource = nullptr)
+QString preprocessShaderSource(QString source, QString const& description)
 {
-    auto shader=std::make_unique<QOpenGLShader>(type);
     defineDisabledDefinitions(source);
-    source=withHeadersIncluded(source, description);
-    if(processedSource)
-        *processedSource = source;
+    return withHeadersIncluded(source, description);
+}
+
+std::unique_ptr<QOpenGLShader> compileShader(QOpenGLShader::ShaderType type, QString const& source, QString const& description)
+{
+    auto shader=std::make_unique<QOpenGLShader>(type);
     if(!shader->compileSourceCode(source))
     {
         std::cerr << "Failed to compile " << description.toStdString() << ":\n"
@@ -284,9 +288,6 @@ std::unique_ptr<QOpenGLShader> compileShader(QOpenGLShader::ShaderType type, QSt
     return shader;
 }
 
-std::unique_ptr<QOpenGLShader> compileShader(QOpenGLShader::ShaderType type, QString const& filename, QString* processedSource = nullptr)
-{ return compileShader(type, getShaderSrc(filename), filename, processedSource); }
-
 QString withHeadersIncluded(QString src, QString const& filename)
 {
     QTextStream srcStream(&src);
@@ -354,6 +355,8 @@ std::set<QString> getShaderFileNamesToLinkWith(QString const& filename, int recu
             continue;
         if(headerFileName == RADIANCE_TO_LUMINANCE_HEADER_FILENAME) // no companion source for radiance-to-luminance conversion header
             continue;
+        if(headerFileName == WAVELENGTH_SET_BATCH_HEADER_FILENAME) // no companion source for wavelength set batch header
+            continue;
         const auto shaderFileNameToLinkWith=includeFileBaseName+".frag";
         filenames.insert(shaderFileNameToLinkWith);
         if(shaderFileNameToLinkWith!=filename)
@@ -369,27 +372,35 @@ std::unique_ptr<QOpenGLShaderProgram> compileShaderProgram(QString const& mainSr
                                                            const char* description, const UseGeomShader useGeomShader,
                                                            std::vector<std::pair<QString, QString>>* sourcesToSave)
 {
+    const auto buildBegin=std::chrono::steady_clock::now();
     auto program=std::make_unique<QOpenGLShaderProgram>();
 
     auto shaderFileNames=getShaderFileNamesToLinkWith(mainSrcFileName);
     shaderFileNames.insert(mainSrcFileName);
 
-    std::vector<std::unique_ptr<QOpenGLShader>> shaders;
+    std::vector<ShaderSource> sources;
     for(const auto& filename : shaderFileNames)
     {
-        QString processedSource;
-        shaders.emplace_back(compileShader(QOpenGLShader::Fragment, filename, &processedSource));
-        program->addShader(shaders.back().get());
+        sources.push_back({QOpenGLShader::Fragment, filename, preprocessShaderSource(getShaderSrc(filename), filename)});
         if(sourcesToSave)
-            sourcesToSave->push_back({filename, processedSource});
+            sourcesToSave->push_back({filename, sources.back().source});
     }
+    sources.push_back({QOpenGLShader::Vertex, "shader.vert", preprocessShaderSource(getShaderSrc("shader.vert"), "shader.vert")});
+    if(useGeomShader)
+        sources.push_back({QOpenGLShader::Geometry, "shader.geom", preprocessShaderSource(getShaderSrc("shader.geom"), "shader.geom")});
 
-    shaders.emplace_back(compileShader(QOpenGLShader::Vertex, "shader.vert"));
-    program->addShader(shaders.back().get());
+    const auto cacheKey=programCacheKey(sources);
+    if(loadProgramFromCache(*program, cacheKey))
+    {
+        recordShaderProgramBuild(description, buildBegin, true);
+        return program;
+    }
 
-    if(useGeomShader)
+    prepareProgramForCaching(*program);
+    std::vector<std::unique_ptr<QOpenGLShader>> shaders;
+    for(const auto& src : sources)
     {
-        shaders.emplace_back(compileShader(QOpenGLShader::Geometry, "shader.geom"));
+        shaders.emplace_back(compileShader(src.type, src.source, src.name));
         program->addShader(shaders.back().get());
     }
 
@@ -399,6 +410,8 @@ std::unique_ptr<QOpenGLShaderProgram> compileShaderProgram(QString const& mainSr
         std::cerr << "Failed to link " << description << "\n";
         throw MustQuit{};
     }
+    saveProgramToCache(*program, cacheKey);
+    recordShaderProgramBuild(description, buildBegin, false);
     return program;
 }
 
@@ -6,6 +6,8 @@
 #include <glm/glm.hpp>
 #include "../common/util.hpp"
 
+// The directory the shader files are read from, with a trailing slash
+QString shadersDirPath();
 DEFINE_EXPLICIT_BOOL(IgnoreCache);
 QString getShaderSrc(QString const& fileName, IgnoreCache ignoreCache=IgnoreCache{false});
 DEFINE_EXPLICIT_BOOL(UseGeomShader);
@@ -0,0 +1,235 @@
+#include "stage-cache.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <initializer_list>
+#include <QDir>
+#include <QFile>
+#include <QRegularExpression>
+#include <QCryptographicHash>
+
+#include "data.hpp"
+#include "util.hpp"
+#include "shaders.hpp"
+#include "texture-saving.hpp"
+#include "config.h"
+
+namespace
+{
+
+QString cacheDirPath()
+{
+    if(!opts.stageCacheDir.empty())
+        return QString::fromStdString(opts.stageCacheDir);
+    return QString::fromStdString(atmo.textureOutputDir)+"/stage-cache";
+}
+
+QString resultPath(StageKey const& key)
+{
+    return QString("%1/%2-%3.f32").arg(cacheDirPath(), QString::fromStdString(key.stage), QString(key.hash.toHex()));
+}
+
+// A change in the program or in any shader file may change any result
+QByteArray const& codeHash()
+{
+    static const QByteArray result=[]
+    {
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        hash.addData(QByteArray(PROJECT_VERSION)+'\n');
+        for(const auto& name : QDir(shadersDirPath()).entryList(QDir::Files, QDir::Name))
+        {
+            hash.addData(name.toUtf8()+'\n');
+            hash.addData(getShaderSrc(name, IgnoreCache{true}).toUtf8());
+            hash.addData(QByteArray(1, '\0'));
+        }
+        return hash.result();
+    }();
+    return result;
+}
+
+// The const header without the constants the stage doesn't depend on. Any constant added to the header
+// in the future will thus be taken into account by default.
+QString constHeaderWithout(std::initializer_list<const char*> const constantNames)
+{
+    auto header=virtualHeaderFiles.at(CONSTANTS_HEADER_FILENAME);
+    for(const auto name : constantNames)
+        header.remove(QRegularExpression(QString("^const [a-z0-9]+ %1=[^\n]*\n").arg(name),
+                                         QRegularExpression::MultilineOption));
+    return header;
+}
+
+class KeyBuilder
+{
+    QCryptographicHash hash{QCryptographicHash::Sha256};
+public:
+    KeyBuilder() { hash.addData(codeHash()); }
+    KeyBuilder& operator<<(QByteArray const& data)
+    {
+        hash.addData(data);
+        hash.addData(QByteArray(1, '\0'));
+        return *this;
+    }
+    KeyBuilder& operator<<(QString const& str) { return *this << str.toUtf8(); }
+    KeyBuilder& operator<<(StageKey const& key) { return *this << key.hash; }
+    StageKey result(std::string const& stage) const { return {stage, hash.result()}; }
+};
+
+std::vector<GLint> textureSizes(const GLenum target, const GLuint texture)
+{
+    gl.glActiveTexture(GL_TEXTURE0);
+    gl.glBindTexture(target, texture);
+    GLint w=1, h=1, d=1;
+    gl.glGetTexLevelParameteriv(target,0,GL_TEXTURE_WIDTH,&w);
+    gl.glGetTexLevelParameteriv(target,0,GL_TEXTURE_HEIGHT,&h);
+    if(target==GL_TEXTURE_3D)
+        gl.glGetTexLevelParameteriv(target,0,GL_TEXTURE_DEPTH,&d);
+    gl.glBindTexture(target, 0);
+    if(target==GL_TEXTURE_3D)
+        return {w,h,d};
+    return {w,h};
+}
+
+size_t subpixelCount(std::vector<GLint> const& sizes)
+{
+    size_t count=4;
+    for(const auto s : sizes)
+        count *= s;
+    return count;
+}
+
+}
+
+StageKey transmittanceStageKey(const unsigned texIndex)
+{
+    KeyBuilder key;
+    key << constHeaderWithout({"groundAlbedo", "solarIrradianceAtTOA", "lightPollutionRelativeRadiance"})
+        << makeTransmittanceComputeFunctionsSrc(atmo.allWavelengths[texIndex]);
+    return key.result("transmittance-wlset"+std::to_string(texIndex));
+}
+
+StageKey directIrradianceStageKey(const unsigned texIndex)
+{
+    KeyBuilder key;
+    key << transmittanceStageKey(texIndex)
+        << constHeaderWithout({"groundAlbedo", "lightPollutionRelativeRadiance"});
+    return key.result("direct-irradiance-wlset"+std::to_string(texIndex));
+}
+
+StageKey singleScatteringStageKey(const unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer)
+{
+    // The phase function code is available to the shader as currentPhaseFunction(), and its type
+    // decides how the result is used, so both go into the key
+    KeyBuilder key;
+    key << transmittanceStageKey(texIndex)
+        << constHeaderWithout({"groundAlbedo", "lightPollutionRelativeRadiance"})
+        << makeScattererDensityFunctionsSrc()
+        << scatterer.name
+        << toString(scatterer.scatteringCrossSection(atmo.allWavelengths[texIndex]))
+        << scatterer.phaseFunction
+        << QByteArray::number(static_cast<int>(scatterer.phaseFunctionType));
+    return key.result("single-scattering-wlset"+std::to_string(texIndex)+"-"+scatterer.name.toStdString());
+}
+
+StageKey lightPollutionStageKey(const unsigned texIndex)
+{
+    KeyBuilder key;
+    key << transmittanceStageKey(texIndex)
+        << constHeaderWithout({})
+        << makeScattererDensityFunctionsSrc()
+        << makePhaseFunctionsSrc()
+        << makeTotalScatteringCoefSrc()
+        << QByteArray::number(atmo.scatteringOrdersToCompute);
+    return key.result("light-pollution-wlset"+std::to_string(texIndex));
+}
+
+bool loadStageResult(const GLenum target, const GLuint texture, StageKey const& key)
+{
+    if(!opts.reuseStages || opts.dbgNoSaveTextures) return false;
+
+    QFile file(resultPath(key));
+    if(!file.open(QFile::ReadOnly))
+        return false;
+
+    std::cerr << indentOutput() << "Reusing " << key.stage << " from \"" << file.fileName() << "\"... ";
+    const auto sizes=textureSizes(target, texture);
+    const auto expectedSize=qint64(sizes.size()*sizeof(uint16_t) + subpixelCount(sizes)*sizeof(GLfloat));
+    const auto data=file.readAll();
+    if(file.error() || data.size()!=expectedSize)
+    {
+        std::cerr << "unexpected file size, will recompute\n";
+        return false;
+    }
+    for(unsigned i=0; i<sizes.size(); ++i)
+    {
+        uint16_t size;
+        std::memcpy(&size, data.constData()+i*sizeof size, sizeof size);
+        if(size!=sizes[i])
+        {
+            std::cerr << "texture size mismatch, will recompute\n";
+            return false;
+        }
+    }
+
+    const auto pixels=data.constData()+sizes.size()*sizeof(uint16_t);
+    gl.glBindTexture(target, texture);
+    if(target==GL_TEXTURE_3D)
+        gl.glTexSubImage3D(target,0,0,0,0,sizes[0],sizes[1],sizes[2],GL_RGBA,GL_FLOAT,pixels);
+    else
+        gl.glTexSubImage2D(target,0,0,0,sizes[0],sizes[1],GL_RGBA,GL_FLOAT,pixels);
+    gl.glBindTexture(target, 0);
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error in loadStageResult(): " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+    return true;
+}
+
+void saveStageResult(const GLenum target, const GLuint texture, StageKey const& key)
+{
+    if(!opts.reuseStages || opts.dbgNoSaveTextures) return;
+
+    createDirs(cacheDirPath().toStdString());
+    // Results with other keys won't be needed unless the inputs are reverted, and they may be large
+    const QDir dir(cacheDirPath());
+    const QRegularExpression otherKeyPattern("^"+QRegularExpression::escape(QString::fromStdString(key.stage))+
+                                             "-[0-9a-f]{64}\\.f32$");
+    for(const auto& name : dir.entryList(QDir::Files))
+        if(otherKeyPattern.match(name).hasMatch())
+            QFile::remove(dir.filePath(name));
+
+    const auto sizes=textureSizes(target, texture);
+    TextureSaveJob job{key.stage, resultPath(key).toStdString(), std::vector<int>(sizes.begin(), sizes.end())};
+    job.subpixelCount=subpixelCount(sizes);
+    // Otherwise an interrupted run could leave a truncated result with a valid name
+    job.writeAtomically=true;
+
+    std::cerr << indentOutput() << "Saving " << key.stage << " to the stage cache... ";
+    gl.glActiveTexture(GL_TEXTURE0);
+    gl.glBindTexture(target, texture);
+    if(opts.saveQueueDepth)
+    {
+        readBackTextureAsync(target, std::move(job));
+        gl.glBindTexture(target, 0);
+        std::cerr << "queued\n";
+        return;
+    }
+
+    job.subpixels.reset(new GLfloat[job.subpixelCount]);
+    gl.glGetTexImage(target, 0, GL_RGBA, GL_FLOAT, job.subpixels.get());
+    gl.glBindTexture(target, 0);
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error in saveStageResult() after glGetTexImage() call: " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+    if(const auto error=finishTextureSave(job); !error.empty())
+    {
+        std::cerr << error << "\n";
+        throw MustQuit{};
+    }
+    std::cerr << "done\n";
+}
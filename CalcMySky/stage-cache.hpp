@@ -0,0 +1,39 @@
+#ifndef INCLUDE_ONCE_6E2B0F47_A913_4C58_8D7E_31F5C2B9A064
+#define INCLUDE_ONCE_6E2B0F47_A913_4C58_8D7E_31F5C2B9A064
+
+#include <string>
+#include <QByteArray>
+#include <QOpenGLFunctions_3_3_Core>
+#include "../common/AtmosphereParameters.hpp"
+
+/* Incremental recomputation, see --reuse-stages.
+ *
+ * The results of the stages that depend on a part of the atmosphere description are kept in
+ * textureOutputDir/stage-cache, tagged with a hash of everything that goes into the stage: the
+ * generated GLSL code and constants it uses, the keys of the stages whose results it takes, and the
+ * shader files and program version. A subsequent run reuses the result if the hash matches, e.g.
+ * changing the ground albedo leaves transmittance, direct irradiance and single scattering intact.
+ *
+ * Multiple scattering and eclipsed double scattering depend on virtually everything in the
+ * description, so they are always recomputed.
+ *
+ * The keys use the current const header, so initConstHeader() must be called before computing them.
+ */
+
+struct StageKey
+{
+    std::string stage; // e.g. "transmittance-wlset0"
+    QByteArray hash;
+};
+
+StageKey transmittanceStageKey(unsigned texIndex);
+StageKey directIrradianceStageKey(unsigned texIndex);
+StageKey singleScatteringStageKey(unsigned texIndex, AtmosphereParameters::Scatterer const& scatterer);
+StageKey lightPollutionStageKey(unsigned texIndex);
+
+// Uploads the cached result of the stage into the texture. Returns false if there's no result with this key.
+bool loadStageResult(GLenum target, GLuint texture, StageKey const& key);
+// Stores the contents of the texture as the result of the stage, replacing results with older keys
+void saveStageResult(GLenum target, GLuint texture, StageKey const& key);
+
+#endif
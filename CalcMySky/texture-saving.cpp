@@ -0,0 +1,288 @@
+#include "texture-saving.hpp"
+
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+#include <QFile>
+#include <QSaveFile>
+
+#include "data.hpp"
+#include "util.hpp"
+#include "profiling.hpp"
+
+namespace
+{
+
+class WriterPool
+{
+    std::mutex mutex;
+    std::condition_variable jobAdded, jobDone;
+    std::deque<TextureSaveJob> jobs;
+    std::vector<std::thread> threads;
+    std::vector<std::string> errors;
+    std::vector<std::string> pathsInProgress;
+    bool quitting=false;
+
+    void run()
+    {
+        std::unique_lock lock(mutex);
+        for(;;)
+        {
+            jobAdded.wait(lock, [this]{ return quitting || !jobs.empty(); });
+            // The saves still queued on quitting are abandoned: normal completion waits for them
+            // in waitForTextureSaves(), so here we're quitting due to an error anyway.
+            if(quitting) return;
+            auto job=std::move(jobs.front());
+            jobs.pop_front();
+            pathsInProgress.push_back(job.path);
+            lock.unlock();
+
+            const auto error=finishTextureSave(job);
+            job.subpixels.reset(); // release the memory before the job is counted as done
+
+            lock.lock();
+            if(!error.empty())
+                errors.push_back("Failed to save "+job.name+" to \""+job.path+"\": "+error);
+            pathsInProgress.erase(std::find(pathsInProgress.begin(), pathsInProgress.end(), job.path));
+            jobDone.notify_all();
+        }
+    }
+
+public:
+    ~WriterPool()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard lock(mutex);
+            quitting=true;
+        }
+        jobAdded.notify_all();
+        for(auto& thread : threads)
+            thread.join();
+        threads.clear();
+    }
+
+    void add(TextureSaveJob job)
+    {
+        {
+            std::lock_guard lock(mutex);
+            if(threads.empty())
+            {
+                // There's no use in having more writers than the jobs that can be queued
+                const auto threadCount=std::clamp(std::thread::hardware_concurrency(), 1u, opts.saveQueueDepth);
+                for(unsigned n=0; n<threadCount; ++n)
+                    threads.emplace_back([this]{ run(); });
+            }
+            jobs.push_back(std::move(job));
+        }
+        jobAdded.notify_one();
+    }
+
+    unsigned pendingCount()
+    {
+        std::lock_guard lock(mutex);
+        return jobs.size()+pathsInProgress.size();
+    }
+
+    void waitForOneJob()
+    {
+        std::unique_lock lock(mutex);
+        const auto countBefore=jobs.size()+pathsInProgress.size();
+        jobDone.wait(lock, [&]{ return jobs.size()+pathsInProgress.size() < countBefore || countBefore==0; });
+    }
+
+    void waitForAllJobs()
+    {
+        std::unique_lock lock(mutex);
+        jobDone.wait(lock, [this]{ return jobs.empty() && pathsInProgress.empty(); });
+    }
+
+    std::vector<std::string> takeErrors()
+    {
+        std::lock_guard lock(mutex);
+        std::vector<std::string> result;
+        result.swap(errors);
+        return result;
+    }
+} writerPool;
+
+struct PendingReadback
+{
+    GLuint pbo;
+    GLsync fence;
+    TextureSaveJob job;
+};
+std::deque<PendingReadback> pendingReadbacks;
+
+void reportWriterErrors()
+{
+    const auto errors=writerPool.takeErrors();
+    if(errors.empty()) return;
+    std::cerr << "\n";
+    for(const auto& error : errors)
+        std::cerr << error << "\n";
+    throw MustQuit{};
+}
+
+void completeOldestReadback(const bool waitForGPU)
+{
+    auto& readback=pendingReadbacks.front();
+    for(;;)
+    {
+        constexpr GLuint64 timeout=100'000'000; // ns
+        const auto result=gl.glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, waitForGPU ? timeout : 0);
+        if(result==GL_ALREADY_SIGNALED || result==GL_CONDITION_SATISFIED)
+            break;
+        if(result==GL_WAIT_FAILED)
+        {
+            std::cerr << "glClientWaitSync() FAILED while reading back " << readback.job.name << ": "
+                      << openglErrorString(gl.glGetError()) << "\n";
+            throw MustQuit{};
+        }
+        if(!waitForGPU)
+            return;
+    }
+    gl.glDeleteSync(readback.fence);
+
+    auto job=std::move(readback.job);
+    const auto pbo=readback.pbo;
+    pendingReadbacks.pop_front();
+
+    const auto byteCount=job.subpixelCount*sizeof job.subpixels[0];
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    const auto data=gl.glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, byteCount, GL_MAP_READ_BIT);
+    if(!data)
+    {
+        std::cerr << "Failed to map pixel buffer with " << job.name << ": " << openglErrorString(gl.glGetError()) << "\n";
+        throw MustQuit{};
+    }
+    job.subpixels.reset(new GLfloat[job.subpixelCount]);
+    std::memcpy(job.subpixels.get(), data, byteCount);
+    gl.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    gl.glDeleteBuffers(1, &pbo);
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error while reading back " << job.name << ": " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+
+    writerPool.add(std::move(job));
+}
+
+void makeRoomForSave()
+{
+    reportWriterErrors();
+
+    // Pass the textures that are already read back to the writers as early as possible
+    while(!pendingReadbacks.empty())
+    {
+        const auto countBefore=pendingReadbacks.size();
+        completeOldestReadback(false);
+        if(pendingReadbacks.size()==countBefore)
+            break;
+    }
+
+    while(pendingReadbacks.size()+writerPool.pendingCount() >= opts.saveQueueDepth)
+    {
+        if(writerPool.pendingCount())
+            writerPool.waitForOneJob();
+        else
+            completeOldestReadback(true);
+    }
+
+    reportWriterErrors();
+}
+
+}
+
+std::string finishTextureSave(TextureSaveJob& job)
+{
+    for(size_t i = 0; i < job.subpixelCount; ++i)
+    {
+        if(std::isnan(job.subpixels[i]))
+            return "NaN entries detected";
+    }
+    if(job.reducePrecision)
+        roundTexData(job.subpixels.get(), job.subpixelCount, opts.textureSavePrecision);
+
+    const auto writeBegin=std::chrono::steady_clock::now();
+    QFile plainOut(QString::fromStdString(job.path));
+    QSaveFile atomicOut(QString::fromStdString(job.path));
+    QFileDevice& out = job.writeAtomically ? static_cast<QFileDevice&>(atomicOut) : plainOut;
+    if(!out.open(QFile::WriteOnly))
+        return "failed to open file: "+out.errorString().toStdString();
+    for(const uint16_t s : job.sizes)
+        out.write(reinterpret_cast<const char*>(&s), sizeof s);
+    out.write(reinterpret_cast<const char*>(job.subpixels.get()), job.subpixelCount*sizeof job.subpixels[0]);
+    bool written;
+    if(job.writeAtomically)
+    {
+        written=atomicOut.commit();
+    }
+    else
+    {
+        plainOut.close();
+        written=!plainOut.error();
+    }
+    if(!written)
+        return "failed to write file: "+out.errorString().toStdString();
+    recordFileWrite(job.path, job.sizes.size()*sizeof(uint16_t)+job.subpixelCount*sizeof job.subpixels[0], writeBegin);
+    return {};
+}
+
+void readBackTextureAsync(const GLenum target, TextureSaveJob job)
+{
+    makeRoomForSave();
+
+    GLuint pbo=0;
+    gl.glGenBuffers(1, &pbo);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    gl.glBufferData(GL_PIXEL_PACK_BUFFER, job.subpixelCount*sizeof(GLfloat), nullptr, GL_STREAM_READ);
+    // With a pack buffer bound, this only schedules the copy, the data are fetched when the fence signals
+    gl.glGetTexImage(target, 0, GL_RGBA, GL_FLOAT, nullptr);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    const auto fence=gl.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        std::cerr << "GL error while scheduling readback of " << job.name << ": " << openglErrorString(err) << "\n";
+        throw MustQuit{};
+    }
+    pendingReadbacks.push_back({pbo, fence, std::move(job)});
+}
+
+void finishTextureSaveAsync(TextureSaveJob job)
+{
+    makeRoomForSave();
+    writerPool.add(std::move(job));
+}
+
+void stopTextureWriters()
+{
+    writerPool.stop();
+}
+
+void waitForTextureSaves()
+{
+    if(pendingReadbacks.empty() && !writerPool.pendingCount())
+    {
+        reportWriterErrors();
+        return;
+    }
+
+    std::cerr << indentOutput() << "Waiting for textures to be saved... ";
+    while(!pendingReadbacks.empty())
+        completeOldestReadback(true);
+    writerPool.waitForAllJobs();
+    reportWriterErrors();
+    std::cerr << "done\n";
+}
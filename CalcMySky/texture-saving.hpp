@@ -0,0 +1,48 @@
+#ifndef INCLUDE_ONCE_8F3A2C61_5D0B_47E9_B2C4_1E6A9D7F0B58
+#define INCLUDE_ONCE_8F3A2C61_5D0B_47E9_B2C4_1E6A9D7F0B58
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <QOpenGLFunctions_3_3_Core>
+
+// What remains to be done to save a texture after its data have been read back from the GPU
+struct TextureSaveJob
+{
+    std::string name;
+    std::string path;
+    std::vector<int> sizes;
+    std::unique_ptr<GLfloat[]> subpixels;
+    size_t subpixelCount=0;
+    bool reducePrecision=false;
+    // Make the file appear only when it's complete, so that an interrupted run can't leave a truncated one
+    bool writeAtomically=false;
+};
+
+// Checks the data for NaNs, reduces precision if requested, and writes the file.
+// Returns an error message on failure, an empty string on success.
+std::string finishTextureSave(TextureSaveJob& job);
+
+/* With nonzero opts.saveQueueDepth the textures are read back via pixel buffer objects, and the
+ * saves are finished by writer threads, so that the GPU can go on to the next stage meanwhile.
+ * At most opts.saveQueueDepth saves are pending at any time, which bounds the memory they take.
+ * Failures of pending saves are reported, and the program quits, on the next call of any of the
+ * functions below.
+ */
+// Schedules reading back of the texture bound to the target. The job must not have the data yet.
+void readBackTextureAsync(GLenum target, TextureSaveJob job);
+// Hands the job with the data already read back to a writer thread
+void finishTextureSaveAsync(TextureSaveJob job);
+// Waits until all the pending textures are written to disk
+void waitForTextureSaves();
+// Abandons the saves still queued and joins the writer threads. No saves may be scheduled after this.
+void stopTextureWriters();
+
+// Stops the writers on destruction. Created in main(), it makes them stop before the statics they use,
+// e.g. in profiling.cpp, are destroyed, even if main() exits due to an error with saves still queued.
+struct TextureWritersGuard
+{
+    ~TextureWritersGuard() { stopTextureWriters(); }
+};
+
+#endif
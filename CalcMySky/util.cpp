@@ -7,6 +7,8 @@
 #include <QFile>
 
 #include "data.hpp"
+#include "profiling.hpp"
+#include "texture-saving.hpp"
 
 void createDirs(std::string const& path)
 {
@@ -30,6 +32,17 @@ void renderQuad()
     OPENGL_DEBUG_CHECK_ERROR("glBindVertexArray(0) FAILED inside renderQuad()");
 }
 
+void renderQuadInstances(const GLsizei instanceCount)
+{
+    OPENGL_DEBUG_CHECK_ERROR("FAILED on entry to renderQuadInstances()");
+    gl.glBindVertexArray(vao);
+    OPENGL_DEBUG_CHECK_ERROR("glBindVertexArray(vao) FAILED inside renderQuadInstances()");
+    gl.glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instanceCount);
+    OPENGL_DEBUG_CHECK_ERROR("glDrawArraysInstanced() FAILED inside renderQuadInstances()");
+    gl.glBindVertexArray(0);
+    OPENGL_DEBUG_CHECK_ERROR("glBindVertexArray(0) FAILED inside renderQuadInstances()");
+}
+
 void qtMessageHandler(const QtMsgType type, QMessageLogContext const&, QString const& message)
 {
     switch(type)
@@ -58,7 +71,7 @@ void qtMessageHandler(const QtMsgType type, QMessageLogContext const&, QString c
 
 std::vector<glm::vec4> saveTexture(const GLenum target, const GLuint texture, const std::string_view name,
                                    const std::string_view path, std::vector<int> const& sizes,
-                                   const ReturnTextureData returnTexData)
+                                   const ReturnTextureData returnTexData, const ReducePrecision reducePrecision)
 {
     if(opts.dbgNoSaveTextures)
     {
@@ -66,6 +79,7 @@ std::vector<glm::vec4> saveTexture(const GLenum target, const GLuint texture, co
         return {};
     }
 
+    const ProfiledStage profiledStage("saving "+std::string(name), -1);
     std::cerr << indentOutput() << "Saving " << name << " to \"" << path << "\"... ";
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
@@ -103,48 +117,43 @@ std::vector<glm::vec4> saveTexture(const GLenum target, const GLuint texture, co
         }
     }
 
-    const auto subpixelCount = 4*pixelCount;
-    const std::unique_ptr<GLfloat[]> subpixels(new GLfloat[subpixelCount]);
-    gl.glGetTexImage(target, 0, GL_RGBA, GL_FLOAT, subpixels.get());
+    TextureSaveJob job{std::string(name), std::string(path), sizes};
+    job.subpixelCount = 4*pixelCount;
+    job.reducePrecision = target==GL_TEXTURE_3D && opts.textureSavePrecision && reducePrecision;
+
+    if(opts.saveQueueDepth && !returnTexData)
+    {
+        readBackTextureAsync(target, std::move(job));
+        std::cerr << "queued\n";
+        return {};
+    }
+
+    job.subpixels.reset(new GLfloat[job.subpixelCount]);
+    gl.glGetTexImage(target, 0, GL_RGBA, GL_FLOAT, job.subpixels.get());
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
         std::cerr << "GL error in saveTexture() after glGetTexImage() call: " << openglErrorString(err) << "\n";
         throw MustQuit{};
     }
 
-    for(size_t i = 0; i < subpixelCount; ++i)
-    {
-        if(std::isnan(subpixels[i]))
-        {
-            std::cerr << "NaN entries detected while saving " << name << "\n";
-            throw MustQuit{};
-        }
-    }
     std::vector<glm::vec4> dataToReturn;
     if(returnTexData)
     {
         static_assert(std::is_trivially_copyable_v<glm::vec4>);
-        dataToReturn.assign(reinterpret_cast<const glm::vec4*>(subpixels.get()),
-                            reinterpret_cast<const glm::vec4*>(subpixels.get()+subpixelCount));
-    }
-    if(target==GL_TEXTURE_3D && opts.textureSavePrecision)
-    {
-        roundTexData(subpixels.get(), subpixelCount, opts.textureSavePrecision);
+        dataToReturn.assign(reinterpret_cast<const glm::vec4*>(job.subpixels.get()),
+                            reinterpret_cast<const glm::vec4*>(job.subpixels.get()+job.subpixelCount));
     }
 
-    QFile out(QByteArray::fromRawData(path.data(), path.size()));
-    if(!out.open(QFile::WriteOnly))
+    if(opts.saveQueueDepth)
     {
-        std::cerr << "failed to open file: " << out.errorString().toStdString() << "\n";
-        throw MustQuit{};
+        finishTextureSaveAsync(std::move(job));
+        std::cerr << "queued\n";
+        return dataToReturn;
     }
-    for(const uint16_t s : sizes)
-        out.write(reinterpret_cast<const char*>(&s), sizeof s);
-    out.write(reinterpret_cast<const char*>(subpixels.get()), subpixelCount*sizeof subpixels[0]);
-    out.close();
-    if(out.error())
+
+    if(const auto error=finishTextureSave(job); !error.empty())
     {
-        std::cerr << "failed to write file: " << out.errorString().toStdString() << "\n";
+        std::cerr << error << "\n";
         throw MustQuit{};
     }
     std::cerr << "done\n";
@@ -189,6 +198,19 @@ void setupTexture(const GLuint texture, const GLsizei width, const GLsizei heigh
 void setupTexture(TextureId id, const GLsizei width, const GLsizei height, const GLsizei depth)
 { setupTexture(textures[id],width,height,depth); }
 
+GLuint makeScatteringAccumulatorTexture()
+{
+    GLuint texture=0;
+    gl.glGenTextures(1, &texture);
+    gl.glBindTexture(GL_TEXTURE_3D,texture);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    gl.glTexParameteri(GL_TEXTURE_3D,GL_TEXTURE_WRAP_R,GL_CLAMP_TO_EDGE);
+    setupTexture(texture, atmo.scatTexWidth(),atmo.scatTexHeight(),atmo.scatTexDepth());
+    return texture;
+}
+
 // ------------------------------------ KHR_debug support ----------------------------------------
 #ifdef GL_DEBUG_OUTPUT
 
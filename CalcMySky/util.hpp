@@ -2,6 +2,7 @@
 #define INCLUDE_ONCE_C49956E1_F7B6_4759_8745_711BBDFE6FE7
 
 #include <string>
+#include <csignal>
 #include <iostream>
 #include <string_view>
 #include <QVector4D>
@@ -11,6 +12,8 @@
 #include "../common/util.hpp"
 
 extern QOpenGLFunctions_3_3_Core gl;
+// Set on SIGINT, checked by the long-running loops
+inline volatile std::sig_atomic_t interruptRequested=0;
 
 inline QVector4D QVec(glm::vec4 v) { return QVector4D(v.x, v.y, v.z, v.w); }
 inline QString toString(int x) { return QString::number(x); }
@@ -35,6 +38,7 @@ void setupDebugPrintCallback(QOpenGLContext& context, bool needFullDebugOutput);
 void setupTexture(TextureId id, GLsizei width, GLsizei height);
 void setupTexture(TextureId id, GLsizei width, GLsizei height, GLsizei depth);
 void setupTexture(GLuint tex, GLsizei width, GLsizei height, GLsizei depth);
+GLuint makeScatteringAccumulatorTexture();
 inline void setUniformTexture(QOpenGLShaderProgram& program, GLenum target, GLuint texture, GLint sampler, const char* uniformName)
 {
     gl.glActiveTexture(GL_TEXTURE0+sampler);
@@ -50,11 +54,14 @@ inline void setDrawBuffers(std::vector<GLenum> const& bufs)
 }
 
 void renderQuad();
+void renderQuadInstances(GLsizei instanceCount);
 inline void checkFramebufferStatus(const char*const fboDescription) { return checkFramebufferStatus(gl, fboDescription); }
 void qtMessageHandler(const QtMsgType type, QMessageLogContext const&, QString const& message);
 DEFINE_EXPLICIT_BOOL(ReturnTextureData);
+DEFINE_EXPLICIT_BOOL(ReducePrecision);
 std::vector<glm::vec4> saveTexture(GLenum target, GLuint texture, std::string_view name, std::string_view path,
-                                   std::vector<int> const& sizes, ReturnTextureData=ReturnTextureData{false});
+                                   std::vector<int> const& sizes, ReturnTextureData=ReturnTextureData{false},
+                                   ReducePrecision=ReducePrecision{true});
 void createDirs(std::string const& path);
 
 class OutputIndentIncrease
@@ -0,0 +1,238 @@
+#include "AltitudeSliceCache.hpp"
+
+#include <chrono>
+#include <algorithm>
+#include <QFile>
+#include <QDebug>
+#include "../common/util.hpp"
+
+namespace
+{
+
+AltitudeSliceCache::Slice readSlice(QString const& path, const qint64 headerSize, const qint64 sliceSize, const int index)
+{
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
+
+    const qint64 offset=headerSize+sliceSize*index;
+    if(!file.seek(offset))
+    {
+        throw DataLoadError{QObject::tr("Failed to seek to offset %1 in file \"%2\": %3")
+                            .arg(offset).arg(path).arg(file.errorString())};
+    }
+    auto slice=std::make_shared<std::vector<char>>(sliceSize);
+    const auto actuallyRead=file.read(slice->data(), sliceSize);
+    if(actuallyRead != sliceSize)
+    {
+        const auto error = actuallyRead==-1 ? QObject::tr("Failed to read texture data from file \"%1\": %2").arg(path).arg(file.errorString())
+                                            : QObject::tr("Failed to read texture data from file \"%1\": requested %2 bytes, read %3").arg(path).arg(sliceSize).arg(actuallyRead);
+        throw DataLoadError{error};
+    }
+    return slice;
+}
+
+bool isReady(std::shared_future<AltitudeSliceCache::Slice> const& slice)
+{
+    return slice.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+}
+
+AltitudeSliceCache::~AltitudeSliceCache()
+{
+    // The prefetches use the other members, so they must finish before these are destroyed
+    prefetches_.clear();
+}
+
+void AltitudeSliceCache::setBudget(const size_t bytes)
+{
+    std::lock_guard lock(mutex_);
+    budget_=bytes;
+    evictOverBudget();
+}
+
+auto AltitudeSliceCache::header(QString const& path, const qint64 headerSize) -> FileHeader
+{
+    {
+        std::lock_guard lock(mutex_);
+        if(const auto it=headers_.find(path); it!=headers_.end() && it->second.data.size()==headerSize)
+            return it->second;
+    }
+
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly))
+        throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
+    FileHeader header{file.read(headerSize), file.size()};
+    if(header.data.size() != headerSize)
+    {
+        throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": %2")
+                            .arg(path).arg(file.errorString())};
+    }
+
+    std::lock_guard lock(mutex_);
+    headers_[path]=header;
+    return header;
+}
+
+auto AltitudeSliceCache::slicePair(QString const& path, const qint64 headerSize, const qint64 sliceSize,
+                                   const int lowerIndex) -> std::pair<Slice,Slice>
+{
+    {
+        std::lock_guard lock(mutex_);
+        const auto fileSize = headers_.count(path) ? headers_.at(path).fileSize : headerSize+sliceSize*(lowerIndex+2);
+        slicings_[path]={headerSize, sliceSize, int((fileSize-headerSize)/sliceSize), lowerIndex};
+    }
+    return {getSlice(path, headerSize, sliceSize, lowerIndex),
+            getSlice(path, headerSize, sliceSize, lowerIndex+1)};
+}
+
+auto AltitudeSliceCache::getSlice(QString const& path, const qint64 headerSize, const qint64 sliceSize,
+                                  const int index) -> Slice
+{
+    std::unique_lock lock(mutex_);
+    if(budget_==0)
+    {
+        ++missCount_;
+        lock.unlock();
+        return readSlice(path, headerSize, sliceSize, index);
+    }
+
+    const Key key{path, index};
+    if(const auto it=entries_.find(key); it!=entries_.end())
+    {
+        lru_.splice(lru_.begin(), lru_, it->second.lruPos);
+        ++hitCount_;
+        const auto slice=it->second.slice;
+        lock.unlock();
+        return slice.get(); // may wait for another thread that's reading it
+    }
+
+    std::promise<Slice> promise;
+    ++missCount_;
+    lru_.push_front(key);
+    entries_.emplace(key, Entry{promise.get_future().share(), size_t(sliceSize), lru_.begin()});
+    bytesUsed_ += sliceSize;
+    evictOverBudget();
+    lock.unlock();
+
+    try
+    {
+        auto slice=readSlice(path, headerSize, sliceSize, index);
+        promise.set_value(slice);
+        return slice;
+    }
+    catch(...)
+    {
+        promise.set_exception(std::current_exception());
+        lock.lock();
+        // Let the next request retry the read. The entry may have been evicted or cleared meanwhile.
+        if(const auto it=entries_.find(key); it!=entries_.end() && isReady(it->second.slice))
+        {
+            bytesUsed_ -= it->second.bytes;
+            lru_.erase(it->second.lruPos);
+            entries_.erase(it);
+        }
+        throw;
+    }
+}
+
+void AltitudeSliceCache::evictOverBudget()
+{
+    // Slices being read can't be evicted, their readers will need the entries to publish the data
+    for(auto pos=lru_.end(); bytesUsed_>budget_ && pos!=lru_.begin();)
+    {
+        --pos;
+        const auto it=entries_.find(*pos);
+        if(!isReady(it->second.slice))
+            continue;
+        bytesUsed_ -= it->second.bytes;
+        entries_.erase(it);
+        pos=lru_.erase(pos);
+    }
+}
+
+void AltitudeSliceCache::prefetchNeighbours(const int direction)
+{
+    prefetches_.erase(std::remove_if(prefetches_.begin(), prefetches_.end(),
+                                     [](auto const& f){ return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }),
+                      prefetches_.end());
+
+    struct Prefetch
+    {
+        QString path;
+        qint64 headerSize, sliceSize;
+        int index;
+    };
+    std::vector<Prefetch> toPrefetch;
+    {
+        std::lock_guard lock(mutex_);
+        if(budget_==0) return;
+
+        size_t bytesNeeded=0;
+        for(const auto& [path, slicing] : slicings_)
+        {
+            bytesNeeded += 2*slicing.sliceSize;
+            for(const int index : {slicing.currentLowerIndex+2, slicing.currentLowerIndex-1})
+            {
+                if((index > slicing.currentLowerIndex ? direction < 0 : direction > 0) ||
+                   index < 0 || index >= slicing.sliceCount)
+                    continue;
+                bytesNeeded += slicing.sliceSize;
+                if(!entries_.count({path, index}))
+                    toPrefetch.push_back({path, slicing.headerSize, slicing.sliceSize, index});
+            }
+        }
+        if(bytesNeeded > budget_)
+        {
+            // This is checked on each altitude change, so only warn once for each budget
+            if(warnedBudget_ != budget_)
+            {
+                qDebug().nospace() << "Altitude slice cache budget of " << budget_ << " bytes is too small for prefetching, "
+                                   << bytesNeeded << " bytes are needed";
+                warnedBudget_=budget_;
+            }
+            return;
+        }
+    }
+
+    for(auto& prefetch : toPrefetch)
+    {
+        prefetches_.emplace_back(std::async(std::launch::async, [this, prefetch=std::move(prefetch)]
+        {
+            // A failure will be reported if the slice is actually needed
+            try { getSlice(prefetch.path, prefetch.headerSize, prefetch.sliceSize, prefetch.index); }
+            catch(DataLoadError const&) {}
+        }));
+    }
+}
+
+void AltitudeSliceCache::waitForPrefetches()
+{
+    for(auto& prefetch : prefetches_)
+        prefetch.wait();
+}
+
+size_t AltitudeSliceCache::hitCount() const
+{
+    std::lock_guard lock(mutex_);
+    return hitCount_;
+}
+
+size_t AltitudeSliceCache::missCount() const
+{
+    std::lock_guard lock(mutex_);
+    return missCount_;
+}
+
+void AltitudeSliceCache::clear()
+{
+    prefetches_.clear();
+
+    std::lock_guard lock(mutex_);
+    headers_.clear();
+    slicings_.clear();
+    entries_.clear();
+    lru_.clear();
+    bytesUsed_=0;
+}
@@ -0,0 +1,88 @@
+#ifndef INCLUDE_ONCE_3F6E2A91_C4D8_4B57_9A1E_7D02B5E8F4C3
+#define INCLUDE_ONCE_3F6E2A91_C4D8_4B57_9A1E_7D02B5E8F4C3
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <future>
+#include <utility>
+#include <QString>
+#include <QByteArray>
+
+/* Cache of the altitude slices read from the files of 4D textures.
+ *
+ * The renderer uploads two neighbouring altitude slices and the shaders mix them with altitudeSliceMixFactor.
+ * For data generated by older versions, which lack the "altitude slices are mixed in shaders" directive, the
+ * renderer instead uploads a lerp of the two slices computed on the CPU. Either way, a change of camera
+ * altitude that stays between the same two slices needs no file reads at all, and a move to the next
+ * interval needs only one new slice, which may already have been prefetched in the direction of motion.
+ *
+ * The slices are kept under a byte budget, least recently used are evicted first. All the methods
+ * are thread-safe, the same slice requested concurrently is read only once.
+ */
+class AltitudeSliceCache
+{
+public:
+    using Slice=std::shared_ptr<const std::vector<char>>;
+    struct FileHeader
+    {
+        QByteArray data;
+        qint64 fileSize;
+    };
+
+    ~AltitudeSliceCache();
+    // Zero budget disables caching and prefetching. Reducing the budget evicts the slices over it.
+    void setBudget(size_t bytes);
+    // Returns the first headerSize bytes of the file, reading them only on first request
+    FileHeader header(QString const& path, qint64 headerSize);
+    // Returns the slices lowerIndex and lowerIndex+1 of sliceSize bytes each, which follow the header of
+    // headerSize bytes. The pair is remembered as the current one of this file for prefetchNeighbours().
+    std::pair<Slice,Slice> slicePair(QString const& path, qint64 headerSize, qint64 sliceSize, int lowerIndex);
+    // Starts reading on worker threads the slices adjacent to the current pairs of all the files: the one above
+    // the pair for positive direction, the one below for negative, both for zero. Does nothing if the budget can't
+    // hold them along with the current pairs.
+    void prefetchNeighbours(int direction);
+    // Blocks until the prefetches started so far finish
+    void waitForPrefetches();
+    // Waits for the prefetches and drops all the data
+    void clear();
+    // Number of slice requests served from the cache, and number of slices read from the files, including prefetches
+    size_t hitCount() const;
+    size_t missCount() const;
+
+private:
+    struct FileSlicing
+    {
+        qint64 headerSize;
+        qint64 sliceSize;
+        int sliceCount;
+        int currentLowerIndex;
+    };
+    using Key=std::pair<QString,int>; // file path and slice index
+    struct Entry
+    {
+        std::shared_future<Slice> slice;
+        size_t bytes;
+        std::list<Key>::iterator lruPos;
+    };
+
+    Slice getSlice(QString const& path, qint64 headerSize, qint64 sliceSize, int index);
+    void evictOverBudget();
+
+    mutable std::mutex mutex_;
+    size_t budget_=0;
+    size_t warnedBudget_=0; // the budget that was last reported too small for prefetching
+    size_t bytesUsed_=0;
+    size_t hitCount_=0;
+    size_t missCount_=0;
+    std::map<QString, FileHeader> headers_;
+    std::map<QString, FileSlicing> slicings_;
+    std::map<Key, Entry> entries_;
+    std::list<Key> lru_; // most recently used first
+    // Only accessed from the thread that calls prefetchNeighbours() and clear()
+    std::vector<std::future<void>> prefetches_;
+};
+
+#endif
@@ -4,7 +4,11 @@
 #include <cmath>
 #include <array>
 #include <vector>
+#include <chrono>
+#include <thread>
+#include <future>
 #include <cstring>
+#include <algorithm>
 #include <cassert>
 #include <iterator>
 #include <iostream>
@@ -65,95 +69,103 @@ public:
 # define OGL_TRACE()
 #endif
 
+// Returns the index of the lower of the two altitude slices of 4D textures to mix for the given altitude, and the weight of the upper one
+std::pair<int,float> altitudeSlicesToMix(const float altitudeCoord, const int altIntervals)
+{
+    const auto altTexIndex = altitudeCoord==1 ? altIntervals-1 : altitudeCoord*altIntervals;
+    const auto floorAltIndex = std::floor(altTexIndex);
+    return {int(floorAltIndex), altTexIndex-floorAltIndex};
 }
 
-void AtmosphereRenderer::loadEclipsedDoubleScatteringTexture(QString const& path, const float altitudeCoord)
+}
+
+auto AtmosphereRenderer::readEclipsedDoubleScatteringCoarseGrid(QString const& path, const float altitudeCoord,
+                                                                 AtmosphereParameters const& params,
+                                                                 AltitudeSliceCache& cache) -> TextureData
 {
     auto log=qDebug().nospace();
 
-    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
-    {
-        throw DataLoadError{QObject::tr("GL error on entry to loadEclipsedDoubleScatteringTexture(\"%1\"): %2")
-                            .arg(path).arg(openglErrorString(err).c_str())};
-    }
-    log << "Loading texture from " << path << "... ";
-    QFile file(path);
-    if(!file.open(QFile::ReadOnly))
-        throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
-
+    log << "Reading texture from " << path << "... ";
     uint16_t numPointsPerSet;
-    {
-        const qint64 sizeToRead=sizeof numPointsPerSet;
-        if(file.read(reinterpret_cast<char*>(&numPointsPerSet), sizeToRead) != sizeToRead)
-        {
-            throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": %2")
-                                .arg(path).arg(file.errorString())};
-        }
-    }
-    const auto texSizeByViewAzimuth = params_.eclipsedDoubleScatteringTextureSize[0];
-    const auto texSizeByViewElevation = params_.eclipsedDoubleScatteringTextureSize[1];
-    const auto texSizeBySZA = params_.eclipsedDoubleScatteringTextureSize[2];
-    const auto texSizeByAltitude = params_.eclipsedDoubleScatteringTextureSize[3];
-    EclipsedDoubleScatteringPrecomputer precomputer(gl, params_, texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA, 2);
+    std::memcpy(&numPointsPerSet, cache.header(path, sizeof numPointsPerSet).data.constData(), sizeof numPointsPerSet);
+    const auto texSizeBySZA = params.eclipsedDoubleScatteringTextureSize[2];
+    const auto texSizeByAltitude = params.eclipsedDoubleScatteringTextureSize[3];
+
+    // The altitude slices are selected the same way as in the 4D scattering textures
+    const auto [floorAltIndex, fractAltIndex] = altitudeSlicesToMix(altitudeCoord, params.scatteringTextureSize[3]-1);
+    const int maxAltIndex = floorAltIndex+1;
 
-    const auto altTexIndex = altitudeCoord==1 ? numAltIntervalsIn4DTexture_-1 : altitudeCoord*numAltIntervalsIn4DTexture_;
-    const int floorAltIndex = std::floor(altTexIndex);
-    const auto fractAltIndex = altTexIndex-floorAltIndex;
-    const auto maxAltIndex = floorAltIndex+1;
+    TextureData result;
+    result.pointsPerSet = numPointsPerSet;
+    result.fractAltIndex = fractAltIndex;
+    result.rgba.resize(numPointsPerSet*texSizeBySZA*2);
 
-    std::vector<glm::vec4> data(numPointsPerSet*texSizeBySZA*2);
+    const qint64 altSliceByteSize = numPointsPerSet*sizeof result.rgba[0]*texSizeBySZA;
+    const auto [lower, upper] = cache.slicePair(path, sizeof numPointsPerSet, altSliceByteSize, floorAltIndex);
+    std::memcpy(result.rgba.data(), lower->data(), altSliceByteSize);
+    std::memcpy(reinterpret_cast<char*>(result.rgba.data())+altSliceByteSize, upper->data(), altSliceByteSize);
 
-    const auto sliceByteSize = numPointsPerSet*sizeof data[0];
-    const auto fileReadOffset = uint64_t(sliceByteSize)*texSizeBySZA*floorAltIndex;
-    const qint64 absoluteOffset=file.pos()+fileReadOffset;
-    log << "skipping to offset " << absoluteOffset << "... ";
-    if(!file.seek(absoluteOffset))
+    for(int altIndex=floorAltIndex; altIndex<=maxAltIndex; ++altIndex)
     {
-        throw DataLoadError{QObject::tr("Failed to seek to offset %1 in file \"%2\": %3")
-            .arg(absoluteOffset).arg(path).arg(file.errorString())};
+        // Using the same encoding for altitude as in scatteringTex4DCoordsToTexVars()
+        const float distToHorizon = float(altIndex)/(texSizeByAltitude-1)*params.lengthOfHorizRayFromGroundToBorderOfAtmo;
+        // Rounding errors can result in altitude>max, breaking the code after this calculation, so we have to clamp.
+        // To avoid too many zeros that would make log interpolation problematic, we clamp the bottom value at 1 m. The same at the top.
+        result.cameraAltitudes.push_back(std::clamp(float(sqrt(sqr(distToHorizon)+sqr(params.earthRadius))-params.earthRadius),
+                                                    1.f, params.atmosphereHeight-1));
     }
 
-    const qint64 sizeToRead = data.size()*sizeof data[0];
-    if(file.read(reinterpret_cast<char*>(data.data()), sizeToRead) != sizeToRead)
+    log << "done";
+    return result;
+}
+
+void AtmosphereRenderer::loadEclipsedDoubleScatteringTexture(QString const& path, const float altitudeCoord)
+{
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
-        throw DataLoadError{QObject::tr("Failed to read data from file \"%1\": %2")
-            .arg(path).arg(file.errorString())};
+        throw DataLoadError{QObject::tr("GL error on entry to loadEclipsedDoubleScatteringTexture(\"%1\"): %2")
+                            .arg(path).arg(openglErrorString(err).c_str())};
     }
+    auto prefetched=takeTextureRead(path);
+    const auto data = prefetched ? std::move(*prefetched) : readEclipsedDoubleScatteringCoarseGrid(path, altitudeCoord, params_, altitudeSliceCache_);
 
-    size_t readOffset = 0;
-    for(int altIndex=floorAltIndex; altIndex<=maxAltIndex; ++altIndex)
-    {
-        for(int szaIndex=0; szaIndex<texSizeBySZA; ++szaIndex)
-        {
-            // Using the same encoding for altitude as in scatteringTex4DCoordsToTexVars()
-            const float distToHorizon = float(altIndex)/(texSizeByAltitude-1)*params_.lengthOfHorizRayFromGroundToBorderOfAtmo;
-            // Rounding errors can result in altitude>max, breaking the code after this calculation, so we have to clamp.
-            // To avoid too many zeros that would make log interpolation problematic, we clamp the bottom value at 1 m. The same at the top.
-            const float cameraAltitude = std::clamp(float(sqrt(sqr(distToHorizon)+sqr(params_.earthRadius))-params_.earthRadius),
-                                                    1.f, params_.atmosphereHeight-1);
+    auto log=qDebug().nospace();
+    log << "Reconstructing texture from " << path << "... ";
+    const auto texSizeByViewAzimuth = params_.eclipsedDoubleScatteringTextureSize[0];
+    const auto texSizeByViewElevation = params_.eclipsedDoubleScatteringTextureSize[1];
+    const auto texSizeBySZA = params_.eclipsedDoubleScatteringTextureSize[2];
+    EclipsedDoubleScatteringPrecomputer precomputer(gl, params_, texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA, 2);
 
-            precomputer.loadCoarseGridSamples(cameraAltitude, data.data()+readOffset, numPointsPerSet);
-            precomputer.generateTextureFromCoarseGridData(altIndex-floorAltIndex, szaIndex, cameraAltitude);
-            readOffset += numPointsPerSet;
-        }
-    }
+    // The reconstruction is independent for each (altitude, SZA) cell and doesn't need OpenGL,
+    // so it's done in parallel, leaving only the upload for this thread.
+    precomputer.generateTextureFromCoarseGridData(data.rgba.data(), data.pointsPerSet, data.cameraAltitudes,
+                                                  std::max(1u, std::thread::hardware_concurrency()));
 
     const size_t altSliceSize = texSizeByViewAzimuth * texSizeByViewElevation * texSizeBySZA;
     auto texture = precomputer.texture();
     assert(texture.size() == altSliceSize*2);
 
-    for(size_t n = 0; n < altSliceSize; ++n)
+    if(params_.altitudeSlicesMixedInShaders)
     {
-        const auto interpolated = texture[n] + fractAltIndex * (texture[n+altSliceSize] - texture[n]);
-        if(std::isnan(interpolated.x))
+        // The texture already has the lower slice followed by the upper one, as the shaders expect
+        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, texSizeByViewAzimuth, texSizeByViewElevation, 2*texSizeBySZA,
+                        0, GL_RGBA, GL_FLOAT, texture.data());
+    }
+    else
+    {
+        for(size_t n = 0; n < altSliceSize; ++n)
         {
-            std::cerr << "NaN computed from " << texture[n].x << " and " << texture[n+altSliceSize].x << " (n = " << n << ")\n";
+            const auto interpolated = texture[n] + float(data.fractAltIndex) * (texture[n+altSliceSize] - texture[n]);
+            if(std::isnan(interpolated.x))
+            {
+                std::cerr << "NaN computed from " << texture[n].x << " and " << texture[n+altSliceSize].x << " (n = " << n << ")\n";
+            }
+            texture[n] = interpolated;
         }
-        texture[n] = interpolated;
-    }
 
-    gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA,
-                    0, GL_RGBA, GL_FLOAT, texture.data());
+        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA,
+                        0, GL_RGBA, GL_FLOAT, texture.data());
+    }
 
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
@@ -164,113 +176,115 @@ void AtmosphereRenderer::loadEclipsedDoubleScatteringTexture(QString const& path
     log << "done";
 }
 
-void AtmosphereRenderer::loadTexture4D(QString const& path, const float altitudeCoord, Texture4DType texType)
+auto AtmosphereRenderer::readTexture4DSlice(QString const& path, const float altitudeCoord, const Texture4DType texType,
+                                            const KeepAltitudeSlicePair keepSlicePair, AltitudeSliceCache& cache) -> TextureData
 {
     auto log=qDebug().nospace();
 
-    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
-    {
-        throw DataLoadError{QObject::tr("GL error on entry to loadTexture4D(\"%1\"): %2")
-                            .arg(path).arg(openglErrorString(err).c_str())};
-    }
-    log << "Loading texture from " << path << "... ";
-    QFile file(path);
-    if(!file.open(QFile::ReadOnly))
-        throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
-
+    log << "Reading texture from " << path << "... ";
     uint16_t sizes[4];
-    {
-        const qint64 sizeToRead=sizeof sizes;
-        if(file.read(reinterpret_cast<char*>(sizes), sizeToRead) != sizeToRead)
-        {
-            throw DataLoadError{QObject::tr("Failed to read header from file \"%1\": %2")
-                                .arg(path).arg(file.errorString())};
-        }
-    }
+    const auto header=cache.header(path, sizeof sizes);
+    std::memcpy(sizes, header.data.constData(), sizeof sizes);
     log << "dimensions from header: " << sizes[0] << "×" << sizes[1] << "×" << sizes[2] << "×" << sizes[3] << "... ";
 
     const size_t subpixelsPerPixel = texType==Texture4DType::InterpolationGuides ? 1 : 4;
     const size_t subpixelSize = texType==Texture4DType::InterpolationGuides ? sizeof(GLshort) : sizeof(GLfloat);
     const size_t pixelSize = subpixelsPerPixel*subpixelSize;
-    const qint64 expectedFileSize = file.pos() + pixelSize*uint64_t(sizes[0])*sizes[1]*sizes[2]*sizes[3];
-    if(expectedFileSize != file.size())
+    const qint64 expectedFileSize = sizeof sizes + pixelSize*uint64_t(sizes[0])*sizes[1]*sizes[2]*sizes[3];
+    if(expectedFileSize != header.fileSize)
     {
         throw DataLoadError{QObject::tr("Size of file \"%1\" (%2 bytes) doesn't match image dimensions %3×%4×%5×%6 from file header.\nThe expected size is %7 bytes.")
-                            .arg(path).arg(file.size()).arg(sizes[0]).arg(sizes[1]).arg(sizes[2]).arg(sizes[3]).arg(expectedFileSize)};
+                            .arg(path).arg(header.fileSize).arg(sizes[0]).arg(sizes[1]).arg(sizes[2]).arg(sizes[3]).arg(expectedFileSize)};
     }
 
-    numAltIntervalsIn4DTexture_ = sizes[3]-1;
-    const auto altTexIndex = altitudeCoord==1 ? numAltIntervalsIn4DTexture_-1 : altitudeCoord*numAltIntervalsIn4DTexture_;
-    const auto floorAltIndex = std::floor(altTexIndex);
-    const auto fractAltIndex = altTexIndex-floorAltIndex;
-
-    const auto readOffset = pixelSize*uint64_t(sizes[0])*sizes[1]*sizes[2]*uint64_t(floorAltIndex);
-    sizes[3]=2;
-    const qint64 sizeToRead = pixelSize*uint64_t(sizes[0])*sizes[1]*sizes[2]*sizes[3];
-
-    const std::unique_ptr<char[]> data(new char[sizeToRead]);
-
-    const qint64 absoluteOffset=file.pos()+readOffset;
-    log << "skipping to offset " << absoluteOffset << "... ";
-    if(!file.seek(absoluteOffset))
-    {
-        throw DataLoadError{QObject::tr("Failed to seek to offset %1 in file \"%2\": %3")
-                            .arg(absoluteOffset).arg(path).arg(file.errorString())};
-    }
-    const auto actuallyRead=file.read(data.get(), sizeToRead);
-    if(actuallyRead != sizeToRead)
-    {
-        const auto error = actuallyRead==-1 ? QObject::tr("Failed to read texture data from file \"%1\": %2").arg(path).arg(file.errorString())
-                                            : QObject::tr("Failed to read texture data from file \"%1\": requested %2 bytes, read %3").arg(path).arg(sizeToRead).arg(actuallyRead);
-        throw DataLoadError{error};
-    }
+    TextureData result;
+    result.width=sizes[0];
+    result.height=sizes[1];
+    result.depth=sizes[2];
+    result.altIntervals = sizes[3]-1;
+    const auto [floorAltIndex, fractAltIndex] = altitudeSlicesToMix(altitudeCoord, result.altIntervals);
 
     const auto altSliceSize = size_t(sizes[0])*sizes[1]*sizes[2];
-    if(texType == Texture4DType::InterpolationGuides)
+    const auto [lowerSlice, upperSlice] = cache.slicePair(path, sizeof sizes, pixelSize*altSliceSize, floorAltIndex);
+    const char*const lowerData = lowerSlice->data();
+    const char*const upperData = upperSlice->data();
+    if(keepSlicePair)
+    {
+        // The shaders will mix the slices, stacked along the depth
+        result.depth=2*sizes[2];
+        char* data;
+        if(texType == Texture4DType::InterpolationGuides)
+        {
+            result.red.resize(2*altSliceSize);
+            data = reinterpret_cast<char*>(result.red.data());
+        }
+        else
+        {
+            result.rgba.resize(2*altSliceSize);
+            data = reinterpret_cast<char*>(result.rgba.data());
+        }
+        std::memcpy(data, lowerData, pixelSize*altSliceSize);
+        std::memcpy(data + pixelSize*altSliceSize, upperData, pixelSize*altSliceSize);
+    }
+    else if(texType == Texture4DType::InterpolationGuides)
     {
-        std::unique_ptr<int16_t[]> texData(new int16_t[altSliceSize]);
+        result.red.resize(altSliceSize);
         for(size_t n = 0; n < altSliceSize; ++n)
         {
             int16_t lower, upper;
             assert(sizeof lower == pixelSize);
-            std::memcpy(&lower, data.get() + n * pixelSize, pixelSize);
-            std::memcpy(&upper, data.get() + (n+altSliceSize) * pixelSize, pixelSize);
-            texData[n] = lower + fractAltIndex*(upper-lower);
+            std::memcpy(&lower, lowerData + n * pixelSize, pixelSize);
+            std::memcpy(&upper, upperData + n * pixelSize, pixelSize);
+            result.red[n] = lower + fractAltIndex*(upper-lower);
         }
-        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_R16_SNORM, sizes[0], sizes[1], sizes[2], 0, GL_RED, GL_SHORT, texData.get());
     }
     else
     {
-        std::unique_ptr<glm::vec4[]> texData(new glm::vec4[altSliceSize]);
+        result.rgba.resize(altSliceSize);
         for(size_t n = 0; n < altSliceSize; ++n)
         {
             glm::vec4 lower, upper;
             assert(sizeof lower == pixelSize);
-            std::memcpy(&lower, data.get() + n * pixelSize, pixelSize);
-            std::memcpy(&upper, data.get() + (n+altSliceSize) * pixelSize, pixelSize);
-            texData[n] = lower + fractAltIndex*(upper-lower);
+            std::memcpy(&lower, lowerData + n * pixelSize, pixelSize);
+            std::memcpy(&upper, upperData + n * pixelSize, pixelSize);
+            result.rgba[n] = lower + fractAltIndex*(upper-lower);
         }
-        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, sizes[0], sizes[1], sizes[2], 0, GL_RGBA, GL_FLOAT, texData.get());
-    }
-    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
-    {
-        throw DataLoadError{QObject::tr("GL error in loadTexture4D(\"%1\") after glTexImage3D() call: %2")
-                            .arg(path).arg(openglErrorString(err).c_str())};
     }
 
     log << "done";
+    return result;
 }
 
-glm::ivec2 AtmosphereRenderer::loadTexture2D(QString const& path)
+void AtmosphereRenderer::loadTexture4D(QString const& path, const float altitudeCoord, Texture4DType texType)
 {
-    auto log=qDebug().nospace();
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        throw DataLoadError{QObject::tr("GL error on entry to loadTexture4D(\"%1\"): %2")
+                            .arg(path).arg(openglErrorString(err).c_str())};
+    }
+    auto prefetched=takeTextureRead(path);
+    const auto data = prefetched ? std::move(*prefetched)
+                                 : readTexture4DSlice(path, altitudeCoord, texType,
+                                                      KeepAltitudeSlicePair{params_.altitudeSlicesMixedInShaders},
+                                                      altitudeSliceCache_);
 
+    numAltIntervalsIn4DTexture_ = data.altIntervals;
+    if(texType == Texture4DType::InterpolationGuides)
+        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_R16_SNORM, data.width, data.height, data.depth, 0, GL_RED, GL_SHORT, data.red.data());
+    else
+        gl.glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, data.width, data.height, data.depth, 0, GL_RGBA, GL_FLOAT, data.rgba.data());
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
-        throw DataLoadError{QObject::tr("GL error on entry to loadTexture2D(\"%1\"): %2")
+        throw DataLoadError{QObject::tr("GL error in loadTexture4D(\"%1\") after glTexImage3D() call: %2")
                             .arg(path).arg(openglErrorString(err).c_str())};
     }
-    log << "Loading texture from " << path << "... ";
+}
+
+auto AtmosphereRenderer::readTexture2D(QString const& path) -> TextureData
+{
+    auto log=qDebug().nospace();
+
+    log << "Reading texture from " << path << "... ";
     QFile file(path);
     if(!file.open(QFile::ReadOnly))
         throw DataLoadError{QObject::tr("Failed to open file \"%1\": %2").arg(path).arg(file.errorString())};
@@ -284,20 +298,23 @@ glm::ivec2 AtmosphereRenderer::loadTexture2D(QString const& path)
                                 .arg(path).arg(file.errorString())};
         }
     }
-    const auto subpixelCount = 4*uint64_t(sizes[0])*sizes[1];
+    const auto pixelCount = uint64_t(sizes[0])*sizes[1];
     log << "dimensions from header: " << sizes[0] << "×" << sizes[1] << "... ";
 
-    if(const qint64 expectedFileSize = subpixelCount*sizeof(GLfloat)+file.pos();
+    TextureData result;
+    result.width=sizes[0];
+    result.height=sizes[1];
+    result.rgba.resize(pixelCount);
+    if(const qint64 expectedFileSize = pixelCount*sizeof result.rgba[0]+file.pos();
        expectedFileSize != file.size())
     {
         throw DataLoadError{QObject::tr("Size of file \"%1\" (%2 bytes) doesn't match image dimensions %3×%4 from file header.\nThe expected size is %5 bytes.")
                             .arg(path).arg(file.size()).arg(sizes[0]).arg(sizes[1]).arg(expectedFileSize)};
     }
 
-    const std::unique_ptr<GLfloat[]> subpixels(new GLfloat[subpixelCount]);
     {
-        const qint64 sizeToRead=subpixelCount*sizeof subpixels[0];
-        const auto actuallyRead=file.read(reinterpret_cast<char*>(subpixels.get()), sizeToRead);
+        const qint64 sizeToRead=pixelCount*sizeof result.rgba[0];
+        const auto actuallyRead=file.read(reinterpret_cast<char*>(result.rgba.data()), sizeToRead);
         if(actuallyRead != sizeToRead)
         {
             const auto error = actuallyRead==-1 ? QObject::tr("Failed to read texture data from file \"%1\": %2").arg(path).arg(file.errorString())
@@ -305,14 +322,91 @@ glm::ivec2 AtmosphereRenderer::loadTexture2D(QString const& path)
             throw DataLoadError{error};
         }
     }
-    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,sizes[0],sizes[1],0,GL_RGBA,GL_FLOAT,subpixels.get());
+    log << "done";
+    return result;
+}
+
+glm::ivec2 AtmosphereRenderer::loadTexture2D(QString const& path)
+{
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        throw DataLoadError{QObject::tr("GL error on entry to loadTexture2D(\"%1\"): %2")
+                            .arg(path).arg(openglErrorString(err).c_str())};
+    }
+    auto prefetched=takeTextureRead(path);
+    const auto data = prefetched ? std::move(*prefetched) : readTexture2D(path);
+
+    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,data.width,data.height,0,GL_RGBA,GL_FLOAT,data.rgba.data());
     if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
     {
         throw DataLoadError{QObject::tr("GL error in loadTexture2D(\"%1\") after glTexImage2D() call: %2")
                             .arg(path).arg(openglErrorString(err).c_str())};
     }
-    log << "done";
-    return {sizes[0], sizes[1]};
+    return {data.width, data.height};
+}
+
+void AtmosphereRenderer::prefetchTexture2D(QString const& path)
+{
+    textureReads_.push_back({path, [path]{ return readTexture2D(path); }, {}});
+    startTextureReads();
+}
+
+void AtmosphereRenderer::prefetchTexture4D(QString const& path, const float altitudeCoord, const Texture4DType texType)
+{
+    const KeepAltitudeSlicePair keepSlicePair{params_.altitudeSlicesMixedInShaders};
+    textureReads_.push_back({path, [=]{ return readTexture4DSlice(path, altitudeCoord, texType, keepSlicePair, altitudeSliceCache_); }, {}});
+    startTextureReads();
+}
+
+void AtmosphereRenderer::prefetchEclipsedDoubleScatteringTexture(QString const& path, const float altitudeCoord)
+{
+    // params_ isn't modified while loading, and clearResources() waits for the reads before it's changed or destroyed
+    textureReads_.push_back({path, [=]{ return readEclipsedDoubleScatteringCoarseGrid(path, altitudeCoord, params_, altitudeSliceCache_); }, {}});
+    startTextureReads();
+}
+
+void AtmosphereRenderer::startTextureReads()
+{
+    // Each read holds a whole altitude slice in memory until it's uploaded, so only a couple run ahead of
+    // the steps, regardless of the number of CPU cores. The reads are limited by disk, not CPU, anyway.
+    constexpr size_t maxReadsInFlight = 2;
+    abandonedTextureReads_.erase(std::remove_if(abandonedTextureReads_.begin(), abandonedTextureReads_.end(),
+                                                [](auto const& f){ return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }),
+                                 abandonedTextureReads_.end());
+    for(size_t n = 0; n < std::min(maxReadsInFlight, textureReads_.size()); ++n)
+    {
+        auto& read = textureReads_[n];
+        if(read.result.valid()) continue;
+        read.result = std::async(std::launch::async, [read=read.read, cancelled=textureReadsCancelled_]
+                                 { return *cancelled ? TextureData{} : read(); });
+    }
+}
+
+void AtmosphereRenderer::abandonTextureReads()
+{
+    if(textureReads_.empty()) return;
+
+    *textureReadsCancelled_=true;
+    textureReadsCancelled_=std::make_shared<std::atomic<bool>>(false);
+    for(auto& read : textureReads_)
+        if(read.result.valid())
+            abandonedTextureReads_.emplace_back(std::move(read.result));
+    textureReads_.clear();
+}
+
+auto AtmosphereRenderer::takeTextureRead(QString const& path) -> std::optional<TextureData>
+{
+    // The steps consume the reads in the order of scheduling, unless the set of data files changed in between
+    const auto it=std::find_if(textureReads_.begin(), textureReads_.end(), [&](auto const& read){ return read.path==path; });
+    if(it==textureReads_.end())
+        return std::nullopt;
+
+    auto read=std::move(*it);
+    textureReads_.erase(it);
+    startTextureReads();
+    if(!read.result.valid())
+        return read.read();
+    return read.result.get(); // rethrows DataLoadError from the worker thread
 }
 
 void AtmosphereRenderer::loadTextures(const CountStepsOnly countStepsOnly)
@@ -326,9 +420,11 @@ void AtmosphereRenderer::loadTextures(const CountStepsOnly countStepsOnly)
 
     for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
     {
+        const auto filename=QString("%1/transmittance-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
         if(countStepsOnly)
         {
             ++totalLoadingStepsToDo_;
+            prefetchTexture2D(filename);
             continue;
         }
         if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
@@ -338,15 +434,17 @@ void AtmosphereRenderer::loadTextures(const CountStepsOnly countStepsOnly)
         tex.setMinificationFilter(QOpenGLTexture::Linear);
         tex.setWrapMode(QOpenGLTexture::ClampToEdge);
         tex.bind();
-        loadTexture2D(QString("%1/transmittance-wlset%2.f32").arg(pathToData_).arg(wlSetIndex));
+        loadTexture2D(filename);
         ++loadingStepsDone_; return;
     }
 
     for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
     {
+        const auto filename=QString("%1/irradiance-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
         if(countStepsOnly)
         {
             ++totalLoadingStepsToDo_;
+            prefetchTexture2D(filename);
             continue;
         }
         if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
@@ -356,7 +454,7 @@ void AtmosphereRenderer::loadTextures(const CountStepsOnly countStepsOnly)
         tex.setMinificationFilter(QOpenGLTexture::Linear);
         tex.setWrapMode(QOpenGLTexture::ClampToEdge);
         tex.bind();
-        loadTexture2D(QString("%1/irradiance-wlset%2.f32").arg(pathToData_).arg(wlSetIndex));
+        loadTexture2D(filename);
         ++loadingStepsDone_; return;
     }
 
@@ -374,6 +472,22 @@ double AtmosphereRenderer::altitudeUnitRangeTexCoord() const
     return std::sqrt(h*(h+2*R) / ( H*(H+2*R) ));
 }
 
+bool AtmosphereRenderer::altitudeChangeNeedsReloading(const double altCoord) const
+{
+    if(altCoord == altCoordToLoad_)
+        return false;
+    // When the shaders mix the slices, the textures only change when the camera moves to another pair of slices
+    if(!params_.altitudeSlicesMixedInShaders)
+        return true;
+    const int altIntervals = params_.scatteringTextureSize[3]-1;
+    return altitudeSlicesToMix(altCoord, altIntervals).first != altitudeSlicesToMix(altCoordToLoad_, altIntervals).first;
+}
+
+float AtmosphereRenderer::altitudeSliceMixFactor() const
+{
+    return altitudeSlicesToMix(altitudeUnitRangeTexCoord(), params_.scatteringTextureSize[3]-1).second;
+}
+
 void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStepsOnly)
 {
     const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
@@ -393,6 +507,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
         if(countStepsOnly)
         {
             ++totalLoadingStepsToDo_;
+            prefetchTexture4D(filename, altCoord);
         }
         else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
         {
@@ -409,9 +524,11 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
     {
         for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
         {
+            const auto filename=QString("%1/multiple-scattering-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
             if(countStepsOnly)
             {
                 ++totalLoadingStepsToDo_;
+                prefetchTexture4D(filename, altCoord);
                 continue;
             }
             if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
@@ -422,7 +539,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
             tex.setMagnificationFilter(texFilter);
             tex.setWrapMode(QOpenGLTexture::ClampToEdge);
             tex.bind();
-            loadTexture4D(QString("%1/multiple-scattering-wlset%2.f32").arg(pathToData_).arg(wlSetIndex), altCoord);
+            loadTexture4D(filename, altCoord);
             ++loadingStepsDone_; return;
         }
     }
@@ -457,9 +574,11 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
         {
             for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
             {
+                const auto filename=QString("%1/single-scattering/%2/%3.f32").arg(pathToData_).arg(wlSetIndex).arg(scatterer.name);
                 if(countStepsOnly)
                 {
                     ++totalLoadingStepsToDo_;
+                    prefetchTexture4D(filename, altCoord);
                     continue;
                 }
                 if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
@@ -470,7 +589,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                 texture.setMagnificationFilter(texFilter);
                 texture.setWrapMode(QOpenGLTexture::ClampToEdge);
                 texture.bind();
-                loadTexture4D(QString("%1/single-scattering/%2/%3.f32").arg(pathToData_).arg(wlSetIndex).arg(scatterer.name), altCoord);
+                loadTexture4D(filename, altCoord);
                 ++loadingStepsDone_; return;
             }
             for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
@@ -481,6 +600,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                     if(countStepsOnly)
                     {
                         ++totalLoadingStepsToDo_;
+                        prefetchTexture4D(filename, altCoord, Texture4DType::InterpolationGuides);
                     }
                     else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
                     {
@@ -503,6 +623,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                     if(countStepsOnly)
                     {
                         ++totalLoadingStepsToDo_;
+                        prefetchTexture4D(filename, altCoord, Texture4DType::InterpolationGuides);
                     }
                     else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
                     {
@@ -538,9 +659,11 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
         case PhaseFunctionType::Smooth:
         case PhaseFunctionType::Achromatic:
         {
+            const auto filename=QString("%1/single-scattering/%2-xyzw.f32").arg(pathToData_).arg(scatterer.name);
             if(countStepsOnly)
             {
                 ++totalLoadingStepsToDo_;
+                prefetchTexture4D(filename, altCoord);
             }
             else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
             {
@@ -549,7 +672,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                 texture.setMagnificationFilter(texFilter);
                 texture.setWrapMode(QOpenGLTexture::ClampToEdge);
                 texture.bind();
-                loadTexture4D(QString("%1/single-scattering/%2-xyzw.f32").arg(pathToData_).arg(scatterer.name), altCoord);
+                loadTexture4D(filename, altCoord);
                 ++loadingStepsDone_; return;
             }
 
@@ -559,6 +682,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                 if(countStepsOnly)
                 {
                     ++totalLoadingStepsToDo_;
+                    prefetchTexture4D(guidesFilename01, altCoord, Texture4DType::InterpolationGuides);
                 }
                 else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
                 {
@@ -578,6 +702,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                 if(countStepsOnly)
                 {
                     ++totalLoadingStepsToDo_;
+                    prefetchTexture4D(guidesFilename02, altCoord, Texture4DType::InterpolationGuides);
                 }
                 else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
                 {
@@ -630,6 +755,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
             if(countStepsOnly)
             {
                 ++totalLoadingStepsToDo_;
+                prefetchEclipsedDoubleScatteringTexture(filename, altCoord);
             }
             else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
             {
@@ -644,8 +770,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                 texture.setWrapMode(QOpenGLTexture::DirectionR, QOpenGLTexture::ClampToEdge);
 
                 texture.bind();
-                loadEclipsedDoubleScatteringTexture(QString("%1/eclipsed-double-scattering-xyzw.f32")
-                                                     .arg(pathToData_), altCoord);
+                loadEclipsedDoubleScatteringTexture(filename, altCoord);
 
                 ++loadingStepsDone_; return;
             }
@@ -654,9 +779,11 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
         {
             for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
             {
+                const auto filename=QString("%1/eclipsed-double-scattering-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
                 if(countStepsOnly)
                 {
                     ++totalLoadingStepsToDo_;
+                    prefetchEclipsedDoubleScatteringTexture(filename, altCoord);
                     continue;
                 }
                 if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
@@ -673,8 +800,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
                 texture.setWrapMode(QOpenGLTexture::DirectionR, QOpenGLTexture::ClampToEdge);
 
                 texture.bind();
-                loadEclipsedDoubleScatteringTexture(QString("%1/eclipsed-double-scattering-wlset%2.f32")
-                                                     .arg(pathToData_).arg(wlSetIndex), altCoord);
+                loadEclipsedDoubleScatteringTexture(filename, altCoord);
 
                 ++loadingStepsDone_; return;
             }
@@ -723,6 +849,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
         if(countStepsOnly)
         {
             ++totalLoadingStepsToDo_;
+            prefetchTexture2D(filename);
         }
         else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
         {
@@ -739,9 +866,11 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
     {
         for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
         {
+            const auto filename=QString("%1/light-pollution-wlset%2.f32").arg(pathToData_).arg(wlSetIndex);
             if(countStepsOnly)
             {
                 ++totalLoadingStepsToDo_;
+                prefetchTexture2D(filename);
                 continue;
             }
             if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
@@ -752,7 +881,7 @@ void AtmosphereRenderer::reloadScatteringTextures(const CountStepsOnly countStep
             tex.setMagnificationFilter(texFilter);
             tex.setWrapMode(QOpenGLTexture::ClampToEdge);
             tex.bind();
-            loadTexture2D(QString("%1/light-pollution-wlset%2.f32").arg(pathToData_).arg(wlSetIndex));
+            loadTexture2D(filename);
             ++loadingStepsDone_; return;
         }
     }
@@ -1071,6 +1200,44 @@ void main()
         }
     }
 
+    if(countStepsOnly)
+    {
+        ++totalLoadingStepsToDo_;
+    }
+    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    {
+        eclipsedDoubleScatteringPrecomputedBatchedPrograms_.clear();
+        ++loadingStepsDone_; return;
+    }
+    if(QFile::exists(pathToData_+"/shaders/double-scattering-eclipsed/precomputed-batched/0/"))
+    {
+        for(unsigned batchIndex=0; batchIndex<renderingBatchCount(); ++batchIndex)
+        {
+            if(countStepsOnly)
+            {
+                ++totalLoadingStepsToDo_;
+                continue;
+            }
+            if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
+                continue;
+
+            const auto scatDir=QString("%1/shaders/double-scattering-eclipsed/precomputed-batched/%2").arg(pathToData_).arg(batchIndex);
+            qDebug().nospace() << "Loading shaders from " << scatDir << "...";
+            auto& program=*eclipsedDoubleScatteringPrecomputedBatchedPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+
+            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(scatDir.toStdString())))
+                addShaderFile(program,QOpenGLShader::Fragment,shaderFile.path());
+
+            program.addShader(viewDirFragShader_.get());
+            program.addShader(viewDirVertShader_.get());
+            for(const auto& b : viewDirBindAttribLocations_)
+                program.bindAttributeLocation(b.first.c_str(), b.second);
+
+            link(program, QObject::tr("batched precomputed eclipsed double scattering shader program"));
+            ++loadingStepsDone_; return;
+        }
+    }
+
     // Rendering with on-the-fly precomputation, useful as a reference on slower machines, and as the production mode on very fast ones
     if(countStepsOnly)
     {
@@ -1160,6 +1327,41 @@ void main()
         }
     }
 
+    if(countStepsOnly)
+    {
+        ++totalLoadingStepsToDo_;
+    }
+    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    {
+        multipleScatteringBatchedPrograms_.clear();
+        ++loadingStepsDone_; return;
+    }
+    if(QFile::exists(pathToData_+"/shaders/multiple-scattering-batched/0/"))
+    {
+        for(unsigned batchIndex=0; batchIndex<renderingBatchCount(); ++batchIndex)
+        {
+            if(countStepsOnly)
+            {
+                ++totalLoadingStepsToDo_;
+                continue;
+            }
+            if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
+                continue;
+
+            auto& program=*multipleScatteringBatchedPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+            const auto batchDir=QString("%1/shaders/multiple-scattering-batched/%2").arg(pathToData_).arg(batchIndex);
+            qDebug().nospace() << "Loading shaders from " << batchDir << "...";
+            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(batchDir.toStdString())))
+                addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
+            program.addShader(viewDirFragShader_.get());
+            program.addShader(viewDirVertShader_.get());
+            for(const auto& b : viewDirBindAttribLocations_)
+                program.bindAttributeLocation(b.first.c_str(), b.second);
+            link(program, QObject::tr("batched multiple scattering shader program"));
+            ++loadingStepsDone_; return;
+        }
+    }
+
     if(countStepsOnly)
     {
         ++totalLoadingStepsToDo_;
@@ -1307,6 +1509,82 @@ void main()
             ++loadingStepsDone_; return;
         }
     }
+
+    if(countStepsOnly)
+    {
+        ++totalLoadingStepsToDo_;
+    }
+    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    {
+        lightPollutionBatchedPrograms_.clear();
+        ++loadingStepsDone_; return;
+    }
+    if(QFile::exists(pathToData_+"/shaders/light-pollution-batched/0/"))
+    {
+        for(unsigned batchIndex=0; batchIndex<renderingBatchCount(); ++batchIndex)
+        {
+            if(countStepsOnly)
+            {
+                ++totalLoadingStepsToDo_;
+                continue;
+            }
+            if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
+                continue;
+
+            auto& program=*lightPollutionBatchedPrograms_.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+            const auto batchDir=QString("%1/shaders/light-pollution-batched/%2").arg(pathToData_).arg(batchIndex);
+            qDebug().nospace() << "Loading shaders from " << batchDir << "...";
+            for(const auto& shaderFile : fs::directory_iterator(fs::u8path(batchDir.toStdString())))
+                addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
+            program.addShader(viewDirFragShader_.get());
+            program.addShader(viewDirVertShader_.get());
+            for(const auto& b : viewDirBindAttribLocations_)
+                program.bindAttributeLocation(b.first.c_str(), b.second);
+            link(program, QObject::tr("batched light pollution shader program"));
+            ++loadingStepsDone_; return;
+        }
+    }
+
+    if(countStepsOnly)
+    {
+        ++totalLoadingStepsToDo_;
+    }
+    else if(++currentLoadingIterationStepCounter_ > loadingStepsDone_)
+    {
+        singleScatteringBatchedPrograms_.clear();
+        ++loadingStepsDone_; return;
+    }
+    if(QFile::exists(pathToData_+"/shaders/single-scattering/precomputed-batched/0/"))
+    {
+        for(const auto& scatterer : params_.scatterers)
+        {
+            for(unsigned batchIndex=0; batchIndex<renderingBatchCount(); ++batchIndex)
+            {
+                if(countStepsOnly)
+                {
+                    ++totalLoadingStepsToDo_;
+                    continue;
+                }
+                if(++currentLoadingIterationStepCounter_ <= loadingStepsDone_)
+                    continue;
+
+                auto& programs=singleScatteringBatchedPrograms_[scatterer.name];
+                auto& program=*programs.emplace_back(std::make_unique<QOpenGLShaderProgram>());
+                const auto batchDir=QString("%1/shaders/single-scattering/precomputed-batched/%2/%3").arg(pathToData_)
+                                                                                                     .arg(batchIndex)
+                                                                                                     .arg(scatterer.name);
+                qDebug().nospace() << "Loading shaders from " << batchDir << "...";
+                for(const auto& shaderFile : fs::directory_iterator(fs::u8path(batchDir.toStdString())))
+                    addShaderFile(program, QOpenGLShader::Fragment, shaderFile.path());
+                program.addShader(viewDirFragShader_.get());
+                program.addShader(viewDirVertShader_.get());
+                for(const auto& b : viewDirBindAttribLocations_)
+                    program.bindAttributeLocation(b.first.c_str(), b.second);
+                link(program, QObject::tr("batched shader program for scatterer \"%1\"").arg(scatterer.name));
+                ++loadingStepsDone_; return;
+            }
+        }
+    }
 }
 
 void AtmosphereRenderer::setupBuffers()
@@ -1368,6 +1646,47 @@ double AtmosphereRenderer::cameraMoonDistance() const
     return -hpR*sin(moonElevation)+sqrt(sqr(tools_->earthMoonDistance())-sqr(hpR*cos(moonElevation)));
 }
 
+auto AtmosphereRenderer::currentEclipseGeometry() const -> EclipseGeometry
+{
+    return {tools_->altitude(), tools_->sunZenithAngle(), tools_->moonZenithAngle(),
+            tools_->moonAzimuth() - tools_->sunAzimuth(), tools_->earthMoonDistance(), tools_->sunAngularRadius()};
+}
+
+bool AtmosphereRenderer::eclipseGeometriesMatch(EclipseGeometry const& a, EclipseGeometry const& b) const
+{
+    const auto angleTol=tools_->eclipsePrecomputationAngleTolerance();
+    return std::abs(a.altitude-b.altitude) <= tools_->eclipsePrecomputationAltitudeTolerance() &&
+           std::abs(a.sunZenithAngle-b.sunZenithAngle) <= angleTol &&
+           std::abs(a.moonZenithAngle-b.moonZenithAngle) <= angleTol &&
+           std::abs(std::remainder(a.moonRelativeAzimuth-b.moonRelativeAzimuth, 2*M_PI)) <= angleTol &&
+           std::abs(a.earthMoonDistance-b.earthMoonDistance) <= tools_->eclipsePrecomputationMoonDistanceTolerance() &&
+           std::abs(a.sunAngularRadius-b.sunAngularRadius) <= angleTol;
+}
+
+void AtmosphereRenderer::invalidateEclipsePrecomputations()
+{
+    eclipsedSingleScatteringGeometry_.reset();
+    eclipsedDoubleScatteringCache_.clear();
+    eclipsedDoubleScatteringTexturesValid_=false;
+    ++eclipsePrecomputationGeneration_;
+}
+
+void AtmosphereRenderer::keepEclipsePrecomputationsAfterAltitudeReload()
+{
+    // The cached results are keyed by altitude among other things, so they stay valid. But a pending
+    // computation has been sampling the textures of the previous altitude, which are now replaced.
+    ++eclipsePrecomputationGeneration_;
+    // The target textures have been recreated empty. Restoring the most recent result lets the renderer
+    // show it while the result for the new altitude is computed within the frame budget, instead of
+    // stalling to compute it at once.
+    if(eclipsedDoubleScatteringCache_.empty())
+    {
+        eclipsedDoubleScatteringTexturesValid_=false;
+        return;
+    }
+    uploadEclipsedDoubleScatteringTextures(eclipsedDoubleScatteringCache_.front().targetTexturesData);
+}
+
 QVector4D AtmosphereRenderer::getPixelLuminance(QPoint const& pixelPos)
 {
     GLint origFBO=-1;
@@ -1425,6 +1744,7 @@ std::vector<float> AtmosphereRenderer::getWavelengths()
 
 void AtmosphereRenderer::setSolarSpectrum(std::vector<float> const& solarIrradianceAtTOA)
 {
+    invalidateEclipsePrecomputations();
     solarIrradianceFixup_.clear();
     for(unsigned n=0; n<solarIrradianceAtTOA.size()/4; ++n)
     {
@@ -1437,6 +1757,7 @@ void AtmosphereRenderer::setSolarSpectrum(std::vector<float> const& solarIrradia
 
 void AtmosphereRenderer::resetSolarSpectrum()
 {
+    invalidateEclipsePrecomputations();
     // Simple clear() won't work because we want to reset the uniform in the programs where it's been already altered
     std::fill(solarIrradianceFixup_.begin(), solarIrradianceFixup_.end(), QVector4D(1,1,1,1));
 }
@@ -1468,6 +1789,39 @@ void AtmosphereRenderer::prepareRadianceFrames(const bool clear)
     }
 }
 
+unsigned AtmosphereRenderer::renderingBatchCount() const
+{
+    return (params_.allWavelengths.size()+wavelengthSetsPerRenderingBatch-1)/wavelengthSetsPerRenderingBatch;
+}
+
+// Luminance goes to the first draw buffer, and radiances of the wavelength sets of the batch to the following ones
+void AtmosphereRenderer::prepareBatchedRadianceFrames(const unsigned firstWLSet, const unsigned wlSetCount)
+{
+    if(radianceRenderBuffers_.empty()) return;
+
+    std::vector<GLenum> drawBuffers{GL_COLOR_ATTACHMENT0};
+    for(unsigned i=0; i<wlSetCount; ++i)
+    {
+        gl.glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1+i, GL_RENDERBUFFER, radianceRenderBuffers_[firstWLSet+i]);
+        drawBuffers.push_back(GL_COLOR_ATTACHMENT1+i);
+        gl.glEnablei(GL_BLEND, 1+i);
+    }
+    gl.glDrawBuffers(drawBuffers.size(), drawBuffers.data());
+}
+
+// Returns to the layout of the per-wavelength-set passes, where the radiance goes to the second draw buffer
+void AtmosphereRenderer::finishBatchedRadianceFrames()
+{
+    if(radianceRenderBuffers_.empty()) return;
+
+    for(unsigned i=1; i<wavelengthSetsPerRenderingBatch; ++i)
+    {
+        gl.glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1+i, GL_RENDERBUFFER, 0);
+        gl.glDisablei(GL_BLEND, 1+i);
+    }
+    gl.glDrawBuffers(2, std::array<GLenum,2>{GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1}.data());
+}
+
 bool AtmosphereRenderer::canGrabRadiance() const
 {
     const bool haveNoLuminanceOnlySingleScatteringTextures =
@@ -1486,6 +1840,10 @@ bool AtmosphereRenderer::canRenderPrecomputedEclipsedDoubleScattering() const
     return !params_.noEclipsedDoubleScatteringTextures;
 }
 
+// Unlike the precomputed scattering passes, zero-order scattering has no batched shaders, and in radiance mode
+// takes a pass per wavelength set. It samples the transmittance and irradiance textures of the current set through
+// the sampling functions shared with the precomputation shaders, which would need per-set sampler variants.
+// Eclipsed single scattering and single scattering with interpolation guides are also rendered per set.
 void AtmosphereRenderer::renderZeroOrderScattering()
 {
     OGL_TRACE();
@@ -1534,8 +1892,16 @@ void AtmosphereRenderer::precomputeEclipsedSingleScattering()
 {
     OGL_TRACE();
 
+    const auto geometry=currentEclipseGeometry();
+    if(tools_->eclipsePrecomputationCacheSize() && eclipsedSingleScatteringGeometry_ &&
+       eclipseGeometriesMatch(*eclipsedSingleScatteringGeometry_, geometry))
+    {
+        ++eclipseCacheStats_.singleScatteringHits;
+        return;
+    }
+    ++eclipseCacheStats_.singleScatteringMisses;
+
     gl.glBindVertexArray(vao_);
-    // TODO: avoid redoing it if Sun elevation and Moon elevation and relative azimuth haven't changed
     for(const auto& scatterer : params_.scatterers)
     {
         auto& textures=eclipsedSingleScatteringPrecomputationTextures_[scatterer.name];
@@ -1568,6 +1934,7 @@ void AtmosphereRenderer::precomputeEclipsedSingleScattering()
     gl.glBindVertexArray(0);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,luminanceRadianceFBO_);
     gl.glEnablei(GL_BLEND, 0);
+    eclipsedSingleScatteringGeometry_=geometry;
 }
 
 void AtmosphereRenderer::renderSingleScattering()
@@ -1658,6 +2025,13 @@ void AtmosphereRenderer::renderSingleScattering()
                     drawSurface(prog);
                 }
             }
+            else if(singleScatteringBatchedPrograms_.count(scatterer.name) &&
+                    // Batched shaders don't use interpolation guides
+                    !(singleScatteringInterpolationGuidesTextures01_.count(scatterer.name) &&
+                      singleScatteringInterpolationGuidesTextures02_.count(scatterer.name)))
+            {
+                renderSingleScatteringBatched(scatterer.name);
+            }
             else
             {
                 for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
@@ -1677,6 +2051,7 @@ void AtmosphereRenderer::renderSingleScattering()
                         tex.bind(0);
                         prog.setUniformValue("scatteringTexture", 0);
                     }
+                    prog.setUniformValue("altitudeSliceMixFactor", altitudeSliceMixFactor());
 
                     bool guides01Loaded = false, guides02Loaded = false;
                     {
@@ -1723,6 +2098,7 @@ void AtmosphereRenderer::renderSingleScattering()
                 tex.bind(0);
             }
             prog.setUniformValue("scatteringTexture", 0);
+            prog.setUniformValue("altitudeSliceMixFactor", altitudeSliceMixFactor());
             prog.setUniformValue("pseudoMirrorSkyBelowHorizon", tools_->pseudoMirrorEnabled());
 
             bool guides01Loaded = false, guides02Loaded = false;
@@ -1771,17 +2147,78 @@ void AtmosphereRenderer::renderSingleScattering()
     }
 }
 
+void AtmosphereRenderer::dropPendingEclipsedDoubleScattering()
+{
+    if(!pendingEclipsedDoubleScattering_) return;
+    // Precomputers restore the viewport they found when created, which may be stale by now
+    GLint viewport[4];
+    gl.glGetIntegerv(GL_VIEWPORT, viewport);
+    pendingEclipsedDoubleScattering_.reset();
+    gl.glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
 void AtmosphereRenderer::precomputeEclipsedDoubleScattering()
 {
-    // TODO: avoid redoing it if Sun elevation and Moon elevation and relative azimuth haven't changed
+    if(pendingEclipsedDoubleScattering_ && pendingEclipsedDoubleScattering_->generation != eclipsePrecomputationGeneration_)
+        dropPendingEclipsedDoubleScattering();
+
+    const auto geometry=currentEclipseGeometry();
+    const auto cacheSize=tools_->eclipsePrecomputationCacheSize();
+    const auto cached=std::find_if(eclipsedDoubleScatteringCache_.begin(), eclipsedDoubleScatteringCache_.end(),
+                                   [&](auto const& entry){ return eclipseGeometriesMatch(entry.geometry, geometry); });
+    if(cacheSize && cached!=eclipsedDoubleScatteringCache_.end())
+    {
+        ++eclipseCacheStats_.doubleScatteringHits;
+        // The front entry is already in the textures
+        if(cached==eclipsedDoubleScatteringCache_.begin())
+            return;
+        eclipsedDoubleScatteringCache_.splice(eclipsedDoubleScatteringCache_.begin(), eclipsedDoubleScatteringCache_, cached);
+        uploadEclipsedDoubleScatteringTextures(cached->targetTexturesData);
+        return;
+    }
+
+    // A computation started in a previous frame is finished first, even if the geometry has changed since then:
+    // during an animation, restarting it would never let it complete.
+    if(!pendingEclipsedDoubleScattering_)
+    {
+        ++eclipseCacheStats_.doubleScatteringMisses;
+        pendingEclipsedDoubleScattering_=std::make_unique<PendingEclipsedDoubleScattering>();
+        pendingEclipsedDoubleScattering_->entry.geometry=geometry;
+        pendingEclipsedDoubleScattering_->generation=eclipsePrecomputationGeneration_;
+    }
+
+    // Until the first computation completes there's no previous texture to render, so it has to be done at once
+    const auto budget=tools_->eclipsedDoubleScatteringPrecomputationBudget();
+    if(budget>0 && eclipsedDoubleScatteringTexturesValid_)
+        stepEclipsedDoubleScatteringPrecomputation(budget);
+    else
+        stepEclipsedDoubleScatteringPrecomputation(INFINITY);
+}
+
+void AtmosphereRenderer::stepEclipsedDoubleScatteringPrecomputation(const double budgetMilliseconds)
+{
+    auto& pending=*pendingEclipsedDoubleScattering_;
+    const auto& geometry=pending.entry.geometry;
+    const bool limitedTime=std::isfinite(budgetMilliseconds);
+    // The whole step is timed on the CPU clock: besides the sampling, it includes the conversion to luminance and
+    // the reconstruction of the texture from the coarse grid, which run on the CPU. Timer queries wouldn't see
+    // this work, and GL_TIME_ELAPSED ones would also conflict with a query the application may have around draw().
+    using Clock=std::chrono::steady_clock;
+    const auto stepStart=Clock::now();
+    const auto millisecondsSince=[](const Clock::time_point start)
+                                 { return std::chrono::duration<double,std::milli>(Clock::now()-start).count(); };
 
+    GLint viewport[4];
+    gl.glGetIntegerv(GL_VIEWPORT, viewport);
     gl.glBindFramebuffer(GL_FRAMEBUFFER, eclipseDoubleScatteringPrecomputationFBO_);
     gl.glDisablei(GL_BLEND, 0);
     gl.glBindVertexArray(vao_);
     const bool renderingNeedsLuminance = !canGrabRadiance();
-    std::unique_ptr<EclipsedDoubleScatteringPrecomputer> precompAccumulator;
-    for(unsigned wlSetIndex=0; wlSetIndex<params_.allWavelengths.size(); ++wlSetIndex)
+    bool anythingDone=false;
+    bool complete=false;
+    while(!complete)
     {
+        const auto wlSetIndex=pending.wlSetIndex;
         auto& prog=*eclipsedDoubleScatteringPrecomputationPrograms_[wlSetIndex];
         prog.bind();
         int unusedTextureUnitNum=0;
@@ -1789,45 +2226,121 @@ void AtmosphereRenderer::precomputeEclipsedDoubleScattering()
         prog.setUniformValue("transmittanceTexture", unusedTextureUnitNum++);
         if(!solarIrradianceFixup_.empty())
             prog.setUniformValue("solarIrradianceFixup", solarIrradianceFixup_[wlSetIndex]);
-        prog.setUniformValue("sunAngularRadius", float(tools_->sunAngularRadius()));
+        prog.setUniformValue("sunAngularRadius", float(geometry.sunAngularRadius));
+
+        if(!pending.precomputer)
+        {
+            pending.precomputer = std::make_unique<EclipsedDoubleScatteringPrecomputer>(gl,
+                                                            params_,
+                                                            params_.eclipsedDoubleScatteringTextureSize[0],
+                                                            params_.eclipsedDoubleScatteringTextureSize[1], 1, 1);
+            pending.precomputer->beginCoarseGridComputation(geometry.altitude, geometry.sunZenithAngle, geometry.moonZenithAngle,
+                                                            geometry.moonRelativeAzimuth, geometry.earthMoonDistance);
+        }
+        auto& precomputer=*pending.precomputer;
+
+        if(!limitedTime)
+        {
+            precomputer.computeCoarseGridSamples(prog, *eclipsedDoubleScatteringSamplesReducer_, unusedTextureUnitNum,
+                                                 precomputer.coarseGridSampleCount());
+        }
+        else if(precomputer.coarseGridSamplesDone() < precomputer.coarseGridSampleCount())
+        {
+            // At least one sample per frame, so that the computation does progress
+            const auto millisecondsLeft=budgetMilliseconds-millisecondsSince(stepStart);
+            if(anythingDone && millisecondsLeft < eclipsedDoubleScatteringMillisecondsPerSample_)
+                break;
+            const auto sampleCount = eclipsedDoubleScatteringMillisecondsPerSample_>0 ?
+                                        std::max(size_t(1), size_t(std::max(0., millisecondsLeft)/eclipsedDoubleScatteringMillisecondsPerSample_)) : 1;
+            const auto samplesBefore=precomputer.coarseGridSamplesDone();
+            const auto samplingStart=Clock::now();
+            precomputer.computeCoarseGridSamples(prog, *eclipsedDoubleScatteringSamplesReducer_, unusedTextureUnitNum, sampleCount);
+            // The samples have been read back, so the GPU work is finished and included in the measured time
+            const auto milliseconds=millisecondsSince(samplingStart);
+            anythingDone=true;
+            const auto samplesDone=precomputer.coarseGridSamplesDone()-samplesBefore;
+            const auto msPerSample=milliseconds/samplesDone;
+            eclipsedDoubleScatteringMillisecondsPerSample_ = eclipsedDoubleScatteringMillisecondsPerSample_>0 ?
+                                    (eclipsedDoubleScatteringMillisecondsPerSample_+msPerSample)/2 : msPerSample;
+        }
+        if(precomputer.coarseGridSamplesDone() < precomputer.coarseGridSampleCount())
+            continue;
+
+        const bool lastWavelengthSet = wlSetIndex+1 == params_.allWavelengths.size();
+        const bool generatingTexture = !renderingNeedsLuminance || lastWavelengthSet;
+        if(limitedTime && anythingDone)
+        {
+            // The sampled data are kept, so the rest of the work on this wavelength set can be done in the next frame
+            const auto millisecondsNeeded = (renderingNeedsLuminance ? eclipsedDoubleScatteringMillisecondsPerLuminanceConversion_ : 0)
+                                          + (generatingTexture ? eclipsedDoubleScatteringMillisecondsPerTextureGeneration_ : 0);
+            if(budgetMilliseconds-millisecondsSince(stepStart) < millisecondsNeeded)
+                break;
+        }
 
-        auto precomputer = std::make_unique<EclipsedDoubleScatteringPrecomputer>(gl,
-                                                        params_,
-                                                        params_.eclipsedDoubleScatteringTextureSize[0],
-                                                        params_.eclipsedDoubleScatteringTextureSize[1], 1, 1);
-        precomputer->computeRadianceOnCoarseGrid(prog, eclipsedDoubleScatteringPrecomputationScratchTexture_->textureId(),
-                                                 unusedTextureUnitNum, tools_->altitude(), tools_->sunZenithAngle(),
-                                                 tools_->moonZenithAngle(), tools_->moonAzimuth() - tools_->sunAzimuth(),
-                                                 tools_->earthMoonDistance());
         if(renderingNeedsLuminance)
         {
+            const auto conversionStart=Clock::now();
             const auto rad2lum = radianceToLuminance(wlSetIndex, params_.allWavelengths);
             if(wlSetIndex==0)
             {
-                precompAccumulator = std::move(precomputer);
-                precompAccumulator->convertRadianceToLuminance(rad2lum);
+                pending.accumulator = std::move(pending.precomputer);
+                pending.accumulator->convertRadianceToLuminance(rad2lum);
             }
             else
             {
-                precompAccumulator->accumulateLuminance(*precomputer, rad2lum);
+                pending.accumulator->accumulateLuminance(precomputer, rad2lum);
             }
+            eclipsedDoubleScatteringMillisecondsPerLuminanceConversion_ = millisecondsSince(conversionStart);
         }
 
-        if(!renderingNeedsLuminance || wlSetIndex+1 == params_.allWavelengths.size())
+        complete = lastWavelengthSet;
+        if(generatingTexture)
         {
-            auto& generator = renderingNeedsLuminance ? *precompAccumulator : *precomputer;
-            generator.generateTextureFromCoarseGridData(0, 0, tools_->altitude());
-            eclipsedDoubleScatteringPrecomputationTargetTextures_[renderingNeedsLuminance ? 0 : wlSetIndex]->bind();
-            gl.glTexImage3D(GL_TEXTURE_3D,0,GL_RGBA32F,
-                            params_.eclipsedDoubleScatteringTextureSize[0], params_.eclipsedDoubleScatteringTextureSize[1], 1,
-                            0,GL_RGBA,GL_FLOAT,generator.texture().data());
+            const auto generationStart=Clock::now();
+            auto& generator = renderingNeedsLuminance ? *pending.accumulator : precomputer;
+            generator.generateTextureFromCoarseGridData(0, 0, geometry.altitude);
+            pending.entry.targetTexturesData.push_back(generator.texture());
+            eclipsedDoubleScatteringMillisecondsPerTextureGeneration_ = millisecondsSince(generationStart);
         }
+        anythingDone=true;
+        pending.precomputer.reset();
+        ++pending.wlSetIndex;
     }
     gl.glBindVertexArray(0);
+
+    if(complete)
+    {
+        uploadEclipsedDoubleScatteringTextures(pending.entry.targetTexturesData);
+        eclipsedDoubleScatteringTexturesValid_=true;
+        if(const auto cacheSize=tools_->eclipsePrecomputationCacheSize())
+        {
+            eclipsedDoubleScatteringCache_.push_front(std::move(pending.entry));
+            if(eclipsedDoubleScatteringCache_.size() > cacheSize)
+                eclipsedDoubleScatteringCache_.resize(cacheSize);
+        }
+        else
+        {
+            eclipsedDoubleScatteringCache_.clear();
+        }
+        pendingEclipsedDoubleScattering_.reset();
+    }
+
+    gl.glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
     gl.glBindFramebuffer(GL_FRAMEBUFFER,luminanceRadianceFBO_);
     gl.glEnablei(GL_BLEND, 0);
 }
 
+void AtmosphereRenderer::uploadEclipsedDoubleScatteringTextures(std::vector<std::vector<glm::vec4>> const& data)
+{
+    for(unsigned i=0; i<data.size(); ++i)
+    {
+        eclipsedDoubleScatteringPrecomputationTargetTextures_[i]->bind();
+        gl.glTexImage3D(GL_TEXTURE_3D,0,GL_RGBA32F,
+                        params_.eclipsedDoubleScatteringTextureSize[0], params_.eclipsedDoubleScatteringTextureSize[1], 1,
+                        0,GL_RGBA,GL_FLOAT,data[i].data());
+    }
+}
+
 void AtmosphereRenderer::renderMultipleScattering()
 {
     OGL_TRACE();
@@ -1837,6 +2350,11 @@ void AtmosphereRenderer::renderMultipleScattering()
     {
         if(tools_->onTheFlyPrecompDoubleScatteringEnabled())
             precomputeEclipsedDoubleScattering();
+        if(!eclipsedDoubleScatteringPrecomputedBatchedPrograms_.empty())
+        {
+            renderEclipsedDoubleScatteringBatched();
+            return;
+        }
         for(unsigned wlSetIndex=0; wlSetIndex < eclipsedDoubleScatteringPrecomputedPrograms_.size(); ++wlSetIndex)
         {
             if(!radianceRenderBuffers_.empty())
@@ -1861,6 +2379,7 @@ void AtmosphereRenderer::renderMultipleScattering()
                 prog.setUniformValue("eclipsedDoubleScatteringTexture", 0);
                 prog.setUniformValue("eclipsedDoubleScatteringTextureSize", QVector3D(params_.eclipsedDoubleScatteringTextureSize[0],
                                                                                       params_.eclipsedDoubleScatteringTextureSize[1], 1));
+                prog.setUniformValue("eclipsedDoubleScatteringHasAltitudeSlicePair", false);
             }
             else
             {
@@ -1873,10 +2392,16 @@ void AtmosphereRenderer::renderMultipleScattering()
                 prog.setUniformValue("eclipsedDoubleScatteringTexture", 0);
 
                 prog.setUniformValue("eclipsedDoubleScatteringTextureSize", toQVector(glm::vec3(params_.eclipsedDoubleScatteringTextureSize)));
+                prog.setUniformValue("eclipsedDoubleScatteringHasAltitudeSlicePair", true);
+                prog.setUniformValue("altitudeSliceMixFactor", altitudeSliceMixFactor());
             }
             drawSurface(prog);
         }
     }
+    else if(!multipleScatteringBatchedPrograms_.empty())
+    {
+        renderMultipleScatteringBatched();
+    }
     else
     {
         for(unsigned wlSetIndex = 0; wlSetIndex < multipleScatteringTextures_.size(); ++wlSetIndex)
@@ -1898,15 +2423,145 @@ void AtmosphereRenderer::renderMultipleScattering()
             tex.setMagnificationFilter(texFilter);
             tex.bind(0);
             prog.setUniformValue("scatteringTexture", 0);
+            prog.setUniformValue("altitudeSliceMixFactor", altitudeSliceMixFactor());
             drawSurface(prog);
         }
     }
 }
 
+void AtmosphereRenderer::renderSingleScatteringBatched(ScattererName const& scattererName)
+{
+    OGL_TRACE();
+
+    const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
+    const auto& programs=singleScatteringBatchedPrograms_.at(scattererName);
+    const auto& textures=singleScatteringTextures_.at(scattererName);
+    for(unsigned batchIndex = 0; batchIndex < programs.size(); ++batchIndex)
+    {
+        const unsigned firstWLSet = batchIndex*wavelengthSetsPerRenderingBatch;
+        const unsigned wlSetCount = std::min<unsigned>(wavelengthSetsPerRenderingBatch, textures.size()-firstWLSet);
+        prepareBatchedRadianceFrames(firstWLSet, wlSetCount);
+
+        auto& prog=*programs[batchIndex];
+        prog.bind();
+        prog.setUniformValue("cameraPosition", toQVector(cameraPosition()));
+        prog.setUniformValue("sunDirection", toQVector(sunDirection()));
+        prog.setUniformValue("sunAngularRadius", float(tools_->sunAngularRadius()));
+        prog.setUniformValue("pseudoMirrorSkyBelowHorizon", tools_->pseudoMirrorEnabled());
+
+        std::vector<GLint> textureUnits;
+        std::vector<QVector4D> solarIrradianceFixups;
+        for(unsigned i = 0; i < wlSetCount; ++i)
+        {
+            auto& tex=*textures[firstWLSet+i];
+            tex.setMinificationFilter(texFilter);
+            tex.setMagnificationFilter(texFilter);
+            tex.bind(i);
+            textureUnits.push_back(i);
+            solarIrradianceFixups.push_back(solarIrradianceFixup_.empty() ? QVector4D(1,1,1,1) : solarIrradianceFixup_[firstWLSet+i]);
+        }
+        prog.setUniformValueArray("scatteringTextures", textureUnits.data(), wlSetCount);
+        prog.setUniformValue("altitudeSliceMixFactor", altitudeSliceMixFactor());
+        prog.setUniformValueArray("solarIrradianceFixups", solarIrradianceFixups.data(), wlSetCount);
+        drawSurface(prog);
+    }
+    finishBatchedRadianceFrames();
+}
+
+void AtmosphereRenderer::renderMultipleScatteringBatched()
+{
+    OGL_TRACE();
+
+    const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
+    for(unsigned batchIndex = 0; batchIndex < multipleScatteringBatchedPrograms_.size(); ++batchIndex)
+    {
+        const unsigned firstWLSet = batchIndex*wavelengthSetsPerRenderingBatch;
+        const unsigned wlSetCount = std::min<unsigned>(wavelengthSetsPerRenderingBatch, multipleScatteringTextures_.size()-firstWLSet);
+        prepareBatchedRadianceFrames(firstWLSet, wlSetCount);
+
+        auto& prog=*multipleScatteringBatchedPrograms_[batchIndex];
+        prog.bind();
+        prog.setUniformValue("cameraPosition", toQVector(cameraPosition()));
+        prog.setUniformValue("sunDirection", toQVector(sunDirection()));
+        prog.setUniformValue("sunAngularRadius", float(tools_->sunAngularRadius()));
+        prog.setUniformValue("pseudoMirrorSkyBelowHorizon", tools_->pseudoMirrorEnabled());
+
+        std::vector<GLint> textureUnits;
+        std::vector<QVector4D> solarIrradianceFixups;
+        for(unsigned i = 0; i < wlSetCount; ++i)
+        {
+            auto& tex=*multipleScatteringTextures_[firstWLSet+i];
+            tex.setMinificationFilter(texFilter);
+            tex.setMagnificationFilter(texFilter);
+            tex.bind(i);
+            textureUnits.push_back(i);
+            solarIrradianceFixups.push_back(solarIrradianceFixup_.empty() ? QVector4D(1,1,1,1) : solarIrradianceFixup_[firstWLSet+i]);
+        }
+        prog.setUniformValueArray("scatteringTextures", textureUnits.data(), wlSetCount);
+        prog.setUniformValue("altitudeSliceMixFactor", altitudeSliceMixFactor());
+        prog.setUniformValueArray("solarIrradianceFixups", solarIrradianceFixups.data(), wlSetCount);
+        drawSurface(prog);
+    }
+    finishBatchedRadianceFrames();
+}
+
+void AtmosphereRenderer::renderEclipsedDoubleScatteringBatched()
+{
+    OGL_TRACE();
+
+    const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
+    const bool onTheFly = tools_->onTheFlyPrecompDoubleScatteringEnabled();
+    assert(onTheFly || !params_.noEclipsedDoubleScatteringTextures);
+    for(unsigned batchIndex = 0; batchIndex < eclipsedDoubleScatteringPrecomputedBatchedPrograms_.size(); ++batchIndex)
+    {
+        const unsigned firstWLSet = batchIndex*wavelengthSetsPerRenderingBatch;
+        const unsigned wlSetCount = std::min<unsigned>(wavelengthSetsPerRenderingBatch, params_.allWavelengths.size()-firstWLSet);
+        prepareBatchedRadianceFrames(firstWLSet, wlSetCount);
+
+        auto& prog=*eclipsedDoubleScatteringPrecomputedBatchedPrograms_[batchIndex];
+        prog.bind();
+        prog.setUniformValue("cameraPosition", toQVector(cameraPosition()));
+        prog.setUniformValue("sunDirection", toQVector(sunDirection()));
+        prog.setUniformValue("sunAngularRadius", float(tools_->sunAngularRadius()));
+        prog.setUniformValue("pseudoMirrorSkyBelowHorizon", tools_->pseudoMirrorEnabled());
+
+        std::vector<GLint> textureUnits;
+        std::vector<QVector4D> solarIrradianceFixups;
+        for(unsigned i = 0; i < wlSetCount; ++i)
+        {
+            // With on-the-fly precomputation the same texture is used for upper and lower slices
+            auto& tex = onTheFly ? *eclipsedDoubleScatteringPrecomputationTargetTextures_[firstWLSet+i]
+                                 : *eclipsedDoubleScatteringTextures_[firstWLSet+i];
+            tex.setMinificationFilter(texFilter);
+            tex.setMagnificationFilter(texFilter);
+            tex.bind(i);
+            textureUnits.push_back(i);
+            solarIrradianceFixups.push_back(solarIrradianceFixup_.empty() ? QVector4D(1,1,1,1) : solarIrradianceFixup_[firstWLSet+i]);
+        }
+        prog.setUniformValueArray("eclipsedDoubleScatteringTextures", textureUnits.data(), wlSetCount);
+        prog.setUniformValueArray("solarIrradianceFixups", solarIrradianceFixups.data(), wlSetCount);
+        prog.setUniformValue("eclipsedDoubleScatteringHasAltitudeSlicePair", !onTheFly);
+        prog.setUniformValue("altitudeSliceMixFactor", altitudeSliceMixFactor());
+        if(onTheFly)
+            prog.setUniformValue("eclipsedDoubleScatteringTextureSize", QVector3D(params_.eclipsedDoubleScatteringTextureSize[0],
+                                                                                  params_.eclipsedDoubleScatteringTextureSize[1], 1));
+        else
+            prog.setUniformValue("eclipsedDoubleScatteringTextureSize", toQVector(glm::vec3(params_.eclipsedDoubleScatteringTextureSize)));
+        drawSurface(prog);
+    }
+    finishBatchedRadianceFrames();
+}
+
 void AtmosphereRenderer::renderLightPollution()
 {
     OGL_TRACE();
 
+    if(!lightPollutionBatchedPrograms_.empty())
+    {
+        renderLightPollutionBatched();
+        return;
+    }
+
     const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
 
     for(unsigned wlSetIndex = 0; wlSetIndex < lightPollutionPrograms_.size(); ++wlSetIndex)
@@ -1933,6 +2588,40 @@ void AtmosphereRenderer::renderLightPollution()
     }
 }
 
+void AtmosphereRenderer::renderLightPollutionBatched()
+{
+    OGL_TRACE();
+
+    const auto texFilter = tools_->textureFilteringEnabled() ? QOpenGLTexture::Linear : QOpenGLTexture::Nearest;
+    for(unsigned batchIndex = 0; batchIndex < lightPollutionBatchedPrograms_.size(); ++batchIndex)
+    {
+        const unsigned firstWLSet = batchIndex*wavelengthSetsPerRenderingBatch;
+        const unsigned wlSetCount = std::min<unsigned>(wavelengthSetsPerRenderingBatch, lightPollutionTextures_.size()-firstWLSet);
+        prepareBatchedRadianceFrames(firstWLSet, wlSetCount);
+
+        auto& prog=*lightPollutionBatchedPrograms_[batchIndex];
+        prog.bind();
+        prog.setUniformValue("cameraPosition", toQVector(cameraPosition()));
+        prog.setUniformValue("sunDirection", toQVector(sunDirection()));
+        prog.setUniformValue("sunAngularRadius", float(tools_->sunAngularRadius()));
+        prog.setUniformValue("pseudoMirrorSkyBelowHorizon", tools_->pseudoMirrorEnabled());
+
+        std::vector<GLint> textureUnits;
+        for(unsigned i = 0; i < wlSetCount; ++i)
+        {
+            auto& tex=*lightPollutionTextures_[firstWLSet+i];
+            tex.setMinificationFilter(texFilter);
+            tex.setMagnificationFilter(texFilter);
+            tex.bind(i);
+            textureUnits.push_back(i);
+        }
+        prog.setUniformValueArray("lightPollutionScatteringTextures", textureUnits.data(), wlSetCount);
+        prog.setUniformValue("lightPollutionGroundLuminance", float(tools_->lightPollutionGroundLuminance()));
+        drawSurface(prog);
+    }
+    finishBatchedRadianceFrames();
+}
+
 int AtmosphereRenderer::initPreparationToDraw()
 {
     OGL_TRACE();
@@ -1942,10 +2631,12 @@ int AtmosphereRenderer::initPreparationToDraw()
     if(state_ != State::ReadyToRender) return -1;
 
     const auto altCoord=altitudeUnitRangeTexCoord();
-    if(altCoord != altCoordToLoad_)
+    if(altitudeChangeNeedsReloading(altCoord))
     {
         [[maybe_unused]] OGLTrace t("reloading textures");
 
+        altitudeChangeDirection_ = altCoord > altCoordToLoad_ ? 1 : -1;
+        altitudeSliceCache_.setBudget(size_t(tools_->altitudeSliceCacheBudget())*1024*1024);
         altCoordToLoad_ = altCoord;
         state_ = State::ReloadingTextures;
         currentActivity_=QObject::tr("Reloading textures due to altitude change...");
@@ -1965,7 +2656,7 @@ auto AtmosphereRenderer::stepPreparationToDraw() -> LoadingStatus
         return {0, -1};
 
     const auto altCoord=altitudeUnitRangeTexCoord();
-    if(altCoord != altCoordToLoad_)
+    if(altitudeChangeNeedsReloading(altCoord))
     {
         std::cerr << "While we were reloading textures, the requested altitude changed again "
                      "(loaded coordinate: " << altCoordToLoad_ << ", requested: " << altCoord
@@ -1978,7 +2669,11 @@ auto AtmosphereRenderer::stepPreparationToDraw() -> LoadingStatus
     reloadScatteringTextures(CountStepsOnly{false});
 
     if(loadingStepsDone_ == totalLoadingStepsToDo_)
+    {
         finalizeLoading();
+        keepEclipsePrecomputationsAfterAltitudeReload();
+        altitudeSliceCache_.prefetchNeighbours(altitudeChangeDirection_);
+    }
 
     return {loadingStepsDone_, totalLoadingStepsToDo_};
 }
@@ -2085,14 +2780,9 @@ void AtmosphereRenderer::setupRenderTarget()
     }
 
     gl.glGenFramebuffers(1,&eclipseDoubleScatteringPrecomputationFBO_);
-    eclipsedDoubleScatteringPrecomputationScratchTexture_=newTex(QOpenGLTexture::Target2D);
-    eclipsedDoubleScatteringPrecomputationScratchTexture_->create();
-    eclipsedDoubleScatteringPrecomputationScratchTexture_->bind();
-    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,
-                    params_.eclipseAngularIntegrationPoints, params_.radialIntegrationPoints,
-                    0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+    eclipsedDoubleScatteringSamplesReducer_=std::make_unique<EclipsedDoubleScatteringSamplesReducer>(gl, params_);
     gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, eclipseDoubleScatteringPrecomputationFBO_);
-    gl.glFramebufferTexture(GL_DRAW_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,eclipsedDoubleScatteringPrecomputationScratchTexture_->textureId(),0);
+    eclipsedDoubleScatteringSamplesReducer_->setRenderTarget(0);
     checkFramebufferStatus(gl, "Eclipsed double scattering precomputation FBO");
     gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, origFBO);
 
@@ -2129,6 +2819,7 @@ int AtmosphereRenderer::initDataLoading(QByteArray viewDirVertShaderSrc, QByteAr
         totalLoadingStepsToDo_=0;
 
         clearResources();
+        altitudeSliceCache_.setBudget(size_t(tools_->altitudeSliceCacheBudget())*1024*1024);
 
         viewDirVertShaderSrc_=std::move(viewDirVertShaderSrc);
         viewDirFragShaderSrc_=std::move(viewDirFragShaderSrc);
@@ -2181,7 +2872,11 @@ auto AtmosphereRenderer::stepDataLoading() -> LoadingStatus
                               .arg(multipleScatteringTextures_.size())};
     }
 
+    // New textures and shaders may give different results for the same geometry
+    invalidateEclipsePrecomputations();
     finalizeLoading();
+    // The direction of the first altitude change is unknown, so both neighbours are prefetched
+    altitudeSliceCache_.prefetchNeighbours(0);
     return {loadingStepsDone_, totalLoadingStepsToDo_};
 }
 
@@ -2190,6 +2885,8 @@ void AtmosphereRenderer::finalizeLoading()
     currentActivity_.clear();
     totalLoadingStepsToDo_=0;
     loadingStepsDone_=0;
+    // Reads left over from an interrupted loading are for outdated data
+    abandonTextureReads();
     state_ = State::ReadyToRender;
 }
 
@@ -2222,6 +2919,12 @@ void AtmosphereRenderer::clearResources()
     }
     if(!radianceRenderBuffers_.empty())
         gl.glDeleteRenderbuffers(radianceRenderBuffers_.size(), radianceRenderBuffers_.data());
+    dropPendingEclipsedDoubleScattering();
+    eclipsedDoubleScatteringSamplesReducer_.reset();
+    // The reads use params_ and altitudeSliceCache_, so they must finish before these are changed or destroyed
+    abandonTextureReads();
+    abandonedTextureReads_.clear();
+    altitudeSliceCache_.clear();
 }
 
 void AtmosphereRenderer::drawSurface(QOpenGLShaderProgram& prog)
@@ -2303,7 +3006,10 @@ auto AtmosphereRenderer::stepShaderReloading() -> LoadingStatus
     loadShaders(CountStepsOnly{false});
 
     if(loadingStepsDone_ == totalLoadingStepsToDo_)
+    {
+        invalidateEclipsePrecomputations();
         finalizeLoading();
+    }
 
     return {loadingStepsDone_, totalLoadingStepsToDo_};
 }
@@ -3,8 +3,13 @@
 
 #include <cmath>
 #include <array>
+#include <list>
 #include <deque>
+#include <atomic>
 #include <memory>
+#include <future>
+#include <optional>
+#include <functional>
 #include <glm/glm.hpp>
 #include <QObject>
 #include <QOpenGLTexture>
@@ -12,8 +17,11 @@
 #include <QOpenGLFunctions_3_3_Core>
 #include "../common/types.hpp"
 #include "../common/AtmosphereParameters.hpp"
+#include "AltitudeSliceCache.hpp"
 #include "api/ShowMySky/AtmosphereRenderer.hpp"
 
+class EclipsedDoubleScatteringSamplesReducer;
+class EclipsedDoubleScatteringPrecomputer;
 class AtmosphereRenderer : public ShowMySky::AtmosphereRenderer
 {
     using ShaderProgPtr=std::unique_ptr<QOpenGLShaderProgram>;
@@ -67,6 +75,7 @@ public:
     void setSolarSpectrum(std::vector<float> const& solarIrradianceAtTOA) override;
     void resetSolarSpectrum() override;
     Direction getViewDirection(QPoint const& pixelPos) override;
+    EclipsePrecomputationCacheStats eclipsePrecomputationCacheStats() const override { return eclipseCacheStats_; }
 
     void setScattererEnabled(QString const& name, bool enable) override;
     int initShaderReloading() override;
@@ -100,7 +109,7 @@ private: // variables
     // Indexed as singleScatteringTextures_[scattererName][wavelengthSetIndex]
     std::map<ScattererName,std::vector<TexturePtr>> singleScatteringTextures_;
     std::map<ScattererName,std::vector<TexturePtr>> eclipsedSingleScatteringPrecomputationTextures_;
-    TexturePtr eclipsedDoubleScatteringPrecomputationScratchTexture_;
+    std::unique_ptr<EclipsedDoubleScatteringSamplesReducer> eclipsedDoubleScatteringSamplesReducer_;
     std::vector<TexturePtr> eclipsedDoubleScatteringPrecomputationTargetTextures_;
     QOpenGLTexture luminanceRenderTargetTexture_;
     QSize viewportSize_;
@@ -116,6 +125,12 @@ private: // variables
     std::vector<std::unique_ptr<ScatteringProgramsMap>> eclipsedSingleScatteringPrograms_;
     std::vector<ShaderProgPtr> eclipsedDoubleScatteringPrecomputedPrograms_;
     std::vector<ShaderProgPtr> eclipsedDoubleScatteringPrecomputationPrograms_;
+    // Indexed by batch of wavelength sets, see renderingBatchCount(). Empty if the model has no batched shaders.
+    std::vector<ShaderProgPtr> multipleScatteringBatchedPrograms_;
+    std::vector<ShaderProgPtr> eclipsedDoubleScatteringPrecomputedBatchedPrograms_;
+    std::vector<ShaderProgPtr> lightPollutionBatchedPrograms_;
+    // Indexed as singleScatteringBatchedPrograms_[scattererName][batchIndex]
+    ScatteringProgramsMap singleScatteringBatchedPrograms_;
     // Indexed as eclipsedSingleScatteringPrecomputationPrograms_[scattererName][wavelengthSetIndex]
     std::unique_ptr<ScatteringProgramsMap> eclipsedSingleScatteringPrecomputationPrograms_;
     std::unique_ptr<QOpenGLShader> precomputationProgramsVertShader_;
@@ -127,6 +142,76 @@ private: // variables
 
     int numAltIntervalsIn4DTexture_;
 
+    // Scene parameters the eclipse precomputations depend on
+    struct EclipseGeometry
+    {
+        double altitude;
+        double sunZenithAngle;
+        double moonZenithAngle;
+        double moonRelativeAzimuth;
+        double earthMoonDistance;
+        double sunAngularRadius;
+    };
+    struct EclipsedDoubleScatteringCacheEntry
+    {
+        EclipseGeometry geometry;
+        std::vector<std::vector<glm::vec4>> targetTexturesData; // indexed as eclipsedDoubleScatteringPrecomputationTargetTextures_
+    };
+    // The geometry for which eclipsedSingleScatteringPrecomputationTextures_ have been computed
+    std::optional<EclipseGeometry> eclipsedSingleScatteringGeometry_;
+    // Most recently used first. The front entry is the one uploaded to eclipsedDoubleScatteringPrecomputationTargetTextures_.
+    std::list<EclipsedDoubleScatteringCacheEntry> eclipsedDoubleScatteringCache_;
+    EclipsePrecomputationCacheStats eclipseCacheStats_;
+    // Incremented on each invalidation and altitude reload, so that a pending computation started before it can be dropped
+    unsigned eclipsePrecomputationGeneration_=0;
+    // Eclipsed double scattering computation spread over several frames, see Settings::eclipsedDoubleScatteringPrecomputationBudget()
+    struct PendingEclipsedDoubleScattering
+    {
+        EclipsedDoubleScatteringCacheEntry entry;
+        unsigned generation=0;
+        unsigned wlSetIndex=0;
+        std::unique_ptr<EclipsedDoubleScatteringPrecomputer> precomputer;
+        std::unique_ptr<EclipsedDoubleScatteringPrecomputer> accumulator; // of luminance, if rendering needs it
+    };
+    std::unique_ptr<PendingEclipsedDoubleScattering> pendingEclipsedDoubleScattering_;
+    // Whether eclipsedDoubleScatteringPrecomputationTargetTextures_ contain a complete result, possibly for an older geometry
+    bool eclipsedDoubleScatteringTexturesValid_=false;
+    // Measured durations of the parts of the computation, 0 means not measured yet
+    double eclipsedDoubleScatteringMillisecondsPerSample_=0;
+    double eclipsedDoubleScatteringMillisecondsPerLuminanceConversion_=0;
+    double eclipsedDoubleScatteringMillisecondsPerTextureGeneration_=0;
+
+    // Texture data read from a file and converted to the form to upload, which doesn't need OpenGL
+    struct TextureData
+    {
+        GLsizei width=0, height=0, depth=0; // depth is 0 for 2D textures
+        int altIntervals=0; // of the 4D texture the slice is taken from
+        std::vector<glm::vec4> rgba;
+        std::vector<int16_t> red; // interpolation guides
+        // Eclipsed double scattering is stored as a coarse grid, the texture is reconstructed from it before upload
+        unsigned pointsPerSet=0;
+        double fractAltIndex=0;
+        std::vector<double> cameraAltitudes;
+    };
+    // Raw altitude slices of the files of 4D textures, see Settings::altitudeSliceCacheBudget()
+    AltitudeSliceCache altitudeSliceCache_;
+    // Sign of the last change of the altitude texture coordinate, the direction to prefetch the slices in
+    int altitudeChangeDirection_=0;
+    // Reads scheduled by the step counting pass of loading, in the order of the loading steps. The first
+    // few are running on worker threads, so that each step only has to upload the data.
+    struct TextureRead
+    {
+        QString path;
+        std::function<TextureData()> read;
+        std::future<TextureData> result; // invalid until the read is started
+    };
+    std::deque<TextureRead> textureReads_;
+    // Set when the reads started so far become outdated, so that those still waiting for a thread return at once
+    std::shared_ptr<std::atomic<bool>> textureReadsCancelled_=std::make_shared<std::atomic<bool>>(false);
+    // Outdated reads that were still running when abandoned. Destroying a future of std::async waits for the
+    // thread, so they are kept here until they finish, instead of blocking the render loop.
+    std::vector<std::future<TextureData>> abandonedTextureReads_;
+
     enum class State
     {
         NotReady,           //!< Just constructed or failed to load data
@@ -148,11 +233,17 @@ private: // methods
     void drawSurface(QOpenGLShaderProgram& prog);
 
     double altitudeUnitRangeTexCoord() const;
+    bool altitudeChangeNeedsReloading(double altCoord) const;
+    float altitudeSliceMixFactor() const;
     double cameraMoonDistance() const;
     glm::dvec3 sunDirection() const;
     glm::dvec3 moonPosition() const;
     glm::dvec3 moonPositionRelativeToSunAzimuth() const;
     glm::dvec3 cameraPosition() const;
+    EclipseGeometry currentEclipseGeometry() const;
+    bool eclipseGeometriesMatch(EclipseGeometry const& a, EclipseGeometry const& b) const;
+    void invalidateEclipsePrecomputations();
+    void keepEclipsePrecomputationsAfterAltitudeReload();
     glm::ivec2 loadTexture2D(QString const& path);
     enum class Texture4DType
     {
@@ -161,14 +252,36 @@ private: // methods
     };
     void loadTexture4D(QString const& path, float altitudeCoord, Texture4DType texType = Texture4DType::ScatteringTexture);
     void loadEclipsedDoubleScatteringTexture(QString const& path, float altitudeCoord);
+    static TextureData readTexture2D(QString const& path);
+    DEFINE_EXPLICIT_BOOL(KeepAltitudeSlicePair);
+    static TextureData readTexture4DSlice(QString const& path, float altitudeCoord, Texture4DType texType,
+                                          KeepAltitudeSlicePair keepSlicePair, AltitudeSliceCache& cache);
+    static TextureData readEclipsedDoubleScatteringCoarseGrid(QString const& path, float altitudeCoord, AtmosphereParameters const& params,
+                                                              AltitudeSliceCache& cache);
+    void prefetchTexture2D(QString const& path);
+    void prefetchTexture4D(QString const& path, float altitudeCoord, Texture4DType texType = Texture4DType::ScatteringTexture);
+    void prefetchEclipsedDoubleScatteringTexture(QString const& path, float altitudeCoord);
+    void startTextureReads();
+    void abandonTextureReads();
+    std::optional<TextureData> takeTextureRead(QString const& path);
 
     void precomputeEclipsedSingleScattering();
     void precomputeEclipsedDoubleScattering();
+    void stepEclipsedDoubleScatteringPrecomputation(double budgetMilliseconds);
+    void uploadEclipsedDoubleScatteringTextures(std::vector<std::vector<glm::vec4>> const& data);
+    void dropPendingEclipsedDoubleScattering();
     void renderZeroOrderScattering();
     void renderSingleScattering();
+    void renderSingleScatteringBatched(ScattererName const& scattererName);
     void renderMultipleScattering();
+    void renderMultipleScatteringBatched();
+    void renderEclipsedDoubleScatteringBatched();
     void renderLightPollution();
+    void renderLightPollutionBatched();
     void prepareRadianceFrames(bool clear);
+    unsigned renderingBatchCount() const;
+    void prepareBatchedRadianceFrames(unsigned firstWLSet, unsigned wlSetCount);
+    void finishBatchedRadianceFrames();
 };
 
 #endif
@@ -75,6 +75,8 @@ public:
     bool textureFilteringEnabled() override { return textureFilteringEnabled_->isChecked(); }
     bool usingEclipseShader() override { return usingEclipseShader_->isChecked(); }
     bool pseudoMirrorEnabled() override { return pseudoMirrorEnabled_->isChecked(); }
+    unsigned eclipsePrecomputationCacheSize() override { return 8; }
+    unsigned altitudeSliceCacheBudget() override { return 256; }
     bool gradualClippingEnabled() const { return gradualClippingEnabled_->isChecked(); }
     bool glareEnabled() const { return glareEnabled_->isChecked(); }
     float exposure() const { return std::pow(10., exposure_->value()); }
@@ -69,6 +69,19 @@ public:
         int stepsToDo; //!< Total number of steps to do. Negative in case of error (e.g. when a step function was called at inappropriate moment).
     };
 
+    /**
+     * \brief Statistics of reuse of eclipse precomputations
+     *
+     * Each #draw with ShowMySky::Settings::usingEclipseShader returning \c true either reuses the results of the eclipsed scattering precomputations done for the same Sun and Moon geometry (a hit), or redoes them (a miss). See ShowMySky::Settings::eclipsePrecomputationCacheSize for details.
+     */
+    struct EclipsePrecomputationCacheStats
+    {
+        unsigned long long singleScatteringHits = 0;   //!< Number of reuses of eclipsed single scattering precomputation
+        unsigned long long singleScatteringMisses = 0; //!< Number of eclipsed single scattering precomputations done
+        unsigned long long doubleScatteringHits = 0;   //!< Number of reuses of eclipsed double scattering precomputation
+        unsigned long long doubleScatteringMisses = 0; //!< Number of eclipsed double scattering precomputations started
+    };
+
 public:
     /**
      * \brief Set the callback that will draw the screen surface.
@@ -235,6 +248,14 @@ public:
      * \return View direction of the pixel specified.
      */
     virtual Direction getViewDirection(QPoint const& pixelPos) = 0;
+    /**
+     * \brief Get statistics of reuse of eclipse precomputations.
+     *
+     * The counters accumulate since the creation of the renderer.
+     *
+     * \return Numbers of hits and misses of the cache of eclipse precomputations.
+     */
+    virtual EclipsePrecomputationCacheStats eclipsePrecomputationCacheStats() const = 0;
 
     virtual ~AtmosphereRenderer() = default;
 
@@ -288,7 +309,7 @@ SHOWMYSKY_DLL_PUBLIC ShowMySky::AtmosphereRenderer*
  *
  * If the value of the symbol doesn't match the value of this constant, the library loaded is incompatible with the header against which the binary was compiled. Mixing incompatible header and library leads to undefined behavior.
  */
-#define ShowMySky_ABI_version 14
+#define ShowMySky_ABI_version 17
 
 /**
  * \brief Name of library to be dlopen()-ed
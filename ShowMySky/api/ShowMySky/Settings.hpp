@@ -131,6 +131,60 @@ public:
      */
     virtual bool pseudoMirrorEnabled() = 0;
 
+    /**
+     * \brief Number of Sun and Moon configurations whose eclipse precomputations are kept for reuse.
+     *
+     * Eclipsed single and double scattering are precomputed for the current camera altitude, zenith angles of the Sun and the Moon, their relative azimuth, Earth-Moon distance and angular radius of the Sun. If none of these has changed since a previous precomputation, e.g. when only exposure or view direction change, its results are reused. Eclipsed double scattering results are kept for this number of the most recently used configurations, eclipsed single scattering results only for the last one. Zero disables the reuse.
+     *
+     * \returns Capacity of the cache of eclipse precomputations.
+     */
+    virtual unsigned eclipsePrecomputationCacheSize() = 0;
+    /**
+     * \brief Tolerance of angles when reusing eclipse precomputations.
+     *
+     * Zenith angles of the Sun and the Moon, their relative azimuth and angular radius of the Sun are considered unchanged if they differ from those of a previous precomputation by no more than this value. See #eclipsePrecomputationCacheSize.
+     *
+     * \returns Tolerance in radians.
+     */
+    virtual double eclipsePrecomputationAngleTolerance() { return 0; }
+    /**
+     * \brief Tolerance of camera altitude when reusing eclipse precomputations.
+     *
+     * See #eclipsePrecomputationAngleTolerance.
+     *
+     * \returns Tolerance in meters.
+     */
+    virtual double eclipsePrecomputationAltitudeTolerance() { return 0; }
+    /**
+     * \brief Tolerance of Earth-Moon distance when reusing eclipse precomputations.
+     *
+     * See #eclipsePrecomputationAngleTolerance.
+     *
+     * \returns Tolerance in meters.
+     */
+    virtual double eclipsePrecomputationMoonDistanceTolerance() { return 0; }
+    /**
+     * \brief Time budget per frame for the precomputation of eclipsed double scattering.
+     *
+     * This is a performance-quality tradeoff setting, used when #onTheFlyPrecompDoubleScatteringEnabled returns \c true.
+     *
+     * When the Sun and Moon geometry changes, the precomputation of eclipsed double scattering for the new geometry is spread over as many AtmosphereRenderer::draw calls as needed for it to take no more than this much time per call, as measured by the CPU clock and including the readback of the samples and the reconstruction of the texture on the CPU, while the result for a previous geometry is rendered meanwhile. At least one sample of the coarse grid is computed per call, so a too small budget still lets the precomputation progress. The first precomputation after loading is done in one call, since there's no previous result to render.
+     *
+     * \returns Time budget in milliseconds, or 0 to do the whole precomputation in a single call.
+     */
+    virtual double eclipsedDoubleScatteringPrecomputationBudget() { return 0; }
+
+    /**
+     * \brief Memory budget for the cache of altitude slices of the 4D textures.
+     *
+     * This is a performance-memory tradeoff setting.
+     *
+     * Multiple scattering, single scattering, interpolation guides and eclipsed double scattering textures are made of the two altitude slices of the data files that bracket the camera altitude. The slices read are kept in host memory within this budget, least recently used being dropped first, so that a change of altitude back to recently visited slices only redoes the upload. With data generated by older versions of CalcMySky the slices are mixed before the upload, so then any altitude change redoes the mixing too. After each reloading due to an altitude change, the next slices in the direction of the change are read in the background, if the budget can hold them along with the slices in use. Zero disables the cache.
+     *
+     * \returns Budget in MiB.
+     */
+    virtual unsigned altitudeSliceCacheBudget() = 0;
+
     virtual ~Settings() = default;
 };
 
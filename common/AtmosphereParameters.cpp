@@ -455,7 +455,13 @@ void AtmosphereParameters::parse(QString const& atmoDescrFileName, const ForceNo
     {
         throw DataLoadError{QString("Failed to open atmosphere description file: %1").arg(atmoDescr.errorString())};
     }
-    descriptionFileText=atmoDescr.readAll();
+    parseText(atmoDescr.readAll(), atmoDescrFileName, forceNoEDSTextures, skipSpectra);
+}
+
+void AtmosphereParameters::parseText(QString const& text, QString const& atmoDescrFileName,
+                                     const ForceNoEDSTextures forceNoEDSTextures, const SkipSpectra skipSpectra)
+{
+    descriptionFileText=text;
     QTextStream stream(&descriptionFileText, QIODevice::ReadOnly);
     int lineNumber=1;
     int version=0;
@@ -476,6 +482,11 @@ void AtmosphereParameters::parse(QString const& atmoDescrFileName, const ForceNo
             noEclipsedDoubleScatteringTextures=true;
             continue;
         }
+        if(codeAndComment[0]==ALTITUDE_SLICES_MIXED_IN_SHADERS_DIRECTIVE)
+        {
+            altitudeSlicesMixedInShaders=true;
+            continue;
+        }
 
         if(forceNoEDSTextures)
         {
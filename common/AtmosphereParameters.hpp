@@ -109,16 +109,24 @@ struct AtmosphereParameters
     std::vector<Absorber> absorbers;
     bool allTexturesAreRadiance=false;
     bool noEclipsedDoubleScatteringTextures=false;
+    // Whether the rendering shaders take textures of two altitude slices and mix them, rather than a premixed slice
+    bool altitudeSlicesMixedInShaders=false;
     static constexpr unsigned pointsPerWavelengthItem=4;
     static constexpr unsigned FORMAT_VERSION = 6;
     static constexpr char ALL_TEXTURES_ARE_RADIANCES_DIRECTIVE[]="all textures are radiances";
     static constexpr char NO_ECLIPSED_DOUBLE_SCATTERING_TEXTURES_DIRECTIVE[]="no eclipsed double scattering textures";
+    static constexpr char ALTITUDE_SLICES_MIXED_IN_SHADERS_DIRECTIVE[]="altitude slices are mixed in shaders";
     static constexpr char SOLAR_IRRADIANCE_AT_TOA_KEY[]="solar irradiance at toa";
     static constexpr char WAVELENGTHS_KEY[]="wavelengths";
 
     void parse(QString const& atmoDescrFileName,
                ForceNoEDSTextures forceNoEDSTextures=ForceNoEDSTextures{false},
                SkipSpectra skipSpectra=SkipSpectra{false});
+    // Parses the text as if it were the contents of the file atmoDescrFileName, which is used for
+    // error messages and to resolve relative paths to spectrum files
+    void parseText(QString const& text, QString const& atmoDescrFileName,
+                   ForceNoEDSTextures forceNoEDSTextures=ForceNoEDSTextures{false},
+                   SkipSpectra skipSpectra=SkipSpectra{false});
     // XXX: keep in sync with those in previewer and renderer
     auto scatTexWidth()  const { return GLsizei(scatteringTextureSize[0]); }
     auto scatTexHeight() const { return GLsizei(scatteringTextureSize[1]*scatteringTextureSize[2]); }
@@ -1,7 +1,15 @@
 #include "EclipsedDoubleScatteringPrecomputer.hpp"
 
 #include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <cstring>
 #include <chrono>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <system_error>
 
 #include <glm/gtx/transform.hpp>
 
@@ -22,28 +30,163 @@ using std::asin;
 using std::exp;
 using std::log;
 
-static glm::vec4 sumTexels(QOpenGLFunctions_3_3_Core& gl, const GLuint textureToRead,
-                           const double texW, const double texH, const GLenum unusedTextureUnit)
+namespace
 {
-    gl.glActiveTexture(unusedTextureUnit);
-    gl.glBindTexture(GL_TEXTURE_2D, textureToRead);
-    gl.glGenerateMipmap(GL_TEXTURE_2D);
-    using namespace std;
-    // Formula from the glspec, "Mipmapping" subsection in section 3.8.11 Texture Minification
-    const int totalMipmapLevels = 1+floor(log2(std::max(texW,texH)));
-    const int deepestLevel=totalMipmapLevels-1;
-#ifndef NDEBUG
-    // Sanity check
-    int deepestMipmapLevelWidth=-1, deepestMipmapLevelHeight=-1;
-    gl.glGetTexLevelParameteriv(GL_TEXTURE_2D, deepestLevel, GL_TEXTURE_WIDTH, &deepestMipmapLevelWidth);
-    gl.glGetTexLevelParameteriv(GL_TEXTURE_2D, deepestLevel, GL_TEXTURE_HEIGHT, &deepestMipmapLevelHeight);
-    assert(deepestMipmapLevelWidth==1);
-    assert(deepestMipmapLevelHeight==1);
-#endif
-
-    glm::vec4 pixel;
-    gl.glGetTexImage(GL_TEXTURE_2D, deepestLevel, GL_RGBA, GL_FLOAT, &pixel[0]);
-    return pixel * float(texW*texH); // deepest mipmap level is a mean, while we need the sum
+
+std::unique_ptr<QOpenGLShaderProgram> makeReductionProgram(const char* fragmentShaderSrc, QString const& description)
+{
+    static constexpr const char* vertShaderSrc=1+R"(
+#version 330
+in vec3 vertex;
+void main()
+{
+    gl_Position=vec4(vertex,1);
+}
+)";
+    auto program=std::make_unique<QOpenGLShaderProgram>();
+    if(!program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertShaderSrc))
+        throw OpenGLError{QObject::tr("Failed to compile vertex shader for %1:\n%2").arg(description, program->log())};
+    if(!program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSrc))
+        throw OpenGLError{QObject::tr("Failed to compile fragment shader for %1:\n%2").arg(description, program->log())};
+    program->bindAttributeLocation("vertex", 0);
+    if(!program->link())
+        throw OpenGLError{QObject::tr("Failed to link %1:\n%2").arg(description, program->log())};
+    return program;
+}
+
+}
+
+EclipsedDoubleScatteringSamplesReducer::EclipsedDoubleScatteringSamplesReducer(QOpenGLFunctions_3_3_Core& gl,
+                                                                               AtmosphereParameters const& atmo)
+    : gl(gl)
+    , texW(atmo.eclipseAngularIntegrationPoints)
+    , texH(atmo.radialIntegrationPoints)
+{
+    // All the samples of one call to computeRadianceOnCoarseGrid(), as long as they don't take too much VRAM
+    const GLsizei samplesPerCall = 4 * atmo.eclipsedDoubleScatteringNumberOfAzimuthPairsToSample
+                                     * atmo.eclipsedDoubleScatteringNumberOfElevationPairsToSample;
+    constexpr size_t maxBytesForSamples=64<<20;
+    const auto bytesPerSample=size_t(texW)*texH*sizeof(glm::vec4);
+    GLint maxLayers=1;
+    gl.glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    maxSamplesPerBatch_=std::max(GLsizei(1), std::min({samplesPerCall, GLsizei(maxLayers),
+                                                       GLsizei(maxBytesForSamples/bytesPerSample)}));
+
+    gl.glGenTextures(1, &samplesTexture);
+    gl.glBindTexture(GL_TEXTURE_2D_ARRAY, samplesTexture);
+    gl.glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl.glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl.glTexImage3D(GL_TEXTURE_2D_ARRAY,0,GL_RGBA32F,texW,texH,maxSamplesPerBatch_,0,GL_RGBA,GL_FLOAT,nullptr);
+    gl.glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // Sums over rows: one texel per row of each sample
+    gl.glGenTextures(1, &rowSumsTexture);
+    gl.glBindTexture(GL_TEXTURE_2D, rowSumsTexture);
+    gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,texH,maxSamplesPerBatch_,0,GL_RGBA,GL_FLOAT,nullptr);
+
+    // Total sums: one texel per sample
+    gl.glGenTextures(1, &sumsTexture);
+    gl.glBindTexture(GL_TEXTURE_2D, sumsTexture);
+    gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl.glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,maxSamplesPerBatch_,1,0,GL_RGBA,GL_FLOAT,nullptr);
+    gl.glBindTexture(GL_TEXTURE_2D, 0);
+
+    gl.glGenBuffers(1, &readbackBuffer);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+    gl.glBufferData(GL_PIXEL_PACK_BUFFER, maxSamplesPerBatch_*sizeof(glm::vec4), nullptr, GL_STREAM_READ);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if(const auto err=gl.glGetError(); err!=GL_NO_ERROR)
+    {
+        throw OpenGLError{QObject::tr("Failed to create textures for summation of eclipsed double scattering samples: %1")
+                            .arg(openglErrorString(err).c_str())};
+    }
+
+    rowSumsProgram=makeReductionProgram(1+R"(
+#version 330
+uniform sampler2DArray samples;
+out vec4 sum;
+void main()
+{
+    // x: row of the sample image, y: sample index
+    ivec2 rowAndSample=ivec2(gl_FragCoord.xy);
+    int width=textureSize(samples,0).x;
+    vec4 s=vec4(0);
+    for(int x=0; x<width; ++x)
+        s+=texelFetch(samples, ivec3(x, rowAndSample), 0);
+    sum=s;
+}
+)", QObject::tr("eclipsed double scattering row summation program"));
+
+    sumsProgram=makeReductionProgram(1+R"(
+#version 330
+uniform sampler2D rowSums;
+out vec4 sum;
+void main()
+{
+    int sampleIndex=int(gl_FragCoord.x);
+    int rowCount=textureSize(rowSums,0).x;
+    vec4 s=vec4(0);
+    for(int row=0; row<rowCount; ++row)
+        s+=texelFetch(rowSums, ivec2(row, sampleIndex), 0);
+    sum=s;
+}
+)", QObject::tr("eclipsed double scattering sample summation program"));
+}
+
+EclipsedDoubleScatteringSamplesReducer::~EclipsedDoubleScatteringSamplesReducer()
+{
+    gl.glDeleteBuffers(1, &readbackBuffer);
+    const GLuint textures[]={samplesTexture, rowSumsTexture, sumsTexture};
+    gl.glDeleteTextures(std::size(textures), textures);
+}
+
+void EclipsedDoubleScatteringSamplesReducer::setRenderTarget(const GLsizei sampleIndex)
+{
+    assert(sampleIndex < maxSamplesPerBatch_);
+    gl.glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, samplesTexture, 0, sampleIndex);
+}
+
+std::vector<glm::vec4> EclipsedDoubleScatteringSamplesReducer::sumSamples(const GLsizei sampleCount, const GLuint unusedTextureUnitNum)
+{
+    assert(sampleCount <= maxSamplesPerBatch_);
+    gl.glActiveTexture(GL_TEXTURE0+unusedTextureUnitNum);
+
+    gl.glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, rowSumsTexture, 0);
+    gl.glViewport(0, 0, texH, sampleCount);
+    rowSumsProgram->bind();
+    gl.glBindTexture(GL_TEXTURE_2D_ARRAY, samplesTexture);
+    rowSumsProgram->setUniformValue("samples", unusedTextureUnitNum);
+    gl.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    gl.glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sumsTexture, 0);
+    gl.glViewport(0, 0, sampleCount, 1);
+    sumsProgram->bind();
+    gl.glBindTexture(GL_TEXTURE_2D, rowSumsTexture);
+    sumsProgram->setUniformValue("rowSums", unusedTextureUnitNum);
+    gl.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    // The whole texture is read, but only the first sampleCount texels are valid
+    gl.glBindTexture(GL_TEXTURE_2D, sumsTexture);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+    gl.glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, nullptr);
+    std::vector<glm::vec4> sums(sampleCount);
+    const auto data=gl.glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sampleCount*sizeof sums[0], GL_MAP_READ_BIT);
+    if(!data)
+    {
+        gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        throw OpenGLError{QObject::tr("Failed to map the buffer with sums of eclipsed double scattering samples: %1")
+                            .arg(openglErrorString(gl.glGetError()).c_str())};
+    }
+    std::memcpy(sums.data(), data, sampleCount*sizeof sums[0]);
+    gl.glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    gl.glBindTexture(GL_TEXTURE_2D, 0);
+
+    return sums;
 }
 
 float EclipsedDoubleScatteringPrecomputer::cosZenithAngleOfHorizon(const float altitude) const
@@ -145,9 +288,12 @@ EclipsedDoubleScatteringPrecomputer::EclipsedDoubleScatteringPrecomputer(
     , texW(atmo.eclipseAngularIntegrationPoints)
     , texH(atmo.radialIntegrationPoints)
     , texture_(texSizeByViewAzimuth*texSizeByViewElevation*texSizeBySZA*texSizeByAltitude)
-    , fourierIntermediate(texSizeByViewAzimuth)
+    , output(texture_)
+    , changesViewport(true)
+    , fourierInterpolator(std::make_unique<FourierInterpolator>(2*atmo.eclipsedDoubleScatteringNumberOfAzimuthPairsToSample,
+                                                                texSizeByViewAzimuth))
 {
-    // XXX: keep in sync with its use in GLSL computeDoubleScatteringEclipsedDensitySample() and C++ initTexturesAndFramebuffers()
+    // XXX: keep in sync with its use in GLSL computeDoubleScatteringEclipsedDensitySample() and EclipsedDoubleScatteringSamplesReducer's constructor
 
     GLint viewport[4];
     gl.glGetIntegerv(GL_VIEWPORT, viewport);
@@ -155,6 +301,27 @@ EclipsedDoubleScatteringPrecomputer::EclipsedDoubleScatteringPrecomputer(
     origViewportHeight=viewport[3];
     gl.glViewport(0,0, texW,texH);
 
+    allocateWorkData();
+}
+
+EclipsedDoubleScatteringPrecomputer::EclipsedDoubleScatteringPrecomputer(HelperTag, EclipsedDoubleScatteringPrecomputer& parent)
+    : gl(parent.gl)
+    , atmo(parent.atmo)
+    , texSizeByViewAzimuth(parent.texSizeByViewAzimuth)
+    , texSizeByViewElevation(parent.texSizeByViewElevation)
+    , texSizeBySZA(parent.texSizeBySZA)
+    , texW(parent.texW)
+    , texH(parent.texH)
+    , output(parent.texture_)
+    , changesViewport(false)
+    , fourierInterpolator(std::make_unique<FourierInterpolator>(2*atmo.eclipsedDoubleScatteringNumberOfAzimuthPairsToSample,
+                                                                texSizeByViewAzimuth))
+{
+    allocateWorkData();
+}
+
+void EclipsedDoubleScatteringPrecomputer::allocateWorkData()
+{
     const auto nAzimuthPairsToSample=atmo.eclipsedDoubleScatteringNumberOfAzimuthPairsToSample;
     const auto nElevationPairsToSample=atmo.eclipsedDoubleScatteringNumberOfElevationPairsToSample;
     for(auto& s : samplesAboveHorizon)
@@ -168,33 +335,38 @@ EclipsedDoubleScatteringPrecomputer::EclipsedDoubleScatteringPrecomputer(
 
 EclipsedDoubleScatteringPrecomputer::~EclipsedDoubleScatteringPrecomputer()
 {
-    gl.glViewport(0,0, origViewportWidth,origViewportHeight);
+    if(changesViewport)
+        gl.glViewport(0,0, origViewportWidth,origViewportHeight);
 }
 
 void EclipsedDoubleScatteringPrecomputer::computeRadianceOnCoarseGrid(QOpenGLShaderProgram& program,
-                                                                      const GLuint intermediateTextureName,
-                                                                      const GLuint intermediateTextureTexUnitNum,
+                                                                      EclipsedDoubleScatteringSamplesReducer& reducer,
+                                                                      const GLuint unusedTextureUnitNum,
                                                                       const double cameraAltitude, const double sunZenithAngle,
                                                                       const double moonZenithAngle, const double moonAzimuthRelativeToSun,
                                                                       const double earthMoonDistance)
+{
+    beginCoarseGridComputation(cameraAltitude, sunZenithAngle, moonZenithAngle, moonAzimuthRelativeToSun, earthMoonDistance);
+    computeCoarseGridSamples(program, reducer, unusedTextureUnitNum, coarseGridSamples.size());
+}
+
+void EclipsedDoubleScatteringPrecomputer::beginCoarseGridComputation(const double cameraAltitude, const double sunZenithAngle,
+                                                                     const double moonZenithAngle, const double moonAzimuthRelativeToSun,
+                                                                     const double earthMoonDistance)
 {
     const auto nAzimuthPairsToSample=atmo.eclipsedDoubleScatteringNumberOfAzimuthPairsToSample;
 
-    const dvec3 sunDir(sin(sunZenithAngle), 0, cos(sunZenithAngle));
     const dvec3 moonDir = dmat3(rotate(moonAzimuthRelativeToSun,dvec3(0,0,1)))*dvec3(sin(moonZenithAngle), 0, cos(moonZenithAngle));
     const double cameraMoonDistance=[cameraAltitude,moonZenithAngle,earthMoonDistance, this]{
         const auto hpR=cameraAltitude+atmo.earthRadius;
         const auto moonElevation=M_PI/2-moonZenithAngle;
         return -hpR*sin(moonElevation)+sqrt(sqr(earthMoonDistance)-0.5*sqr(hpR)*(1+cos(2*moonElevation)));
     }();
-    const float moonAngularRadius=moonRadius/cameraMoonDistance;
     const dvec3 cameraPos(0,0,cameraAltitude);
-    const dvec3 moonPos=cameraPos+cameraMoonDistance*moonDir;
-    program.setUniformValue("cameraAltitude", GLfloat(cameraAltitude));
-    program.setUniformValue("sunZenithAngle", GLfloat(sunZenithAngle));
-    program.setUniformValue("moonAngularRadius", moonAngularRadius);
-    program.setUniformValue("moonPositionRelativeToSunAzimuth", toQVector(moonPos));
-    program.setUniformValue("eclipsedDoubleScatteringTextureSize", texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA);
+    coarseGridCameraAltitude=cameraAltitude;
+    coarseGridSunZenithAngle=sunZenithAngle;
+    coarseGridMoonAngularRadius=moonRadius/cameraMoonDistance;
+    coarseGridMoonPosition=cameraPos+cameraMoonDistance*moonDir;
 
     // Sample double scattering on a very coarse grid of elevations and azimuths
 
@@ -215,34 +387,58 @@ void EclipsedDoubleScatteringPrecomputer::computeRadianceOnCoarseGrid(QOpenGLSha
     assert(azimuths.size()==nAzimuthPairsToSample);
 
     const auto elevCount=elevationsAboveHorizon.size(); // for each direction: above and below horizon
+    coarseGridSamples.clear();
+    coarseGridSamplesDone_=0;
     for(unsigned azimIndex=0; azimIndex<azimuths.size(); ++azimIndex)
     {
-        const auto azimuth=azimuths[azimIndex];
         for(unsigned elevIndex=0; elevIndex<elevCount; ++elevIndex)
-        {
-            const auto elev=elevationsAboveHorizon[elevIndex];
-            const auto viewDir=mat3(rotate(azimuth,vec3(0,0,1)))*vec3(cos(elev),0,sin(elev));
-            program.setUniformValue("cameraViewDir", toQVector(viewDir));
-            gl.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-            // Extracting the pixel containing the sum - the integral over the view direction and scattering directions
-            const auto integral=sumTexels(gl, intermediateTextureName, texW, texH, GL_TEXTURE0+intermediateTextureTexUnitNum);
-            for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
-                samplesAboveHorizon[i][azimIndex*elevCount+elevIndex]=vec2(elev, integral[i]);
-        }
+            coarseGridSamples.push_back({samplesAboveHorizon, azimIndex*elevCount+elevIndex, elevationsAboveHorizon[elevIndex], azimuths[azimIndex]});
         for(unsigned elevIndex=0; elevIndex<elevCount; ++elevIndex)
+            coarseGridSamples.push_back({samplesBelowHorizon, azimIndex*elevCount+elevIndex, elevationsBelowHorizon[elevIndex], azimuths[azimIndex]});
+    }
+}
+
+bool EclipsedDoubleScatteringPrecomputer::computeCoarseGridSamples(QOpenGLShaderProgram& program,
+                                                                   EclipsedDoubleScatteringSamplesReducer& reducer,
+                                                                   const GLuint unusedTextureUnitNum,
+                                                                   const size_t maxSampleCount)
+{
+    // The program may have been used with other values since the previous call
+    program.bind();
+    program.setUniformValue("cameraAltitude", GLfloat(coarseGridCameraAltitude));
+    program.setUniformValue("sunZenithAngle", GLfloat(coarseGridSunZenithAngle));
+    program.setUniformValue("moonAngularRadius", coarseGridMoonAngularRadius);
+    program.setUniformValue("moonPositionRelativeToSunAzimuth", toQVector(coarseGridMoonPosition));
+    program.setUniformValue("eclipsedDoubleScatteringTextureSize", texSizeByViewAzimuth, texSizeByViewElevation, texSizeBySZA);
+
+    const auto end=std::min(coarseGridSamples.size(), coarseGridSamplesDone_+maxSampleCount);
+    for(size_t batchStart=coarseGridSamplesDone_; batchStart<end; batchStart+=reducer.maxSamplesPerBatch())
+    {
+        const auto batchSize=std::min(end-batchStart, size_t(reducer.maxSamplesPerBatch()));
+        program.bind();
+        gl.glViewport(0,0, texW,texH);
+        for(size_t n=0; n<batchSize; ++n)
         {
-            const auto elev=elevationsBelowHorizon[elevIndex];
-            const auto viewDir=mat3(rotate(azimuth,vec3(0,0,1)))*vec3(cos(elev),0,sin(elev));
+            const auto& sample=coarseGridSamples[batchStart+n];
+            const auto viewDir=mat3(rotate(sample.azimuth,vec3(0,0,1)))*vec3(cos(sample.elev),0,sin(sample.elev));
             program.setUniformValue("cameraViewDir", toQVector(viewDir));
+            reducer.setRenderTarget(n);
             gl.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
 
-            // Extracting the pixel containing the sum - the integral over the view direction and scattering directions
-            const auto integral=sumTexels(gl, intermediateTextureName, texW, texH, GL_TEXTURE0+intermediateTextureTexUnitNum);
+        // The sums are the integrals over the view direction and scattering directions
+        const auto integrals=reducer.sumSamples(batchSize, unusedTextureUnitNum);
+        for(size_t n=0; n<batchSize; ++n)
+        {
+            const auto& sample=coarseGridSamples[batchStart+n];
             for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
-                samplesBelowHorizon[i][azimIndex*elevCount+elevIndex]=vec2(elev, integral[i]);
+                sample.samples[i][sample.index]=vec2(sample.elev, integrals[n][i]);
         }
     }
+    coarseGridSamplesDone_=end;
+    program.bind();
+    gl.glViewport(0,0, texW,texH);
+    return coarseGridSamplesDone_==coarseGridSamples.size();
 }
 
 void EclipsedDoubleScatteringPrecomputer::generateTextureFromCoarseGridData(const unsigned altIndex, const unsigned szaIndex, const double cameraAltitude)
@@ -275,19 +471,22 @@ void EclipsedDoubleScatteringPrecomputer::generateTextureFromCoarseGridData(cons
     }
 
     // 3. Interpolate the samples over the circles of elevations using second order spline interpolation
-    for(unsigned azimIndex=0; azimIndex<nAzimuthPairsToSample; ++azimIndex)
+
+    // The elevations at which the interpolants are sampled don't depend on azimuth, so they are found only
+    // once, and sorted to let each interpolant be sampled in a single sweep over its chunks.
+    struct ElevationQueries
     {
-        SplineOrder2InterpolationFunction<float,vec2> intFuncsAboveHorizon[VEC_ELEM_COUNT];
-        for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
-            intFuncsAboveHorizon[i]=splineInterpolationOrder2(&samplesAboveHorizon[i][azimIndex*elevCount], elevCount);
-        SplineOrder2InterpolationFunction<float,vec2> intFuncsBelowHorizon[VEC_ELEM_COUNT];
-        for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
-            intFuncsBelowHorizon[i]=splineInterpolationOrder2(&samplesBelowHorizon[i][azimIndex*elevCount], elevCount);
+        std::vector<float> elevations;
+        std::vector<unsigned> indices; // of the result for azimIndex=0 in radianceInterpolatedOverElevations
+        std::vector<float> results;
+    } queriesAboveHorizon, queriesBelowHorizon;
+    {
+        struct Query { float elevation; unsigned index; };
+        std::vector<Query> above, below;
         for(unsigned texElevIndex=0; texElevIndex<texSizeByViewElevation; ++texElevIndex)
         {
             const auto [cosVZA, viewRayIntersectsGround]=
                 eclipseTexCoordsToTexVars_cosVZA_VRIG(float(texElevIndex)/(texSizeByViewElevation-1), cameraAltitude);
-            const auto& intFuncs =  viewRayIntersectsGround ?  intFuncsBelowHorizon  : intFuncsAboveHorizon;
             const double elevMin = (viewRayIntersectsGround ? elevationsBelowHorizon : elevationsAboveHorizon).front();
             const double elevMax = (viewRayIntersectsGround ? elevationsBelowHorizon : elevationsAboveHorizon).back();
             for(const bool oppositeAzimuth : {false, true})
@@ -298,29 +497,119 @@ void EclipsedDoubleScatteringPrecomputer::generateTextureFromCoarseGridData(cons
                 // We've not sampled too close to horizon to avoid rounding errors, so let's clamp to the edges of available range
                 elevation = std::clamp(elevation, elevMin, elevMax);
 
-                const auto index = texElevIndex*2*nAzimuthPairsToSample + azimIndex + (oppositeAzimuth ? nAzimuthPairsToSample : 0);
-                for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
-                    radianceInterpolatedOverElevations[i][index]=intFuncs[i].sample(elevation);
+                const auto index = texElevIndex*2*nAzimuthPairsToSample + (oppositeAzimuth ? nAzimuthPairsToSample : 0);
+                (viewRayIntersectsGround ? below : above).push_back({float(elevation), index});
+            }
+        }
+        for(auto [queries, out] : {std::pair{&above, &queriesAboveHorizon}, std::pair{&below, &queriesBelowHorizon}})
+        {
+            std::sort(queries->begin(), queries->end(), [](Query const& a, Query const& b){ return a.elevation < b.elevation; });
+            for(const auto& q : *queries)
+            {
+                out->elevations.push_back(q.elevation);
+                out->indices.push_back(q.index);
+            }
+            out->results.resize(queries->size());
+        }
+    }
+
+    for(unsigned azimIndex=0; azimIndex<nAzimuthPairsToSample; ++azimIndex)
+    {
+        // All the components are sampled at the same elevations, so they are fitted together
+        const auto intFuncsAboveHorizon=splineInterpolationOrder2(std::array<vec2 const*,VEC_ELEM_COUNT>{
+                                                                    &samplesAboveHorizon[0][azimIndex*elevCount],
+                                                                    &samplesAboveHorizon[1][azimIndex*elevCount],
+                                                                    &samplesAboveHorizon[2][azimIndex*elevCount],
+                                                                    &samplesAboveHorizon[3][azimIndex*elevCount]},
+                                                                  elevCount);
+        const auto intFuncsBelowHorizon=splineInterpolationOrder2(std::array<vec2 const*,VEC_ELEM_COUNT>{
+                                                                    &samplesBelowHorizon[0][azimIndex*elevCount],
+                                                                    &samplesBelowHorizon[1][azimIndex*elevCount],
+                                                                    &samplesBelowHorizon[2][azimIndex*elevCount],
+                                                                    &samplesBelowHorizon[3][azimIndex*elevCount]},
+                                                                  elevCount);
+        for(auto [intFuncs, queries] : {std::pair{&intFuncsAboveHorizon, &queriesAboveHorizon},
+                                        std::pair{&intFuncsBelowHorizon, &queriesBelowHorizon}})
+        {
+            for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+            {
+                (*intFuncs)[i].sample(queries->elevations.data(), queries->elevations.size(), queries->results.data());
+                for(unsigned n=0; n<queries->results.size(); ++n)
+                    radianceInterpolatedOverElevations[i][queries->indices[n]+azimIndex]=queries->results[n];
             }
         }
     }
 
     // 4. Interpolate the resulting interpolations over azimuths using Fourier interpolation and save into the final texture
     std::vector<float> interpolated[VEC_ELEM_COUNT];
-    for(auto& in : interpolated)
-        in.resize(texSizeByViewAzimuth);
+    float* interpolatedRows[VEC_ELEM_COUNT];
+    for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
+    {
+        interpolated[i].resize(texSizeByViewAzimuth);
+        interpolatedRows[i]=interpolated[i].data();
+    }
     for(unsigned texElevIndex=0; texElevIndex<texSizeByViewElevation; ++texElevIndex)
     {
         const auto indexInPrevStepArray = texElevIndex*2*nAzimuthPairsToSample;
         const auto indexOfLineInTexture = texSizeByViewAzimuth*(texSizeByViewElevation*(texSizeBySZA*altIndex + szaIndex) +
                                                                 texElevIndex);
+        float const* rows[VEC_ELEM_COUNT];
         for(unsigned i=0; i<VEC_ELEM_COUNT; ++i)
-            fourierInterpolate(&radianceInterpolatedOverElevations[i][indexInPrevStepArray], 2*nAzimuthPairsToSample,
-                               fourierIntermediate.data(),
-                               interpolated[i].data(), texSizeByViewAzimuth);
+            rows[i]=&radianceInterpolatedOverElevations[i][indexInPrevStepArray];
+        fourierInterpolator->interpolate(rows, interpolatedRows, VEC_ELEM_COUNT);
         for(unsigned i=0; i<texSizeByViewAzimuth; ++i)
-            texture_[indexOfLineInTexture+i] = vec4(interpolated[0][i],interpolated[1][i],interpolated[2][i],interpolated[3][i]);
+            output[indexOfLineInTexture+i] = vec4(interpolated[0][i],interpolated[1][i],interpolated[2][i],interpolated[3][i]);
+    }
+}
+
+void EclipsedDoubleScatteringPrecomputer::generateTextureFromCoarseGridData(glm::vec4 const*const data, const size_t numPointsPerSet,
+                                                                            std::vector<double> const& cameraAltitudes,
+                                                                            const unsigned threadCount)
+{
+    const unsigned cellCount=cameraAltitudes.size()*texSizeBySZA;
+    assert(texture_.size()==size_t(cellCount)*texSizeByViewAzimuth*texSizeByViewElevation);
+    if(!cellCount) return;
+
+    // The cells are handed out one by one, since their cost varies with altitude
+    std::atomic<unsigned> nextCell{0};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    const auto work=[&](EclipsedDoubleScatteringPrecomputer& precomputer)
+    {
+        try
+        {
+            for(unsigned cell; (cell=nextCell++) < cellCount;)
+            {
+                const unsigned altIndex=cell/texSizeBySZA, szaIndex=cell%texSizeBySZA;
+                precomputer.loadCoarseGridSamples(cameraAltitudes[altIndex], data+size_t(cell)*numPointsPerSet, numPointsPerSet);
+                precomputer.generateTextureFromCoarseGridData(altIndex, szaIndex, cameraAltitudes[altIndex]);
+            }
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if(!error)
+                error=std::current_exception();
+            nextCell=cellCount; // stop the other threads
+        }
+    };
+
+    std::vector<std::thread> threads;
+    try
+    {
+        for(unsigned n=1; n<std::min(threadCount, cellCount); ++n)
+            threads.emplace_back([this,&work]{ EclipsedDoubleScatteringPrecomputer helper(HelperTag{}, *this); work(helper); });
     }
+    catch(std::system_error const&)
+    {
+        // Continue with the threads that have been started
+    }
+    work(*this);
+    for(auto& thread : threads)
+        thread.join();
+
+    if(error)
+        std::rethrow_exception(error);
 }
 
 void EclipsedDoubleScatteringPrecomputer::convertRadianceToLuminance(glm::mat4 const& radianceToLuminance)
@@ -1,13 +1,45 @@
 #ifndef INCLUDE_ONCE_9100E17F_B7DD_4CC0_8D2F_9DBB66C7D23D
 #define INCLUDE_ONCE_9100E17F_B7DD_4CC0_8D2F_9DBB66C7D23D
 
+#include <memory>
 #include <vector>
 #include <utility>
-#include <complex>
 #include <glm/glm.hpp>
 #include <QtOpenGL>
 #include "AtmosphereParameters.hpp"
 
+class FourierInterpolator;
+
+/* Sums the texels of the images of the integrand rendered for the coarse-grid samples of eclipsed double
+ * scattering. Each sample is rendered into its own layer of an array texture, and then all the layers are
+ * summed in two passes (over rows, then over columns) and read back at once, so that there's only one
+ * CPU-GPU synchronization per batch of samples instead of one per sample.
+ *
+ * This object is expected to be long-lived (unlike EclipsedDoubleScatteringPrecomputer), since creating
+ * its programs and textures is relatively expensive.
+ */
+class EclipsedDoubleScatteringSamplesReducer
+{
+    QOpenGLFunctions_3_3_Core& gl;
+    const GLsizei texW, texH; // size of the image of the integrand for one sample
+    GLsizei maxSamplesPerBatch_;
+    GLuint samplesTexture=0, rowSumsTexture=0, sumsTexture=0;
+    GLuint readbackBuffer=0;
+    std::unique_ptr<QOpenGLShaderProgram> rowSumsProgram, sumsProgram;
+
+public:
+    EclipsedDoubleScatteringSamplesReducer(QOpenGLFunctions_3_3_Core& gl, AtmosphereParameters const& atmo);
+    ~EclipsedDoubleScatteringSamplesReducer();
+    EclipsedDoubleScatteringSamplesReducer(EclipsedDoubleScatteringSamplesReducer const&)=delete;
+    EclipsedDoubleScatteringSamplesReducer& operator=(EclipsedDoubleScatteringSamplesReducer const&)=delete;
+
+    GLsizei maxSamplesPerBatch() const { return maxSamplesPerBatch_; }
+    // Attaches the layer for the sample to the bound draw framebuffer
+    void setRenderTarget(GLsizei sampleIndex);
+    // Changes the current program, viewport and framebuffer attachment. Uses the given texture unit.
+    std::vector<glm::vec4> sumSamples(GLsizei sampleCount, GLuint unusedTextureUnitNum);
+};
+
 class EclipsedDoubleScatteringPrecomputer
 {
     QOpenGLFunctions_3_3_Core& gl;
@@ -18,7 +50,9 @@ class EclipsedDoubleScatteringPrecomputer
 
     const double texW, texH; // size of the intermediate texture we are rendering to
     std::vector<glm::vec4> texture_; // output 4D texture data
-    std::vector<std::complex<float>> fourierIntermediate;
+    std::vector<glm::vec4>& output; // where the texture is generated: texture_ of this object or of the parent of a helper
+    const bool changesViewport;
+    std::unique_ptr<FourierInterpolator> fourierInterpolator; // over azimuths, from the coarse grid to the texture row
     std::vector<float> elevationsAboveHorizon, elevationsBelowHorizon;
 
     static constexpr unsigned VEC_ELEM_COUNT=4; // number of components in the partial radiance vector
@@ -31,14 +65,32 @@ class EclipsedDoubleScatteringPrecomputer
     // These containers are re-used for different altitudes and Sun elevations.
     std::vector<float> radianceInterpolatedOverElevations[VEC_ELEM_COUNT];
 
+    struct CoarseGridSample
+    {
+        std::vector<glm::vec2>* samples; // one of samplesAboveHorizon and samplesBelowHorizon
+        size_t index;
+        float elev;
+        float azimuth;
+    };
+    std::vector<CoarseGridSample> coarseGridSamples;
+    size_t coarseGridSamplesDone_=0;
+    double coarseGridCameraAltitude=0, coarseGridSunZenithAngle=0;
+    float coarseGridMoonAngularRadius=0;
+    glm::dvec3 coarseGridMoonPosition;
+
     GLint origViewportWidth, origViewportHeight;
 
     float cosZenithAngleOfHorizon(const float altitude) const;
     std::pair<float,bool> eclipseTexCoordsToTexVars_cosVZA_VRIG(float vzaTexCoordInUnitRange, float altitude) const;
     void generateElevationsForEclipsedDoubleScattering(float cameraAltitude);
+    // Creates a helper that generates parts of the texture of parent from coarse grid samples.
+    // It doesn't use OpenGL, so it can work in a thread other than that of parent.
+    struct HelperTag {};
+    EclipsedDoubleScatteringPrecomputer(HelperTag, EclipsedDoubleScatteringPrecomputer& parent);
+    void allocateWorkData();
 public:
     /* Preconditions:
-     *   * Rendering FBO is bound, and the target texture is attached to it
+     *   * Rendering FBO is bound (its color attachment is changed by computeRadianceOnCoarseGrid())
      *   * program is bound
      *   * Transmittance texture uniform is set for program
      *   * VAO for a quad is bound
@@ -49,13 +101,31 @@ public:
                                         unsigned texSizeBySZA, unsigned texSizeByAltitude);
     ~EclipsedDoubleScatteringPrecomputer();
 
-    void computeRadianceOnCoarseGrid(QOpenGLShaderProgram& program,
-                                     GLuint intermediateTextureName, GLuint intermediateTextureTexUnitNum,
+    void computeRadianceOnCoarseGrid(QOpenGLShaderProgram& program, EclipsedDoubleScatteringSamplesReducer& reducer,
+                                     GLuint unusedTextureUnitNum,
                                      double cameraAltitude, double sunZenithAngle, double moonZenithAngle,
                                      double moonAzimuthRelativeToSun, double earthMoonDistance);
+    /* Incremental alternative to computeRadianceOnCoarseGrid(), e.g. to spread the computation over several frames.
+     * After beginCoarseGridComputation(), each call to computeCoarseGridSamples() computes at most maxSampleCount
+     * of the remaining samples, and returns true when all of them are done. The preconditions of the constructor
+     * must hold for each call, and the viewport is changed by each call.
+     */
+    void beginCoarseGridComputation(double cameraAltitude, double sunZenithAngle, double moonZenithAngle,
+                                    double moonAzimuthRelativeToSun, double earthMoonDistance);
+    bool computeCoarseGridSamples(QOpenGLShaderProgram& program, EclipsedDoubleScatteringSamplesReducer& reducer,
+                                  GLuint unusedTextureUnitNum, size_t maxSampleCount);
+    size_t coarseGridSampleCount() const { return coarseGridSamples.size(); }
+    size_t coarseGridSamplesDone() const { return coarseGridSamplesDone_; }
     void convertRadianceToLuminance(glm::mat4 const& radianceToLuminance);
     void accumulateLuminance(EclipsedDoubleScatteringPrecomputer const& source, glm::mat4 const& sourceRadianceToLuminance);
     void generateTextureFromCoarseGridData(unsigned altIndex, unsigned szaIndex, double cameraAltitude);
+    /* Does loadCoarseGridSamples() and generateTextureFromCoarseGridData() for all the (altitude, SZA) cells of the
+     * texture, distributing them between up to threadCount threads, each with its own copy of the intermediate data.
+     * data contains numPointsPerSet samples for each cell, the cells being ordered by altitude, then by SZA.
+     * cameraAltitudes contains the altitude of each altitude slice.
+     */
+    void generateTextureFromCoarseGridData(glm::vec4 const* data, size_t numPointsPerSet,
+                                           std::vector<double> const& cameraAltitudes, unsigned threadCount);
 
     size_t appendCoarseGridSamplesTo(std::vector<glm::vec4>& data) const;
     void loadCoarseGridSamples(double cameraAltitude, glm::vec4 const* data, size_t numElements);
@@ -7,4 +7,8 @@ constexpr double AU=astronomicalUnit;
 constexpr double sunRadius=696350e3; /* m */
 constexpr auto moonRadius=1737.1e3; /* m */
 
+// Wavelength sets rendered in one pass by batched shaders. Luminance takes the first draw buffer,
+// and OpenGL 3.3 guarantees at least 8 of them.
+constexpr unsigned wavelengthSetsPerRenderingBatch=7;
+
 #endif
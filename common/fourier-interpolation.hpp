@@ -1,10 +1,12 @@
 #ifndef INCLUDE_ONCE_3A48838B_2D1A_4326_9585_2E19F9D300D1
 #define INCLUDE_ONCE_3A48838B_2D1A_4326_9585_2E19F9D300D1
 
+#include <vector>
+#include <complex>
 #include <algorithm>
 #include <unsupported/Eigen/FFT>
 
-void fourierInterpolate(float const*const points, const std::size_t inPointCount,
+inline void fourierInterpolate(float const*const points, const std::size_t inPointCount,
                         std::complex<float>*const intermediate /* must fit interpolationPointCount elements */,
                         float*const interpolated, std::size_t const interpolationPointCount)
 {
@@ -42,4 +44,87 @@ void fourierInterpolate(float const*const points, const std::size_t inPointCount
         interpolated[i] *= float(interpolationPointCount)/inPointCount;
 }
 
+/* Does the same as fourierInterpolate() for many rows of the same length, reusing the FFT plans and
+ * buffers between the calls. Since the interpolation is linear and maps real signals to real ones,
+ * rows are transformed in pairs packed into real and imaginary parts of a single complex signal,
+ * which halves the number of FFTs.
+ */
+class FourierInterpolator
+{
+    Eigen::FFT<float> fft; // keeps the plans for the lengths it has been used with
+    const std::size_t inPointCount, outPointCount;
+    std::vector<std::complex<float>> packedInput, spectrum, extendedSpectrum, packedOutput;
+
+    // Transforms packedInput into packedOutput
+    void interpolatePacked()
+    {
+        const auto N=inPointCount, M=outPointCount;
+        fft.fwd(spectrum.data(), packedInput.data(), N);
+
+        // Unlike in fourierInterpolate(), the spectrum is not Hermitian, so both halves must be preserved.
+        // Nyquist frequency of an even-length input is split into two half-amplitude components.
+        const auto positiveFreqCount=(N-1)/2; // excluding zero and Nyquist frequencies
+        std::fill(extendedSpectrum.begin(), extendedSpectrum.end(), 0);
+        std::copy_n(spectrum.begin(), positiveFreqCount+1, extendedSpectrum.begin());
+        std::copy_n(spectrum.end()-positiveFreqCount, positiveFreqCount, extendedSpectrum.end()-positiveFreqCount);
+        if(N%2==0)
+        {
+            extendedSpectrum[N/2]   = spectrum[N/2]/2.f;
+            extendedSpectrum[M-N/2] = spectrum[N/2]/2.f;
+        }
+
+        fft.inv(packedOutput.data(), extendedSpectrum.data(), M);
+    }
+public:
+    FourierInterpolator(const std::size_t inPointCount, const std::size_t interpolationPointCount)
+        : inPointCount(inPointCount)
+        , outPointCount(interpolationPointCount)
+        , packedInput(inPointCount)
+        , spectrum(inPointCount)
+        , extendedSpectrum(interpolationPointCount)
+        , packedOutput(interpolationPointCount)
+    {
+        assert(interpolationPointCount >= inPointCount);
+    }
+    std::size_t inputSize() const { return inPointCount; }
+    std::size_t outputSize() const { return outPointCount; }
+
+    // Interpolates rowCount rows: points[row] must have inputSize() elements, interpolated[row] must fit outputSize() elements
+    void interpolate(float const*const*const points, float*const*const interpolated, const std::size_t rowCount)
+    {
+        if(inPointCount==outPointCount)
+        {
+            for(std::size_t row=0; row<rowCount; ++row)
+                std::copy_n(points[row], inPointCount, interpolated[row]);
+            return;
+        }
+
+        const float scale=float(outPointCount)/inPointCount;
+        std::size_t row=0;
+        for(; row+1<rowCount; row+=2)
+        {
+            for(std::size_t i=0; i<inPointCount; ++i)
+                packedInput[i]={points[row][i], points[row+1][i]};
+            interpolatePacked();
+            for(std::size_t i=0; i<outPointCount; ++i)
+            {
+                interpolated[row  ][i] = scale*packedOutput[i].real();
+                interpolated[row+1][i] = scale*packedOutput[i].imag();
+            }
+        }
+        if(row<rowCount)
+        {
+            for(std::size_t i=0; i<inPointCount; ++i)
+                packedInput[i]=points[row][i];
+            interpolatePacked();
+            for(std::size_t i=0; i<outPointCount; ++i)
+                interpolated[row][i] = scale*packedOutput[i].real();
+        }
+    }
+    void interpolate(float const*const points, float*const interpolated)
+    {
+        interpolate(&points, &interpolated, 1);
+    }
+};
+
 #endif
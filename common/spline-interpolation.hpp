@@ -1,9 +1,14 @@
 #ifndef INCLUDE_ONCE_F820C110_1DC9_40B4_8442_EDD0227CB7E8
 #define INCLUDE_ONCE_F820C110_1DC9_40B4_8442_EDD0227CB7E8
 
-#include <Eigen/Dense>
-#include <cassert>
+#include <array>
+#include <cmath>
 #include <vector>
+#include <cassert>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
 
 template<typename Number, typename Vec2>
 class SplineOrder2InterpolationFunction
@@ -19,115 +24,246 @@ public:
         {}
     };
     SplineOrder2InterpolationFunction()=default;
-    SplineOrder2InterpolationFunction(std::vector<Chunk>&& chunks) : chunks(chunks) {}
+    SplineOrder2InterpolationFunction(std::vector<Chunk>&& chunks)
+    {
+        xMax.reserve(chunks.size());
+        a.reserve(chunks.size());
+        b.reserve(chunks.size());
+        c.reserve(chunks.size());
+        for(const auto& chunk : chunks)
+        {
+            assert(xMax.empty() || chunk.xMax >= xMax.back());
+            xMax.push_back(chunk.xMax);
+            a.push_back(chunk.a);
+            b.push_back(chunk.b);
+            c.push_back(chunk.c);
+        }
+    }
     Number sample(Number const x) const
     {
-        assert(!chunks.empty());
+        assert(!xMax.empty());
 
-        std::size_t chunkIndex;
-        for(chunkIndex=0; chunkIndex<chunks.size() && x > chunks[chunkIndex].xMax; ++chunkIndex);
+        // First chunk whose right border is not to the left of x
+        const std::size_t chunkIndex = std::lower_bound(xMax.begin(), xMax.end(), x) - xMax.begin();
+        if(chunkIndex==xMax.size())
+            throw std::out_of_range("Too large x");
 
-        if(chunkIndex==chunks.size())
+        return evaluate(chunkIndex, x);
+    }
+    /* Samples the function at count abscissas xs, writing the results to out. If xs are sorted in
+     * ascending order, chunk lookup is a single sweep merged with the queries, so that the whole call
+     * takes O(count + number of chunks) operations. Otherwise each query does a binary search.
+     */
+    void sample(Number const*const xs, const std::size_t count, Number*const out) const
+    {
+        assert(!xMax.empty());
+        if(!count) return;
+
+        if(!std::is_sorted(xs, xs+count))
+        {
+            for(std::size_t n=0; n<count; ++n)
+                out[n]=sample(xs[n]);
+            return;
+        }
+
+        if(xs[count-1] > xMax.back())
             throw std::out_of_range("Too large x");
 
-        const auto a = chunks[chunkIndex].a;
-        const auto b = chunks[chunkIndex].b;
-        const auto c = chunks[chunkIndex].c;
-        return a*x*x + b*x + c;
+        std::size_t n=0;
+        for(std::size_t chunkIndex=0; n<count; ++chunkIndex)
+        {
+            // Find the run of queries belonging to the current chunk, then evaluate it
+            // in a separate loop free of data-dependent branches, so that it can be vectorized.
+            const auto runEnd = std::find_if(xs+n, xs+count, [border=xMax[chunkIndex]](Number x){ return x > border; }) - xs;
+            const Number ca=a[chunkIndex], cb=b[chunkIndex], cc=c[chunkIndex];
+            for(; n<std::size_t(runEnd); ++n)
+                out[n] = (ca*xs[n] + cb)*xs[n] + cc;
+        }
     }
+    std::size_t chunkCount() const { return xMax.size(); }
 private:
-    std::vector<Chunk> chunks;
+    Number evaluate(const std::size_t chunkIndex, const Number x) const
+    {
+        return (a[chunkIndex]*x + b[chunkIndex])*x + c[chunkIndex];
+    }
+
+    // Structure of arrays: the search only touches xMax, and evaluation of a run of queries reads one element of each other array
+    std::vector<Number> xMax;
+    std::vector<Number> a, b, c;
 };
 
-template<typename Vec2, typename Number=typename std::remove_cv<typename std::remove_reference<decltype(Vec2().x)>::type>::type>
-SplineOrder2InterpolationFunction<Number,Vec2> splineInterpolationOrder2(Vec2 const*const points, const std::size_t pointCount)
+namespace splineInterpolationDetail
 {
-    assert(pointCount>=3);
-    assert(std::is_sorted(points,points+pointCount,[](Vec2 const& a, Vec2 const& b){return a.x<b.x;}));
-
-    const auto sqr=[](Number x){ return x*x; };
-    enum { A=0, B=1, C=2 };
 
-    const int n=pointCount;
-    const int N=3*(n-2);
-
-    using namespace Eigen;
-    using Matrix=Eigen::Matrix<Number, Dynamic, Dynamic>;
-    using Vector=Eigen::Matrix<Number, Dynamic, 1>;
-    Matrix M=Matrix::Zero(N, N);
-    Vector R=Vector::Zero(N);
-
-    // All indices in the comments are 1-based, the equations are written in Wolfram Language
-
-    // Values of first and last functions at endpoints must equal ordinates of corresponding endpoint.
-    // This gives two equations. First:
-    //  a[1] points[[1, 1]]^2 + b[1] points[[1, 1]] + c[1] == points[[1, 2]]
-    /*a[1]*/M(0, 3*0+A)=sqr(points[0].x);
-    /*b[1]*/M(0, 3*0+B)=    points[0].x ;
-    /*c[1]*/M(0, 3*0+C)=1;
-    /*RHS*/ R(0)=points[0].y;
-    // And second:
-    //  a[n - 2] points[[n, 1]]^2 + b[n - 2] points[[n, 1]] + c[n - 2] == points[[n, 2]]
-    /*a[n-2]*/M(1, 3*(n-2-1)+A)=sqr(points[n-1].x);
-    /*b[n-2]*/M(1, 3*(n-2-1)+B)=    points[n-1].x ;
-    /*c[n-2]*/M(1, 3*(n-2-1)+C)=1;
-    /* RHS */ R(1)=points[n-1].y;
-
-    // Value of ith function at (i + 1)th point must be equal to the point ordinate.
-    // This gives (n-2) equations:
-    //  Table[a[i] points[[i + 1, 1]]^2 + b[i] points[[i + 1, 1]] + c[i] == points[[i + 1, 2]], {i, n - 2}]
-    for(int i=0; i<n-2; ++i)
+/* Linear system with a banded matrix, solved by Gaussian elimination with partial pivoting in O(size) operations.
+ * Row interchanges can widen the upper band by LowerBW, so each row stores this much extra room.
+ */
+template<typename Number, int LowerBW, int UpperBW, std::size_t RHSCount>
+class BandedLinearSystem
+{
+    static constexpr int width=2*LowerBW+UpperBW+1;
+    struct Row
     {
-        /*a[i]*/M(2+i, 3*i+A)=sqr(points[i+1].x);
-        /*b[i]*/M(2+i, 3*i+B)=    points[i+1].x ;
-        /*c[i]*/M(2+i, 3*i+C)=1;
-        /*RHS*/ R(2+i)=points[i+1].y;
+        std::array<Number,width> coefs{};
+        std::array<Number,RHSCount> rhs{};
+    };
+    std::vector<Row> rows;
+public:
+    explicit BandedLinearSystem(const int size) : rows(size) {}
+    Number& operator()(const int row, const int col)
+    {
+        assert(col-row+LowerBW >= 0 && col-row+LowerBW < width);
+        return rows[row].coefs[col-row+LowerBW];
     }
-
-    // Value of ith function at midpoint between points (i + 1) and (i + 2) must agree with that of (i + 1)th function
-    // This gives (n-3) equations:
-    //  Table[a[i] ((points[[i + 1, 1]] + points[[i + 2, 1]])/2)^2 + b[i] (points[[i + 1, 1]] + points[[i + 2, 1]])/2 + c[i] == 
-    //          a[i + 1] ((points[[i + 1, 1]] + points[[i + 2, 1]])/2)^2 + b[i + 1] (points[[i + 1, 1]] + points[[i + 2, 1]])/2 + c[i + 1]
-    //        , {i, n - 3}]
-    for(int i=0; i<n-3; ++i)
+    Number& rhs(const int row, const std::size_t k) { return rows[row].rhs[k]; }
+    // Replaces the right-hand sides with the solutions
+    void solve()
     {
-        /*a[i]*/  M(n+i, 3*i+A)     =  sqr(0.5*(points[i+1].x+points[i+2].x));
-        /*b[i]*/  M(n+i, 3*i+B)     =      0.5*(points[i+1].x+points[i+2].x) ;
-        /*c[i]*/  M(n+i, 3*i+C)     =  1;
-        /*a[i+1]*/M(n+i, 3*(i+1)+A) = -sqr(0.5*(points[i+1].x+points[i+2].x));
-        /*b[i+1]*/M(n+i, 3*(i+1)+B) = -    0.5*(points[i+1].x+points[i+2].x) ;
-        /*c[i+1]*/M(n+i, 3*(i+1)+C) = -1;
+        auto& M=*this;
+        const int n=rows.size();
+        for(int k=0; k<n; ++k)
+        {
+            const int lastRow=std::min(k+LowerBW, n-1);
+            const int lastCol=std::min(k+LowerBW+UpperBW, n-1);
+            int pivot=k;
+            for(int r=k+1; r<=lastRow; ++r)
+                if(std::abs(M(r,k)) > std::abs(M(pivot,k)))
+                    pivot=r;
+            if(pivot!=k)
+            {
+                for(int c=k; c<=lastCol; ++c)
+                    std::swap(M(k,c), M(pivot,c));
+                std::swap(rows[k].rhs, rows[pivot].rhs);
+            }
+            assert(M(k,k)!=0);
+            for(int r=k+1; r<=lastRow; ++r)
+            {
+                const Number factor=M(r,k)/M(k,k);
+                if(factor==0) continue;
+                M(r,k)=0;
+                for(int c=k+1; c<=lastCol; ++c)
+                    M(r,c) -= factor*M(k,c);
+                for(std::size_t j=0; j<RHSCount; ++j)
+                    rows[r].rhs[j] -= factor*rows[k].rhs[j];
+            }
+        }
+        for(int k=n-1; k>=0; --k)
+        {
+            const int lastCol=std::min(k+LowerBW+UpperBW, n-1);
+            for(std::size_t j=0; j<RHSCount; ++j)
+            {
+                Number sum=rows[k].rhs[j];
+                for(int c=k+1; c<=lastCol; ++c)
+                    sum -= M(k,c)*rows[c].rhs[j];
+                rows[k].rhs[j]=sum/M(k,k);
+            }
+        }
     }
+};
+
+}
 
-    // Same for derivatives at midpoints, giving us another (n-3) equations:
-    //  Table[2 a[i] (points[[i + 1, 1]] + points[[i + 2, 1]])/2 + b[i] == 2 a[i + 1] (points[[i + 1, 1]] + points[[i + 2, 1]])/2 + b[i + 1]
-    //        , {i, n - 3}]
-    for(int i=0; i<n-3; ++i)
+/* Fits quadratic splines to ComponentCount sets of points that share abscissas (e.g. components of
+ * a vector-valued function), so that the system of equations is assembled and factored only once.
+ *
+ * The spline has n-2 chunks for n points: ith chunk contains (i+1)th point, and the chunks join at the
+ * midpoints between the points with continuous values and derivatives, while the first and the last
+ * chunks also pass through the endpoints. Each chunk is parametrized locally around its point as
+ *    y[i+1] + D[i] t + W[i] t^2,    t = (x - x[i+1]) / s[i],    s[i] = (x[i+2] - x[i]) / 2,
+ * which makes the unknowns D[i], W[i] commensurate with the ordinates and all the matrix elements of
+ * order 1, so that the banded system can be solved without scaling problems.
+ */
+template<typename Vec2, std::size_t ComponentCount,
+         typename Number=typename std::remove_cv<typename std::remove_reference<decltype(Vec2().x)>::type>::type>
+std::array<SplineOrder2InterpolationFunction<Number,Vec2>, ComponentCount>
+    splineInterpolationOrder2(std::array<Vec2 const*, ComponentCount> const& points, const std::size_t pointCount)
+{
+    assert(pointCount>=3);
+    const auto x=[&points](const int i){ return points[0][i].x; };
+#ifndef NDEBUG
+    for(std::size_t k=0; k<ComponentCount; ++k)
     {
-        /*a[i]*/  M(2*n-3+i, 3*i+A)     =  points[i+1].x+points[i+2].x;
-        /*b[i]*/  M(2*n-3+i, 3*i+B)     =  1;
-        /*a[i+1]*/M(2*n-3+i, 3*(i+1)+A) = -(points[i+1].x+points[i+2].x);
-        /*b[i+1]*/M(2*n-3+i, 3*(i+1)+B) = -1;
+        assert(std::is_sorted(points[k],points[k]+pointCount,[](Vec2 const& a, Vec2 const& b){return a.x<b.x;}));
+        for(std::size_t i=0; i<pointCount; ++i)
+            assert(points[k][i].x==x(i));
     }
+#endif
 
-    const Vector ABCs = M.colPivHouseholderQr().solve(R);
+    const int n=pointCount;
+    const int chunkCount=n-2;
+    std::vector<Number> scales(chunkCount);
+    for(int i=0; i<chunkCount; ++i)
+        scales[i]=(x(i+2)-x(i))/2;
 
-    std::vector<typename SplineOrder2InterpolationFunction<Number,Vec2>::Chunk> coefs;
+    // Unknowns are ordered as D[0], W[0], D[1], W[1], ..., equations as: left endpoint, then value and derivative
+    // continuity at each junction, then right endpoint. This gives two sub- and two superdiagonals.
+    enum { D=0, W=1 };
+    splineInterpolationDetail::BandedLinearSystem<Number,2,2,ComponentCount> M(2*chunkCount);
 
-    // Left endpoint
-    coefs.emplace_back((points[1].x+points[2].x)/2,
-                       ABCs(A), ABCs(B), ABCs(C));
+    int row=0;
+    {
+        const Number t=(x(0)-x(1))/scales[0];
+        M(row, 2*0+D)=t;
+        M(row, 2*0+W)=t*t;
+        for(std::size_t k=0; k<ComponentCount; ++k)
+            M.rhs(row, k)=points[k][0].y-points[k][1].y;
+        ++row;
+    }
+    for(int i=0; i<chunkCount-1; ++i)
+    {
+        const Number halfStep=(x(i+2)-x(i+1))/2;
+        const Number tau   =  halfStep/scales[i];   // junction in ith chunk's parameter
+        const Number sigma = -halfStep/scales[i+1]; // junction in (i+1)th chunk's parameter
 
-    // Internal points
-    for(int i=1; i<n-3; ++i)
-        coefs.emplace_back((points[i+1].x+points[i+2].x)/2,
-                           ABCs(3*i+A), ABCs(3*i+B), ABCs(3*i+C));
+        // Values: y[i+1] + D[i] tau + W[i] tau^2 == y[i+2] + D[i+1] sigma + W[i+1] sigma^2
+        M(row, 2*i+D)     =  tau;
+        M(row, 2*i+W)     =  tau*tau;
+        M(row, 2*(i+1)+D) = -sigma;
+        M(row, 2*(i+1)+W) = -sigma*sigma;
+        for(std::size_t k=0; k<ComponentCount; ++k)
+            M.rhs(row, k)=points[k][i+2].y-points[k][i+1].y;
+        ++row;
 
-    // Right endpoint
-    coefs.emplace_back(points[n-1].x,
-                       ABCs(3*(n-3)+A), ABCs(3*(n-3)+B), ABCs(3*(n-3)+C));
+        // Derivatives w.r.t. x, multiplied by halfStep: (D[i] + 2 W[i] tau) tau == -(D[i+1] + 2 W[i+1] sigma) sigma
+        M(row, 2*i+D)     = tau;
+        M(row, 2*i+W)     = 2*tau*tau;
+        M(row, 2*(i+1)+D) = sigma;
+        M(row, 2*(i+1)+W) = 2*sigma*sigma;
+        ++row;
+    }
+    {
+        const int i=chunkCount-1;
+        const Number t=(x(n-1)-x(n-2))/scales[i];
+        M(row, 2*i+D)=t;
+        M(row, 2*i+W)=t*t;
+        for(std::size_t k=0; k<ComponentCount; ++k)
+            M.rhs(row, k)=points[k][n-1].y-points[k][n-2].y;
+    }
+
+    M.solve();
+
+    std::array<SplineOrder2InterpolationFunction<Number,Vec2>, ComponentCount> functions;
+    for(std::size_t k=0; k<ComponentCount; ++k)
+    {
+        std::vector<typename SplineOrder2InterpolationFunction<Number,Vec2>::Chunk> coefs;
+        for(int i=0; i<chunkCount; ++i)
+        {
+            const Number xMax = i+1<chunkCount ? (x(i+1)+x(i+2))/2 : x(n-1);
+            // Convert from the local parametrization to a x^2 + b x + c
+            const Number x0=x(i+1), y0=points[k][i+1].y;
+            const Number d=M.rhs(2*i+D, k)/scales[i];
+            const Number e=M.rhs(2*i+W, k)/(scales[i]*scales[i]);
+            coefs.emplace_back(xMax, e, d-2*e*x0, y0-d*x0+e*x0*x0);
+        }
+        functions[k]=std::move(coefs);
+    }
+    return functions;
+}
 
-    return coefs;
+template<typename Vec2, typename Number=typename std::remove_cv<typename std::remove_reference<decltype(Vec2().x)>::type>::type>
+SplineOrder2InterpolationFunction<Number,Vec2> splineInterpolationOrder2(Vec2 const*const points, const std::size_t pointCount)
+{
+    return splineInterpolationOrder2(std::array<Vec2 const*,1>{points}, pointCount)[0];
 }
 
 #endif
@@ -3,7 +3,7 @@
 #include "phase-functions.h.glsl"
 #include "texture-coordinates.h.glsl"
 
-uniform int layer;
+flat in int layer;
 uniform sampler3D tex;
 uniform bool embedPhaseFunction;
 out vec4 scatteringTextureOutput;
@@ -5,7 +5,7 @@
 #include "texture-coordinates.h.glsl"
 #include "common-functions.h.glsl"
 
-uniform int layer;
+flat in int layer;
 layout(location=0) out vec4 scatteringDensity;
 
 void main()
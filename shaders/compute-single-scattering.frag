@@ -4,7 +4,7 @@
 #include "single-scattering.h.glsl"
 #include "texture-coordinates.h.glsl"
 
-uniform int layer;
+flat in int layer;
 out vec4 scatteringTextureOutput;
 
 void main()
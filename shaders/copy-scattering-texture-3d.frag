@@ -1,6 +1,6 @@
 #version 330
 #include "version.h.glsl"
-uniform int layer;
+flat in int layer;
 uniform sampler3D tex;
 out vec4 copy;
 
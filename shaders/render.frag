@@ -1,6 +1,6 @@
 #version 330
 
-#definitions (RENDERING_ANY_ECLIPSED_SINGLE_SCATTERING, RENDERING_ANY_LIGHT_POLLUTION, RENDERING_ANY_NORMAL_SINGLE_SCATTERING, RENDERING_ANY_SINGLE_SCATTERING, RENDERING_ANY_ZERO_SCATTERING, RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_ECLIPSED_SINGLE_SCATTERING_ON_THE_FLY, RENDERING_ECLIPSED_SINGLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_ECLIPSED_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_ECLIPSED_ZERO_SCATTERING, RENDERING_LIGHT_POLLUTION_LUMINANCE, RENDERING_LIGHT_POLLUTION_RADIANCE, RENDERING_MULTIPLE_SCATTERING_LUMINANCE, RENDERING_MULTIPLE_SCATTERING_RADIANCE, RENDERING_SINGLE_SCATTERING_ON_THE_FLY, RENDERING_SINGLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_ZERO_SCATTERING)
+#definitions (RENDERING_ANY_ECLIPSED_SINGLE_SCATTERING, RENDERING_ANY_LIGHT_POLLUTION, RENDERING_ANY_NORMAL_SINGLE_SCATTERING, RENDERING_ANY_RADIANCE_BATCH, RENDERING_ANY_SINGLE_SCATTERING, RENDERING_ANY_ZERO_SCATTERING, RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_RADIANCE_BATCH, RENDERING_ECLIPSED_SINGLE_SCATTERING_ON_THE_FLY, RENDERING_ECLIPSED_SINGLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_ECLIPSED_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_ECLIPSED_ZERO_SCATTERING, RENDERING_LIGHT_POLLUTION_LUMINANCE, RENDERING_LIGHT_POLLUTION_RADIANCE, RENDERING_LIGHT_POLLUTION_RADIANCE_BATCH, RENDERING_MULTIPLE_SCATTERING_LUMINANCE, RENDERING_MULTIPLE_SCATTERING_RADIANCE, RENDERING_MULTIPLE_SCATTERING_RADIANCE_BATCH, RENDERING_SINGLE_SCATTERING_ON_THE_FLY, RENDERING_SINGLE_SCATTERING_PRECOMPUTED_LUMINANCE, RENDERING_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE, RENDERING_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE_BATCH, RENDERING_ZERO_SCATTERING)
 
 #include "version.h.glsl"
 #include "const.h.glsl"
@@ -11,6 +11,7 @@
 #include_if(RENDERING_ANY_ECLIPSED_SINGLE_SCATTERING) "single-scattering-eclipsed.h.glsl"
 #include "texture-coordinates.h.glsl"
 #include "radiance-to-luminance.h.glsl"
+#include_if(RENDERING_ANY_RADIANCE_BATCH) "wavelength-set-batch.h.glsl"
 #include_if(RENDERING_ANY_ZERO_SCATTERING) "texture-sampling-functions.h.glsl"
 #include_if(RENDERING_ECLIPSED_ZERO_SCATTERING) "eclipsed-direct-irradiance.h.glsl"
 #include_if(RENDERING_ANY_LIGHT_POLLUTION) "texture-sampling-functions.h.glsl"
@@ -29,7 +30,17 @@ uniform bool pseudoMirrorSkyBelowHorizon = false;
 uniform bool useInterpolationGuides=false;
 in vec3 position;
 layout(location=0) out vec4 luminance;
+#if RENDERING_ANY_RADIANCE_BATCH
+// A batch renders several wavelength sets in one pass, each set to its own radiance output. Sampler arrays can
+// only be indexed by constant expressions, so the per-set code is unrolled with FOR_EACH_WAVELENGTH_SET_OF_BATCH.
+uniform sampler3D scatteringTextures[WAVELENGTH_SET_BATCH_SIZE];
+uniform sampler3D eclipsedDoubleScatteringTextures[WAVELENGTH_SET_BATCH_SIZE];
+uniform sampler2D lightPollutionScatteringTextures[WAVELENGTH_SET_BATCH_SIZE];
+uniform vec4 solarIrradianceFixups[WAVELENGTH_SET_BATCH_SIZE];
+layout(location=1) out vec4 radianceOutputs[WAVELENGTH_SET_BATCH_SIZE];
+#else
 layout(location=1) out vec4 radianceOutput;
+#endif
 
 vec4 solarRadiance()
 {
@@ -70,7 +81,12 @@ void main()
             lookingIntoAtmosphere=false;
 #else
             luminance=vec4(0);
+#if RENDERING_ANY_RADIANCE_BATCH
+#define CLEAR_RADIANCE(i) radianceOutputs[i]=vec4(0);
+            FOR_EACH_WAVELENGTH_SET_OF_BATCH(CLEAR_RADIANCE)
+#else
             radianceOutput=vec4(0);
+#endif
             return;
 #endif
         }
@@ -223,6 +239,11 @@ void main()
     radiance*=solarIrradianceFixup;
     luminance=radianceToLuminance*radiance;
     radianceOutput=radiance;
+#elif RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_RADIANCE_BATCH
+    luminance=vec4(0);
+// Single-line macro: line continuation is not available in GLSL 3.30
+#define RENDER_WAVELENGTH_SET(i) { CONST vec4 radiance=solarIrradianceFixups[i]*exp(sampleEclipseDoubleScattering3DTexture(eclipsedDoubleScatteringTextures[i], cosSunZenithAngle, cosViewZenithAngle, azimuthRelativeToSun, altitude, viewRayIntersectsGround)); luminance+=radianceToLuminances[i]*radiance; radianceOutputs[i]=radiance; }
+    FOR_EACH_WAVELENGTH_SET_OF_BATCH(RENDER_WAVELENGTH_SET)
 #elif RENDERING_ECLIPSED_DOUBLE_SCATTERING_PRECOMPUTED_LUMINANCE
     luminance=exp(sampleEclipseDoubleScattering3DTexture(eclipsedDoubleScatteringTexture,
                                                          cosSunZenithAngle, cosViewZenithAngle, azimuthRelativeToSun,
@@ -251,6 +272,11 @@ void main()
     radiance*=solarIrradianceFixup;
     luminance=radianceToLuminance*radiance;
     radianceOutput=radiance;
+#elif RENDERING_SINGLE_SCATTERING_PRECOMPUTED_RADIANCE_BATCH
+    // No interpolation guides here: two more samplers per wavelength set would exceed the guaranteed texture units
+    luminance=vec4(0);
+#define RENDER_WAVELENGTH_SET(i) { CONST vec4 radiance=solarIrradianceFixups[i]*phaseFunctionOfBatch(i, dotViewSun)*sample3DTexture(scatteringTextures[i], cosSunZenithAngle, cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround); luminance+=radianceToLuminances[i]*radiance; radianceOutputs[i]=radiance; }
+    FOR_EACH_WAVELENGTH_SET_OF_BATCH(RENDER_WAVELENGTH_SET)
 #elif RENDERING_SINGLE_SCATTERING_PRECOMPUTED_LUMINANCE
     vec4 scattering;
     if(useInterpolationGuides)
@@ -272,10 +298,19 @@ void main()
     radiance*=solarIrradianceFixup;
     luminance=radianceToLuminance*radiance;
     radianceOutput=radiance;
+#elif RENDERING_MULTIPLE_SCATTERING_RADIANCE_BATCH
+    luminance=vec4(0);
+#define RENDER_WAVELENGTH_SET(i) { CONST vec4 radiance=solarIrradianceFixups[i]*sample3DTexture(scatteringTextures[i], cosSunZenithAngle, cosViewZenithAngle, dotViewSun, altitude, viewRayIntersectsGround); luminance+=radianceToLuminances[i]*radiance; radianceOutputs[i]=radiance; }
+    FOR_EACH_WAVELENGTH_SET_OF_BATCH(RENDER_WAVELENGTH_SET)
 #elif RENDERING_LIGHT_POLLUTION_RADIANCE
     vec4 radiance=lightPollutionGroundLuminance*lightPollutionScattering(altitude, cosViewZenithAngle, viewRayIntersectsGround);
     luminance=radianceToLuminance*radiance;
     radianceOutput=radiance;
+#elif RENDERING_LIGHT_POLLUTION_RADIANCE_BATCH
+    luminance=vec4(0);
+    CONST vec2 lightPollutionTexCoords=lightPollutionTexVarsToTexCoords(altitude, cosViewZenithAngle, viewRayIntersectsGround);
+#define RENDER_WAVELENGTH_SET(i) { CONST vec4 radiance=lightPollutionGroundLuminance*texture(lightPollutionScatteringTextures[i], lightPollutionTexCoords); luminance+=radianceToLuminances[i]*radiance; radianceOutputs[i]=radiance; }
+    FOR_EACH_WAVELENGTH_SET_OF_BATCH(RENDER_WAVELENGTH_SET)
 #elif RENDERING_LIGHT_POLLUTION_LUMINANCE
     luminance=lightPollutionGroundLuminance*lightPollutionScattering(altitude, cosViewZenithAngle, viewRayIntersectsGround);
 #else
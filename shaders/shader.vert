@@ -1,8 +1,10 @@
 #version 330
 in vec3 vertex;
 out vec3 position;
+flat out int instanceID;
 void main()
 {
     position=vertex;
+    instanceID=gl_InstanceID;
     gl_Position=vec4(position,1);
 }
@@ -0,0 +1,15 @@
+#version 330
+#include "version.h.glsl"
+uniform sampler2D tex;
+out vec4 sum;
+
+// Output texel (y,0) gets the sum of the texels of the row y of the input texture
+void main()
+{
+    CONST int row=int(gl_FragCoord.x);
+    CONST int width=textureSize(tex,0).x;
+    vec4 s=vec4(0);
+    for(int x=0; x<width; ++x)
+        s+=texelFetch(tex, ivec2(x, row), 0);
+    sum=s;
+}
@@ -0,0 +1,15 @@
+#version 330
+#include "version.h.glsl"
+uniform sampler3D tex;
+out vec4 sum;
+
+// Output texel (y,z) gets the sum of the texels of the row (y,z) of the input texture
+void main()
+{
+    CONST ivec2 rowAndLayer=ivec2(gl_FragCoord.xy);
+    CONST int width=textureSize(tex,0).x;
+    vec4 s=vec4(0);
+    for(int x=0; x<width; ++x)
+        s+=texelFetch(tex, ivec3(x, rowAndLayer), 0);
+    sum=s;
+}
@@ -8,6 +8,11 @@ const float LENGTH_OF_HORIZ_RAY_FROM_GROUND_TO_TOA=sqrt(atmosphereHeight*(atmosp
 
 uniform sampler2D transmittanceTexture;
 uniform vec3 eclipsedDoubleScatteringTextureSize;
+// The 3D textures sampled for rendering hold the two altitude slices of a 4D texture that bracket the camera
+// altitude: the lower one in the first half of the depth, the upper one in the second half. This is the weight
+// of the upper slice. Eclipsed double scattering precomputed on the fly has only one slice, hence the flag.
+uniform float altitudeSliceMixFactor;
+uniform bool eclipsedDoubleScatteringHasAltitudeSlicePair=true;
 
 struct Scattering4DCoords
 {
@@ -249,10 +254,21 @@ vec3 scattering4DCoordsToTex3DCoords(const Scattering4DCoords coords)
     return vec3(cosVZAtc, dotVStc, cosSZAtc);
 }
 
+// Samples a texture of two altitude slices as if it were a single slice mixed from them
+vec4 sampleAltitudeSlicePair(const sampler3D tex, const vec3 coords)
+{
+    // Clamping to the edge of the slice, as the sampler would do for a single-slice texture
+    CONST float sliceDepth = float(textureSize(tex, 0).p)/2;
+    CONST float lowerSliceCoord = 0.5*clamp(coords.p, 0.5/sliceDepth, 1-0.5/sliceDepth);
+    return mix(texture(tex, vec3(coords.st, lowerSliceCoord)),
+               texture(tex, vec3(coords.st, lowerSliceCoord+0.5)),
+               altitudeSliceMixFactor);
+}
+
 // Sample interpolation guides texture at the given coordinate
 float sampleGuide(const sampler3D guides, const vec3 coords)
 {
-    return texture(guides, coords).r;
+    return sampleAltitudeSlicePair(guides, coords).r;
 }
 float findGuide01Angle(const sampler3D guides, const vec3 indices)
 {
@@ -317,8 +333,8 @@ vec4 sample3DTextureGuided01_log(const sampler3D tex, const sampler3D interpolat
     CONST vec3 coordsNextRow = indicesToTexCoords(indicesNextRow, scatteringTextureSize.stp);
     CONST vec3 coordsCurrRow = indicesToTexCoords(indicesCurrRow, scatteringTextureSize.stp);
 
-    CONST vec4 valueCurrRow = texture(tex, coordsCurrRow);
-    CONST vec4 valueNextRow = texture(tex, coordsNextRow);
+    CONST vec4 valueCurrRow = sampleAltitudeSlicePair(tex, coordsCurrRow);
+    CONST vec4 valueNextRow = sampleAltitudeSlicePair(tex, coordsNextRow);
     CONST float epsilon = 1e-37; // Prevents passing zero to log
     CONST vec4 logValNextRow = log(max(valueNextRow, vec4(epsilon)));
     CONST vec4 logValCurrRow = log(max(valueCurrRow, vec4(epsilon)));
@@ -402,7 +418,7 @@ vec4 sample3DTexture(const sampler3D tex, const float cosSunZenithAngle, const f
     CONST Scattering4DCoords coords4d = scatteringTexVarsTo4DCoords(cosSunZenithAngle,cosViewZenithAngle,
                                                                     dotViewSun,altitude,viewRayIntersectsGround);
     CONST vec3 texCoords=scattering4DCoordsToTex3DCoords(coords4d);
-    return texture(tex, texCoords);
+    return sampleAltitudeSlicePair(tex, texCoords);
 }
 
 ScatteringTexVars scatteringTex4DCoordsToTexVars(const Scattering4DCoords coords)
@@ -577,6 +593,8 @@ vec4 sampleEclipseDoubleScattering3DTexture(const sampler3D tex, const float cos
     CONST float cosSZACoord=unitRangeToTexCoord(cosSZAToUnitRangeTexCoord(cosSunZenithAngle), eclipsedDoubleScatteringTextureSize[2]);
     CONST vec3 texCoords=vec3(coords2d, cosSZACoord);
 
+    if(eclipsedDoubleScatteringHasAltitudeSlicePair)
+        return sampleAltitudeSlicePair(tex, texCoords);
     return texture(tex, texCoords);
 }
 
@@ -0,0 +1,104 @@
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include "../common/spline-interpolation.hpp"
+
+/* Compares sampling of SplineOrder2InterpolationFunction with the linear scan over chunks that was used
+ * before, for the number of points and queries typical of eclipsed double scattering texture generation.
+ * Usage: benchmark-Spline-interpolation [pointCount [queryCount [repetitionCount]]]
+ */
+
+struct Point
+{
+    float x, y;
+};
+
+// The previous implementation: array of structures and a linear search for each query
+class LinearScanSpline
+{
+    struct Chunk { float xMax, a, b, c; };
+    std::vector<Chunk> chunks;
+public:
+    LinearScanSpline(std::vector<Point> const& points)
+    {
+        // Piecewise quadratics with the same borders as a spline would have; the coefficients don't matter here
+        for(std::size_t i=1; i+1<points.size(); ++i)
+        {
+            const float xMax = i+2<points.size() ? (points[i].x+points[i+1].x)/2 : points.back().x;
+            chunks.push_back({xMax, points[i].y, points[i].x, points[i+1].y});
+        }
+    }
+    float sample(float const x) const
+    {
+        std::size_t chunkIndex;
+        for(chunkIndex=0; chunkIndex<chunks.size() && x > chunks[chunkIndex].xMax; ++chunkIndex);
+        if(chunkIndex==chunks.size())
+            throw std::out_of_range("Too large x");
+        const auto& ch=chunks[chunkIndex];
+        return ch.a*x*x + ch.b*x + ch.c;
+    }
+};
+
+template<typename Func>
+double measureSeconds(const unsigned repetitionCount, Func&& func)
+{
+    const auto t0=std::chrono::steady_clock::now();
+    for(unsigned n=0; n<repetitionCount; ++n)
+        func();
+    const auto t1=std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(t1-t0).count();
+}
+
+int main(int argc, char** argv)
+{
+    const unsigned pointCount = argc>1 ? std::atoi(argv[1]) : 64;
+    const unsigned queryCount = argc>2 ? std::atoi(argv[2]) : 256;
+    const unsigned repetitionCount = argc>3 ? std::atoi(argv[3]) : 20000;
+    if(pointCount<3)
+    {
+        std::cerr << "Need at least 3 points\n";
+        return 1;
+    }
+
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> dist(-1,1);
+    std::vector<Point> points(pointCount);
+    for(unsigned i=0; i<pointCount; ++i)
+        points[i]={float(i)/(pointCount-1), dist(gen)};
+
+    std::vector<float> queries(queryCount);
+    for(auto& q : queries)
+        q=(dist(gen)+1)/2;
+    std::vector<float> sortedQueries=queries;
+    std::sort(sortedQueries.begin(), sortedQueries.end());
+
+    const LinearScanSpline linear(points);
+    const auto spline=splineInterpolationOrder2(points.data(), points.size());
+
+    std::vector<float> out(queryCount);
+    double checksum=0;
+    const auto linearTime=measureSeconds(repetitionCount, [&]{
+        for(unsigned n=0; n<queryCount; ++n)
+            out[n]=linear.sample(queries[n]);
+        checksum+=out[0];
+    });
+    const auto binarySearchTime=measureSeconds(repetitionCount, [&]{
+        spline.sample(queries.data(), queryCount, out.data());
+        checksum+=out[0];
+    });
+    const auto sweepTime=measureSeconds(repetitionCount, [&]{
+        spline.sample(sortedQueries.data(), queryCount, out.data());
+        checksum+=out[0];
+    });
+
+    const auto nsPerQuery=[=](double seconds){ return 1e9*seconds/(double(repetitionCount)*queryCount); };
+    std::cout << pointCount << " points, " << queryCount << " queries, " << repetitionCount << " repetitions\n"
+              << "linear scan per query:          " << nsPerQuery(linearTime)       << " ns/query\n"
+              << "binary search per query:        " << nsPerQuery(binarySearchTime) << " ns/query\n"
+              << "merged sweep of sorted queries: " << nsPerQuery(sweepTime)        << " ns/query\n"
+              << "(checksum " << checksum << ")\n";
+}
@@ -0,0 +1,31 @@
+# Computes the atmosphere without --jobs, with a single job and with several jobs,
+# and checks that the resulting luminance textures are bit-identical.
+#
+# Expects CALCMYSKY, ATMO_DESCR and WORK_DIR to be defined.
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+
+foreach(run "default" "1" "3")
+    set(args "${ATMO_DESCR}" --out-dir "${WORK_DIR}/${run}")
+    if(NOT run STREQUAL "default")
+        list(APPEND args --jobs ${run})
+    endif()
+    execute_process(COMMAND "${CALCMYSKY}" ${args} RESULT_VARIABLE result OUTPUT_QUIET ERROR_VARIABLE errors)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "calcmysky failed in the run \"${run}\":\n${errors}")
+    endif()
+endforeach()
+
+file(GLOB_RECURSE outputs RELATIVE "${WORK_DIR}/default" "${WORK_DIR}/default/*-xyzw.f32")
+if(NOT outputs)
+    message(FATAL_ERROR "No luminance textures were saved")
+endif()
+foreach(output ${outputs})
+    foreach(run "1" "3")
+        execute_process(COMMAND "${CMAKE_COMMAND}" -E compare_files "${WORK_DIR}/default/${output}" "${WORK_DIR}/${run}/${output}"
+                        RESULT_VARIABLE differ)
+        if(NOT differ EQUAL 0)
+            message(FATAL_ERROR "${output} computed with --jobs ${run} differs from the one computed without --jobs")
+        endif()
+    endforeach()
+endforeach()
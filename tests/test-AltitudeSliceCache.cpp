@@ -0,0 +1,194 @@
+#include <string>
+#include <iostream>
+#include <QFile>
+#include <QTemporaryDir>
+#include "../ShowMySky/AltitudeSliceCache.hpp"
+#include "../common/util.hpp"
+
+constexpr qint64 headerSize=16;
+constexpr qint64 sliceSize=64;
+constexpr int sliceCount=6;
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+#define CHECK_COUNTS(cache, expectedHits, expectedMisses)                                                   \
+    if(cache.hitCount()!=expectedHits || cache.missCount()!=expectedMisses)                                 \
+        FAIL("expected " << expectedHits << " hits and " << expectedMisses << " misses, got "               \
+             << cache.hitCount() << " hits and " << cache.missCount() << " misses")
+
+// Header is filled with '#', slice i with the character 'A'+i
+QString createSlicedFile(QTemporaryDir const& dir)
+{
+    const auto path=dir.filePath("sliced.dat");
+    QFile file(path);
+    if(!file.open(QFile::WriteOnly))
+        return {};
+    file.write(QByteArray(headerSize, '#'));
+    for(int i=0; i<sliceCount; ++i)
+        file.write(QByteArray(sliceSize, char('A'+i)));
+    return path;
+}
+
+bool sliceIs(AltitudeSliceCache::Slice const& slice, const int index)
+{
+    if(!slice || qint64(slice->size())!=sliceSize)
+        return false;
+    for(const char c : *slice)
+        if(c!=char('A'+index))
+            return false;
+    return true;
+}
+
+int testReading(QString const& path)
+{
+    AltitudeSliceCache cache;
+    cache.setBudget(4*sliceSize);
+    const auto header=cache.header(path, headerSize);
+    if(header.data!=QByteArray(headerSize, '#'))
+        FAIL("wrong header data");
+    if(header.fileSize!=headerSize+sliceCount*sliceSize)
+        FAIL("wrong file size: " << header.fileSize);
+
+    const auto [lower, upper]=cache.slicePair(path, headerSize, sliceSize, 2);
+    if(!sliceIs(lower, 2) || !sliceIs(upper, 3))
+        FAIL("wrong slice data");
+    CHECK_COUNTS(cache, 0u, 2u);
+
+    const auto [lowerAgain, upperAgain]=cache.slicePair(path, headerSize, sliceSize, 2);
+    if(lowerAgain!=lower || upperAgain!=upper)
+        FAIL("cached slices aren't reused");
+    CHECK_COUNTS(cache, 2u, 2u);
+    return 0;
+}
+
+int testEviction(QString const& path)
+{
+    AltitudeSliceCache cache;
+    cache.setBudget(3*sliceSize);
+    cache.header(path, headerSize);
+
+    cache.slicePair(path, headerSize, sliceSize, 0);
+    cache.slicePair(path, headerSize, sliceSize, 1); // slice 1 is a hit, and 0 becomes least recently used
+    CHECK_COUNTS(cache, 1u, 3u);
+
+    cache.slicePair(path, headerSize, sliceSize, 3); // evicts 0 and 1
+    CHECK_COUNTS(cache, 1u, 5u);
+    cache.slicePair(path, headerSize, sliceSize, 2); // slices 2 and 3 must have survived
+    CHECK_COUNTS(cache, 3u, 5u);
+    cache.slicePair(path, headerSize, sliceSize, 0); // 0 and 1 must be read again
+    CHECK_COUNTS(cache, 3u, 7u);
+
+    cache.setBudget(2*sliceSize); // keeps only the most recently used 0 and 1
+    cache.slicePair(path, headerSize, sliceSize, 0);
+    CHECK_COUNTS(cache, 5u, 7u);
+    cache.slicePair(path, headerSize, sliceSize, 2);
+    CHECK_COUNTS(cache, 5u, 9u);
+
+    cache.clear();
+    cache.slicePair(path, headerSize, sliceSize, 2);
+    CHECK_COUNTS(cache, 5u, 11u);
+    return 0;
+}
+
+int testZeroBudget(QString const& path)
+{
+    AltitudeSliceCache cache;
+    cache.header(path, headerSize);
+    const auto [lower, upper]=cache.slicePair(path, headerSize, sliceSize, 4);
+    if(!sliceIs(lower, 4) || !sliceIs(upper, 5))
+        FAIL("wrong slice data");
+    cache.prefetchNeighbours(0);
+    cache.waitForPrefetches();
+    cache.slicePair(path, headerSize, sliceSize, 4);
+    CHECK_COUNTS(cache, 0u, 4u);
+    return 0;
+}
+
+int testPrefetch(QString const& path)
+{
+    AltitudeSliceCache cache;
+    cache.setBudget(sliceCount*sliceSize);
+    cache.header(path, headerSize);
+
+    cache.slicePair(path, headerSize, sliceSize, 2);
+    cache.prefetchNeighbours(+1); // reads slice 4 only
+    cache.waitForPrefetches();
+    CHECK_COUNTS(cache, 0u, 3u);
+    const auto [lower, upper]=cache.slicePair(path, headerSize, sliceSize, 3);
+    if(!sliceIs(lower, 3) || !sliceIs(upper, 4))
+        FAIL("wrong prefetched slice data");
+    CHECK_COUNTS(cache, 2u, 3u);
+
+    cache.prefetchNeighbours(0); // slice 5 above and 2 below, which is still cached
+    cache.waitForPrefetches();
+    CHECK_COUNTS(cache, 2u, 4u);
+
+    cache.slicePair(path, headerSize, sliceSize, 4);
+    cache.prefetchNeighbours(+1); // nothing above the topmost pair
+    cache.waitForPrefetches();
+    CHECK_COUNTS(cache, 4u, 4u);
+
+    // The current pair and one neighbour don't fit in two slices, so nothing must be prefetched
+    cache.setBudget(2*sliceSize);
+    cache.slicePair(path, headerSize, sliceSize, 0);
+    cache.prefetchNeighbours(+1);
+    cache.waitForPrefetches();
+    CHECK_COUNTS(cache, 4u, 6u);
+    return 0;
+}
+
+int testReadFailure(QString const& path)
+{
+    AltitudeSliceCache cache;
+    cache.setBudget(sliceCount*sliceSize);
+    cache.header(path, headerSize);
+    for(int attempt=0; attempt<2; ++attempt)
+    {
+        try
+        {
+            cache.slicePair(path, headerSize, sliceSize, sliceCount-1); // the upper slice is past the end
+            FAIL("reading past the end of file didn't throw");
+        }
+        catch(DataLoadError const&)
+        {
+        }
+    }
+    // The failed read must not be cached
+    CHECK_COUNTS(cache, 1u, 3u);
+    return 0;
+}
+
+int main(int argc, char** argv)
+try
+{
+    if(argc!=2)
+    {
+        std::cerr << "Which test to run?\n";
+        return 1;
+    }
+
+    QTemporaryDir dir;
+    if(!dir.isValid())
+        FAIL("failed to create temporary directory");
+    const auto path=createSlicedFile(dir);
+    if(path.isEmpty())
+        FAIL("failed to create test file");
+
+    const std::string arg=argv[1];
+    if(arg=="reading")
+        return testReading(path);
+    if(arg=="eviction")
+        return testEviction(path);
+    if(arg=="zero budget")
+        return testZeroBudget(path);
+    if(arg=="prefetch")
+        return testPrefetch(path);
+    if(arg=="read failure")
+        return testReadFailure(path);
+
+    std::cerr << "Unknown test " << arg << "\n";
+    return 1;
+}
+catch(ShowMySky::Error const& ex)
+{
+    std::cerr << ex.errorType() << ": " << ex.what() << "\n";
+    return 1;
+}
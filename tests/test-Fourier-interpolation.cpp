@@ -1,4 +1,5 @@
 #include <limits>
+#include <iterator>
 #include <iostream>
 #include "../common/fourier-interpolation.hpp"
 
@@ -126,6 +127,54 @@ int testFractionalUpsampling(const bool oddInputSize)
     return 0;
 }
 
+int testBatchedInterpolation(const bool oddInputSize)
+{
+    if(int(oddInputSize) != input.size()%2)
+        input.pop_back();
+
+    // Three rows to check both the paired and the unpaired paths
+    std::vector<float> rows[3];
+    for(unsigned i=0; i<input.size(); ++i)
+    {
+        rows[0].push_back(input[i]);
+        rows[1].push_back(input[input.size()-1-i]);
+        rows[2].push_back(2*input[i]-1);
+    }
+
+    const unsigned outputSize = input.size()*5/2;
+    FourierInterpolator interpolator(input.size(), outputSize);
+    std::vector<float> interpolated[std::size(rows)];
+    float const* rowPointers[std::size(rows)];
+    float* interpolatedPointers[std::size(rows)];
+    for(unsigned row=0; row<std::size(rows); ++row)
+    {
+        interpolated[row].resize(outputSize);
+        rowPointers[row]=rows[row].data();
+        interpolatedPointers[row]=interpolated[row].data();
+    }
+    // Repeated calls must reuse the state correctly
+    for(int repetition=0; repetition<2; ++repetition)
+    {
+        interpolator.interpolate(rowPointers, interpolatedPointers, std::size(rows));
+
+        for(unsigned row=0; row<std::size(rows); ++row)
+        {
+            std::vector<float> reference(outputSize);
+            std::vector<std::complex<float>> intermediate(outputSize);
+            fourierInterpolate(rows[row].data(), rows[row].size(), intermediate.data(), reference.data(), reference.size());
+            for(unsigned k=0; k<outputSize; ++k)
+            {
+                const auto diff = interpolated[row][k]-reference[k];
+                if(std::abs(diff) > interpolationAbsoluteTolerance)
+                    FAIL("batched output for row " << row << " at index " << k << " differs from single-row output by "
+                         << diff << ", which is more than " << interpolationAbsoluteTolerance << "\n");
+            }
+        }
+    }
+
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     std::cerr.precision(std::numeric_limits<float>::max_digits10);
@@ -150,6 +199,8 @@ int main(int argc, char** argv)
         return testIntegralUpsampling(odd);
     if(arg=="fractional upsampling")
         return testFractionalUpsampling(odd);
+    if(arg=="batched interpolation")
+        return testBatchedInterpolation(odd);
 
     std::cerr << "Unknown test " << arg << "\n";
     return 1;
@@ -1,4 +1,5 @@
 #include <limits>
+#include <algorithm>
 #include <iostream>
 #include "../common/spline-interpolation.hpp"
 
@@ -68,5 +69,51 @@ int main()
                  << interpolationAbsoluteTolerance << "\n");
     }
 
+    // Batched fitting of several components sharing abscissas must give the same result as fitting them separately
+    std::vector<Point> scaledInput;
+    for(const auto& p : input)
+        scaledInput.push_back({p.x, 3*p.y-1});
+    const auto batch=splineInterpolationOrder2(std::array<Point const*,2>{input.data(), scaledInput.data()}, input.size());
+    for(unsigned k=0; k<reference.size(); ++k)
+    {
+        const auto& p=reference[k];
+        const auto diff0 = batch[0].sample(p.x)-p.y;
+        if(std::abs(diff0) > interpolationAbsoluteTolerance)
+            FAIL("batched component 0 at x=" << p.x << " (k=" << k << ") differs from reference by " << diff0 << "\n");
+        const auto diff1 = batch[1].sample(p.x)-(3*p.y-1);
+        if(std::abs(diff1) > 3*interpolationAbsoluteTolerance)
+            FAIL("batched component 1 at x=" << p.x << " (k=" << k << ") differs from reference by " << diff1 << "\n");
+    }
+
+    // Sampling of many points at once must agree with sampling them one by one, for sorted as well as unsorted abscissas
+    std::vector<double> xs, ys(reference.size());
+    for(const auto& p : reference)
+        xs.push_back(p.x);
+    interpolated.sample(xs.data(), xs.size(), ys.data());
+    for(unsigned k=0; k<reference.size(); ++k)
+    {
+        if(ys[k]!=interpolated.sample(xs[k]))
+            FAIL("sorted batch sample at x=" << xs[k] << " (k=" << k << ") differs from single sample by "
+                 << ys[k]-interpolated.sample(xs[k]) << "\n");
+    }
+    std::reverse(xs.begin(), xs.end());
+    interpolated.sample(xs.data(), xs.size(), ys.data());
+    for(unsigned k=0; k<reference.size(); ++k)
+    {
+        if(ys[k]!=interpolated.sample(xs[k]))
+            FAIL("unsorted batch sample at x=" << xs[k] << " (k=" << k << ") differs from single sample by "
+                 << ys[k]-interpolated.sample(xs[k]) << "\n");
+    }
+    try
+    {
+        const double tooLarge[]={0., input.back().x+1};
+        double out[2];
+        interpolated.sample(tooLarge, 2, out);
+        FAIL("sampling beyond the domain didn't throw\n");
+    }
+    catch(std::out_of_range const&)
+    {
+    }
+
     return 0;
 }
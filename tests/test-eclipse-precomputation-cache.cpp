@@ -0,0 +1,169 @@
+#include <cmath>
+#include <memory>
+#include <iostream>
+#include <QSurfaceFormat>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QGuiApplication>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLFunctions_3_3_Core>
+#include <ShowMySky/AtmosphereRenderer.hpp>
+
+#define FAIL(details) { std::cerr << __FILE__ << ":" << __LINE__  << ": test failed: " << details << "\n"; return 1; }
+#define CHECK_DOUBLE_SCATTERING_COUNTS(renderer, expectedHits, expectedMisses)                                              \
+    if(const auto stats=renderer->eclipsePrecomputationCacheStats();                                                        \
+       stats.doubleScatteringHits!=expectedHits || stats.doubleScatteringMisses!=expectedMisses)                            \
+        FAIL("expected " << expectedHits << " hits and " << expectedMisses << " misses, got "                               \
+             << stats.doubleScatteringHits << " hits and " << stats.doubleScatteringMisses << " misses")
+
+constexpr double degree=M_PI/180;
+
+struct Settings : ShowMySky::Settings
+{
+    double altitudeValue=0;
+    double moonAzimuthValue=0;
+
+    double altitude() override { return altitudeValue; }
+    double sunAzimuth() override { return 0; }
+    double sunZenithAngle() override { return 60*degree; }
+    double sunAngularRadius() override { return 0.25*degree; }
+    double moonAzimuth() override { return moonAzimuthValue; }
+    double moonZenithAngle() override { return 60*degree; }
+    double earthMoonDistance() override { return 384400e3; }
+    bool zeroOrderScatteringEnabled() override { return false; }
+    bool singleScatteringEnabled() override { return false; }
+    bool multipleScatteringEnabled() override { return true; }
+    double lightPollutionGroundLuminance() override { return 0; }
+    bool onTheFlySingleScatteringEnabled() override { return false; }
+    bool onTheFlyPrecompDoubleScatteringEnabled() override { return true; }
+    bool usingEclipseShader() override { return true; }
+    bool pseudoMirrorEnabled() override { return false; }
+    unsigned eclipsePrecomputationCacheSize() override { return 8; }
+    unsigned altitudeSliceCacheBudget() override { return 256; }
+};
+
+constexpr const char* viewDirVertShaderSrc=1+R"(
+#version 330
+in vec3 vertex;
+out vec3 position;
+void main()
+{
+    position=vertex;
+    gl_Position=vec4(position,1);
+}
+)";
+constexpr const char* viewDirFragShaderSrc=1+R"(
+#version 330
+in vec3 position;
+const float PI=3.1415926535897932;
+vec3 calcViewDir()
+{
+    return vec3(cos(position.x*PI)*cos(position.y*(PI/2)),
+                sin(position.x*PI)*cos(position.y*(PI/2)),
+                sin(position.y*(PI/2)));
+}
+)";
+
+template<typename Step>
+bool completeSteps(Step const& step)
+{
+    for(auto status=step(); ; status=step())
+    {
+        if(status.stepsToDo<0)
+            return false;
+        if(status.stepsDone>=status.stepsToDo)
+            return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc!=2)
+    {
+        std::cerr << "Usage: " << argv[0] << " pathToData\n";
+        return 1;
+    }
+    const QString pathToData=argv[1];
+
+    QSurfaceFormat format;
+    format.setMajorVersion(3);
+    format.setMinorVersion(3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    QSurfaceFormat::setDefaultFormat(format);
+    QGuiApplication app(argc, argv);
+
+    QOpenGLContext context;
+    if(!context.create())
+        FAIL("failed to create OpenGL context");
+    QOffscreenSurface surface;
+    surface.create();
+    if(!context.makeCurrent(&surface))
+        FAIL("failed to make OpenGL context current");
+    QOpenGLFunctions_3_3_Core gl;
+    if(!gl.initializeOpenGLFunctions())
+        FAIL("failed to initialize OpenGL functions");
+
+    GLuint vao=0, vbo=0;
+    gl.glGenVertexArrays(1, &vao);
+    gl.glBindVertexArray(vao);
+    gl.glGenBuffers(1, &vbo);
+    gl.glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    const GLfloat vertices[]={-1,-1, 1,-1, -1,1, 1,1};
+    gl.glBufferData(GL_ARRAY_BUFFER, sizeof vertices, vertices, GL_STATIC_DRAW);
+    constexpr GLuint attribIndex=0;
+    gl.glVertexAttribPointer(attribIndex, 2, GL_FLOAT, false, 0, 0);
+    gl.glEnableVertexAttribArray(attribIndex);
+    gl.glBindVertexArray(0);
+
+    Settings settings;
+    const std::function drawSurface=[&](QOpenGLShaderProgram&)
+    {
+        gl.glBindVertexArray(vao);
+        gl.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        gl.glBindVertexArray(0);
+    };
+
+    try
+    {
+        const std::unique_ptr<ShowMySky::AtmosphereRenderer>
+            renderer(ShowMySky_AtmosphereRenderer_create(&gl, &pathToData, &settings, &drawSurface));
+        renderer->initDataLoading(viewDirVertShaderSrc, viewDirFragShaderSrc, {{"vertex", attribIndex}});
+        if(!completeSteps([&]{ return renderer->stepDataLoading(); }))
+            FAIL("failed to load data");
+        renderer->resizeEvent(64, 32);
+
+        const auto drawAt=[&](const double altitude, const double moonAzimuth)
+        {
+            settings.altitudeValue=altitude;
+            settings.moonAzimuthValue=moonAzimuth;
+            if(renderer->initPreparationToDraw()>0 && !completeSteps([&]{ return renderer->stepPreparationToDraw(); }))
+                return false;
+            renderer->draw(1, true);
+            return true;
+        };
+        const double groundAltitude=0, highAltitude=10e3;
+        const double moonAzimuth1=0.3*degree, moonAzimuth2=0.6*degree;
+
+        if(!drawAt(groundAltitude, moonAzimuth1) || !drawAt(groundAltitude, moonAzimuth2))
+            FAIL("failed to prepare to draw");
+        CHECK_DOUBLE_SCATTERING_COUNTS(renderer, 0u, 2u);
+
+        // Other altitude slices have to be loaded for this altitude
+        if(!drawAt(highAltitude, moonAzimuth2))
+            FAIL("failed to prepare to draw");
+        CHECK_DOUBLE_SCATTERING_COUNTS(renderer, 0u, 3u);
+
+        // Both geometries computed before the altitude changes must still be cached
+        if(!drawAt(groundAltitude, moonAzimuth2))
+            FAIL("failed to prepare to draw");
+        CHECK_DOUBLE_SCATTERING_COUNTS(renderer, 1u, 3u);
+        if(!drawAt(groundAltitude, moonAzimuth1))
+            FAIL("failed to prepare to draw");
+        CHECK_DOUBLE_SCATTERING_COUNTS(renderer, 2u, 3u);
+    }
+    catch(ShowMySky::Error const& ex)
+    {
+        FAIL(ex.errorType().toStdString() << ": " << ex.what().toStdString());
+    }
+    return 0;
+}